@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <chrono>
+#include "manipDaemon.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+//Client end of the manipDaemon connection.  See manipDaemon.h.
+
+static std::mutex clientLock;					// one request at a time on the socket
+static int clientFd = -1;
+static int clientManips = -1;					// manipulators the daemon has open (from the hello)
+//Round trip timing: what the call took here, less what the daemon says it spent on it
+static unsigned clientRequests = 0;
+static unsigned long long clientRoundTripNs = 0;
+static unsigned long long clientOverheadNs = 0;
+static unsigned long long clientMaxOverheadNs = 0;
+
+#ifndef _WIN32
+// Send or receive exactly length bytes
+static int clientTransfer(int sending, void *buffer, size_t length)
+{
+	char *bytes = (char*)buffer;
+	while (length > 0) {
+		ssize_t done = sending ? send(clientFd, bytes, length, MSG_NOSIGNAL) : recv(clientFd, bytes, length, 0);
+		if (done < 0 && errno == EINTR)
+			continue;
+		if (done <= 0)
+			return 0;
+		bytes += done;
+		length -= (size_t)done;
+	}
+	return 1;
+}
+#endif
+
+// Send one request and wait for its reply.  replyPayload (room for maxReplyPayload bytes)
+// gets whatever follows the reply header.  Losing the daemon disconnects.
+static int clientCall(daemonRequest *request, const void *payload, daemonReply *reply, void *replyPayload, size_t maxReplyPayload)
+{
+#ifdef _WIN32
+	return MANIP_DEVICE_NOT_OPENED;
+#else
+	std::lock_guard<std::mutex> guard(clientLock);
+	memset(reply, 0, sizeof(daemonReply));
+	if (clientFd < 0)
+		return MANIP_DEVICE_NOT_OPENED;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int ok = clientTransfer(1, request, sizeof(daemonRequest)) &&
+	         (request->payloadLength == 0 || clientTransfer(1, (void*)payload, request->payloadLength)) &&
+	         clientTransfer(0, reply, sizeof(daemonReply)) && reply->payloadLength <= maxReplyPayload &&
+	         (reply->payloadLength == 0 || clientTransfer(0, replyPayload, reply->payloadLength));
+	if (!ok) {
+		fprintf(stderr, "Lost the connection to manipDaemon\n");
+		close(clientFd);
+		clientFd = -1;
+		clientManips = -1;
+		memset(reply, 0, sizeof(daemonReply));
+		return MANIP_IO_ERROR;
+	}
+	unsigned long long roundTripNs = (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	unsigned long long overheadNs = roundTripNs > reply->serviceNs ? roundTripNs - reply->serviceNs : 0;
+	clientRequests++;
+	clientRoundTripNs += roundTripNs;
+	clientOverheadNs += overheadNs;
+	if (overheadNs > clientMaxOverheadNs)
+		clientMaxOverheadNs = overheadNs;
+	return reply->status;
+#endif
+}
+
+static void clientRequest(daemonRequest *request, int op, int manip)
+{
+	memset(request, 0, sizeof(daemonRequest));
+	request->op = op;
+	request->manip = manip;
+}
+
+//##############################################################################
+//##################CONNECTING##################################################
+//##############################################################################
+
+int manipConnect(const char *socketPath)
+{
+#ifdef _WIN32
+	return MANIP_DEVICE_NOT_OPENED;
+#else
+	//The daemon's manipulators can't be mixed with ones opened here
+	if (!clientConnected() && manipCount() >= 0)
+		return MANIP_DEVICE_NOT_OPENED;
+	if (socketPath == NULL || socketPath[0] == 0)
+		socketPath = getenv("MANIPCONTROL_SOCKET");
+	if (socketPath == NULL || socketPath[0] == 0)
+		socketPath = DAEMON_SOCKET;
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(address.sun_path))
+		return MANIP_INVALID_PARAMETER;
+	strcpy(address.sun_path, socketPath);
+
+	manipDisconnect();
+	{
+		std::lock_guard<std::mutex> guard(clientLock);
+		clientFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (clientFd < 0)
+			return MANIP_DEVICE_NOT_OPENED;
+		if (connect(clientFd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+			close(clientFd);
+			clientFd = -1;
+			return MANIP_DEVICE_NOT_FOUND;
+		}
+		clientRequests = 0;
+		clientRoundTripNs = clientOverheadNs = clientMaxOverheadNs = 0;
+	}
+	daemonRequest request;
+	daemonReply reply;
+	clientRequest(&request, daemonHello, 0);
+	request.arg[0] = DAEMON_PROTOCOL;
+	int status = clientCall(&request, NULL, &reply, NULL, 0);
+	if (status == MANIP_OK && reply.value[0] != DAEMON_PROTOCOL)
+		status = MANIP_INVALID_PARAMETER;
+	if (status != MANIP_OK) {
+		manipDisconnect();
+		return status;
+	}
+	clientManips = reply.value[1];
+	return MANIP_OK;
+#endif
+}
+
+void manipDisconnect(void)
+{
+#ifndef _WIN32
+	std::lock_guard<std::mutex> guard(clientLock);
+	if (clientFd >= 0)
+		close(clientFd);
+	clientFd = -1;
+	clientManips = -1;
+#endif
+}
+
+int manipConnected(void)
+{
+	return clientConnected();
+}
+
+int manipGetDaemonTimes(manipDaemonTimes *times)
+{
+	std::lock_guard<std::mutex> guard(clientLock);
+	times->requests = clientRequests;
+	times->meanRoundTripMs = clientRequests > 0 ? clientRoundTripNs / 1e6 / clientRequests : 0;
+	times->meanOverheadMs = clientRequests > 0 ? clientOverheadNs / 1e6 / clientRequests : 0;
+	times->maxOverheadMs = clientMaxOverheadNs / 1e6;
+	return clientFd >= 0 ? MANIP_OK : MANIP_DEVICE_NOT_OPENED;
+}
+
+int clientConnected()
+{
+	return clientFd >= 0;
+}
+
+//##############################################################################
+//##################CALLS SENT TO THE DAEMON####################################
+//##############################################################################
+
+int clientCount()
+{
+	return clientManips;
+}
+
+int clientFind(const char *serial)
+{
+	daemonRequest request;
+	daemonReply reply;
+	clientRequest(&request, daemonFind, 0);
+	request.payloadLength = (uint32_t)strlen(serial) + 1;
+	if (request.payloadLength > 64)
+		return -1;
+	if (clientCall(&request, serial, &reply, NULL, 0) != MANIP_OK)
+		return -1;
+	return reply.value[0];
+}
+
+int clientDeviceNumber(int manip)
+{
+	daemonRequest request;
+	daemonReply reply;
+	clientRequest(&request, daemonDeviceNumber, manip);
+	if (clientCall(&request, NULL, &reply, NULL, 0) != MANIP_OK)
+		return -1;
+	return reply.value[0];
+}
+
+int clientWhere(int manip, int drive, int *x, int *y, int *z)
+{
+	daemonRequest request;
+	daemonReply reply;
+	clientRequest(&request, daemonWhere, manip);
+	request.arg[0] = drive;
+	int status = clientCall(&request, NULL, &reply, NULL, 0);
+	*x = reply.value[0];
+	*y = reply.value[1];
+	*z = reply.value[2];
+	return status;
+}
+
+// op is daemonMove, daemonMoveAsync or daemonSetTarget
+int clientMove(int op, int manip, int drive, int x, int y, int z)
+{
+	daemonRequest request;
+	daemonReply reply;
+	clientRequest(&request, op, manip);
+	request.arg[0] = drive;
+	request.arg[1] = x;
+	request.arg[2] = y;
+	request.arg[3] = z;
+	return clientCall(&request, NULL, &reply, NULL, 0);
+}
+
+void clientMoveMany(manipMoveRequest *moves, int numMoves)
+{
+	daemonRequest request;
+	daemonReply reply;
+	size_t length = (size_t)numMoves * sizeof(manipMoveRequest);
+	int status = MANIP_INVALID_PARAMETER;
+	if (numMoves > 0 && length <= daemonMaxPayload) {
+		clientRequest(&request, daemonMoveMany, 0);
+		request.payloadLength = (uint32_t)length;
+		status = clientCall(&request, moves, &reply, moves, length);
+	}
+	//The daemon sends the moves back with status and elapsed filled in
+	if (status != MANIP_OK) {
+		for (int i=0; i<numMoves; i++)
+			moves[i].status = status;
+	}
+}
+
+int clientWhereAll(manipPosition *positions, int maxRows)
+{
+	daemonRequest request;
+	daemonReply reply;
+	if ((size_t)maxRows * sizeof(manipPosition) > daemonMaxPayload)
+		maxRows = daemonMaxPayload / sizeof(manipPosition);
+	clientRequest(&request, daemonWhereAll, 0);
+	request.arg[0] = maxRows;
+	if (clientCall(&request, NULL, &reply, positions, (size_t)maxRows * sizeof(manipPosition)) != MANIP_OK)
+		return 0;
+	return (int)(reply.payloadLength / sizeof(manipPosition));
+}
+
+int clientTargetCounts(int manip, manipTargetCounters *counters)
+{
+	daemonRequest request;
+	daemonReply reply;
+	clientRequest(&request, daemonTargetCounts, manip);
+	int status = clientCall(&request, NULL, &reply, NULL, 0);
+	counters->received = (unsigned)reply.value[0];
+	counters->sent = (unsigned)reply.value[1];
+	counters->coalesced = (unsigned)reply.value[2];
+	counters->failed = (unsigned)reply.value[3];
+	return status;
+}
+
+int clientMoveVerified(int manip, int drive, int x, int y, int z, manipVerifiedMove *result)
+{
+	daemonRequest request;
+	daemonReply reply;
+	clientRequest(&request, daemonMoveVerified, manip);
+	request.arg[0] = drive;
+	request.arg[1] = x;
+	request.arg[2] = y;
+	request.arg[3] = z;
+	request.arg[4] = result->tolerance;
+	request.arg[5] = result->maxRetries;
+	request.arg[6] = result->timeoutMs;
+	int status = clientCall(&request, NULL, &reply, NULL, 0);
+	result->x = reply.value[0];
+	result->y = reply.value[1];
+	result->z = reply.value[2];
+	result->attempts = reply.value[3];
+	result->elapsedMs = reply.value[4] / 1000.0;
+	return status;
+}
+
+int clientMoveRelative(int manip, int drive, int dx, int dy, int dz, manipRelativeMove *result)
+{
+	daemonRequest request;
+	daemonReply reply;
+	clientRequest(&request, daemonMoveRelative, manip);
+	request.arg[0] = drive;
+	request.arg[1] = dx;
+	request.arg[2] = dy;
+	request.arg[3] = dz;
+	int status = clientCall(&request, NULL, &reply, NULL, 0);
+	result->x = reply.value[0];
+	result->y = reply.value[1];
+	result->z = reply.value[2];
+	result->clamped = reply.value[3];
+	result->queried = reply.value[4];
+	return status;
+}
+
+int clientMoveAtSpeed(int manip, int drive, int x, int y, int z, manipSpeedMove *move)
+{
+	daemonRequest request;
+	daemonReply reply;
+	clientRequest(&request, daemonMoveAtSpeed, manip);
+	request.arg[0] = drive;
+	request.arg[1] = x;
+	request.arg[2] = y;
+	request.arg[3] = z;
+	request.arg[4] = move->speed;
+	request.arg[5] = move->fine;
+	int status = clientCall(&request, NULL, &reply, NULL, 0);
+	move->speedUsed = reply.value[0];
+	move->fineUsed = reply.value[1];
+	move->velocitySent = reply.value[2];
+	move->queried = reply.value[3];
+	move->predictedMs = reply.value[4] / 1000.0;
+	move->measuredMs = reply.value[5] / 1000.0;
+	return status;
+}
+
+int clientIsMoving(int manip)
+{
+	daemonRequest request;
+	daemonReply reply;
+	clientRequest(&request, daemonIsMoving, manip);
+	clientCall(&request, NULL, &reply, NULL, 0);
+	return reply.value[0];
+}
+
+int clientWaitMove(int manip, int timeoutMs, int *lastStatus)
+{
+	daemonRequest request;
+	daemonReply reply;
+	clientRequest(&request, daemonWaitMove, manip);
+	request.arg[0] = timeoutMs;
+	clientCall(&request, NULL, &reply, NULL, 0);
+	if (lastStatus != NULL)
+		*lastStatus = reply.value[1];
+	return reply.value[0];
+}
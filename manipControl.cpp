@@ -1,53 +1,134 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <math.h>
 #include "mex.h"
-#include <windows.h>
-#include "ftd2xx.h"
+#include "manipCore.h"
 
 //Original code written by Chris Rohde for Lambda SC Shutter (DATE)
 //This code was rewritten by Joe Steinmeyer for use with MPC-2000/ROE-200N (4/24/2009)
 
+//The MATLAB side of manipControl: decodes the command and its inputs and calls the device
+//library (manipCore.h), which does all the talking to the controllers.
+
 // Constants
 #define FUNC_NAME "ManipControl"	//The name of the function (as seen by Matlab)
 #define FUNC_VER 1.10				//The current version of the manipulator control software
-#define maxManips 16				//The maximum number of manipulators that can be controlled using this program
+
+//##############################################################################
+//#####################COMMAND TABLE############################################
+//##############################################################################
+
+// Every command mexFunction understands:
+//   name, fewest and most inputs after the command, what each of those inputs must be,
+//   whether the manipulators must be initialized (2: initialized here, not through
+//   manipDaemon), and the inputs as shown in error messages.
+// Input letters: d number, m manipulator (number or serial), s string, M numeric matrix,
+// x checked by the command itself.  Commands are numbered in this order, and those numbers
+// can be passed instead of the name (see 'commandId'), so only ever add to the end.
+#define MANIP_COMMANDS(X) \
+	X(numDevices,     0,  0, "",            0, "") \
+	X(numManips,      0,  0, "",            0, "") \
+	X(deviceName,     1,  1, "d",           0, ",deviceNumber") \
+	X(deviceSerial,   1,  1, "d",           0, ",deviceNumber") \
+	X(setTransport,   1,  2, "ss",          0, ",name[,paths]") \
+	X(rescan,         0,  0, "",            0, "") \
+	X(help,           0,  0, "",            0, "") \
+	X(initialize,     0,  1, "x",           0, "[,{serial,...}]") \
+	X(uninitialize,   0,  0, "",            1, "") \
+	X(getPosition,    2,  2, "md",          1, ",deviceNumber,driveNumber") \
+	X(changePosition, 5,  5, "mdddd",       1, ",deviceNumber,driveNumber,X,Y,Z") \
+	X(moveAsync,      5,  5, "mdddd",       1, ",deviceNumber,driveNumber,X,Y,Z") \
+	X(moveMany,       1,  1, "M",           1, ",[device,drive,X,Y,Z;...]") \
+	X(startStream,    3,  3, "mdd",         2, ",deviceNumber,driveNumber,rateHz") \
+	X(stopStream,     1,  1, "m",           2, ",deviceNumber") \
+	X(readStream,     1,  1, "m",           2, ",deviceNumber") \
+	X(executePath,    4,  4, "mdMd",        2, ",deviceNumber,driveNumber,waypoints,dwellMs") \
+	X(pathStatus,     1,  1, "m",           2, ",deviceNumber") \
+	X(abortPath,      1,  1, "m",           2, ",deviceNumber") \
+	X(configureLink,  1, 11, "msdsdsdsdsd", 2, ",deviceNumber,name,value,...") \
+	X(autotune,       1,  3, "mdd",         2, ",deviceNumber[,driveNumber,samples]") \
+	X(isMoving,       1,  1, "m",           1, ",deviceNumber") \
+	X(waitMove,       2,  2, "md",          1, ",deviceNumber,timeoutMs") \
+	X(commandId,      0,  1, "s",           0, "[,commandName]") \
+	X(stats,          1,  1, "m",           2, ",deviceNumber") \
+	X(resetStats,     0,  1, "m",           2, "[,deviceNumber]") \
+	X(getPositionAll, 0,  0, "",            1, "") \
+	X(moveVerified,   8,  8, "mddddddd",    1, ",deviceNumber,driveNumber,X,Y,Z,tolSteps,maxRetries,timeoutMs") \
+	X(setTarget,      5,  5, "mdddd",       1, ",deviceNumber,driveNumber,X,Y,Z") \
+	X(moveRelative,   5,  5, "mdddd",       1, ",deviceNumber,driveNumber,dX,dY,dZ") \
+	X(trace,          0,  2, "sd",          0, "[,file,records]") \
+	X(connect,        0,  1, "s",           0, "[,socketPath]") \
+	X(disconnect,     0,  0, "",            0, "") \
+	X(daemonTimes,    0,  0, "",            0, "") \
+	X(publish,        0,  1, "s",           0, "[,name]") \
+	X(unpublish,      0,  0, "",            0, "") \
+	X(changePositionAtSpeed, 7, 7, "mdddddd", 1, ",deviceNumber,driveNumber,X,Y,Z,speed,fine") \
+	X(changePositionPlanned, 5, 5, "mdddd",   1, ",deviceNumber,driveNumber,X,Y,Z")
+
+#define maxCommandArgs 11			//Most inputs any command takes after the command itself
+
+#define COMMAND_ID(name, minArgs, maxArgs, inputs, needsInit, usage) id_##name,
+#define COMMAND_SPEC(name, minArgs, maxArgs, inputs, needsInit, usage) { #name, minArgs, maxArgs, inputs, needsInit, usage },
+enum { MANIP_COMMANDS(COMMAND_ID) numCommandIds };
+
+typedef struct {
+	const char *name;
+	int minArgs;								// inputs after the command
+	int maxArgs;
+	const char *inputs;							// one letter per input (see MANIP_COMMANDS)
+	int needsInit;
+	const char *usage;
+} manipCommandSpec;
+
+static const manipCommandSpec commandSpecs[numCommandIds] = { MANIP_COMMANDS(COMMAND_SPEC) };
+
+// The inputs of one call, decoded and checked against the command's spec.  Indexed like prhs.
+typedef struct {
+	int count;									// nrhs
+	double number[maxCommandArgs+1];			// value of each 'd' input
+	int manip;									// manipulator the 'm' input named
+} manipArgs;
+
+// FNV-1a, usable in case labels so the compiler rejects two command names that collide
+constexpr unsigned commandHash(const char *name, unsigned hash = 2166136261u)
+{
+	return *name == 0 ? hash : commandHash(name + 1, (hash ^ (unsigned char)*name) * 16777619u);
+}
 
 // Function prototypes
-FT_STATUS numberOfDevices(DWORD*);
-FT_STATUS numberOfManips(DWORD*);
-FT_STATUS deviceDescription(DWORD, char*);
-FT_STATUS deviceSerial(DWORD, char*);
-int isManip(DWORD);
+int sessionNumber(const mxArray*);
+int commandLookup(const mxArray*);
+int decodeArgs(int,int,const mxArray*[],manipArgs*);
 void getCommands();
-FT_STATUS getHandle(DWORD, FT_HANDLE*);
-FT_STATUS where(FT_HANDLE,int,int*,int*,int*);
-FT_STATUS move(FT_HANDLE,int,int,int,int);
-FT_STATUS driveChange(FT_HANDLE,int);
+void printMessage(const char*);
+mxArray* linkSettingsStruct(const manipLinkConfig*);
+mxArray* statsStruct(int);
+void shutdownAll();
 
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
 
-	DWORD numDevs;									// Return value for querying the number of devices attached
-	DWORD numManips;								// Return value for querying the number of manipulator controllers attached
-	DWORD devNum;									// Value to input the device we're interested in accessing
-    DWORD driveNum;                                  //Value to input the drive we're interested (Used exclusively for MPC-2000/ROE-200N)	
+	int numDevs;									// Return value for querying the number of devices attached
+	int numManips;									// Return value for querying the number of manipulator controllers attached
+    int driveNum;                                   //Value to input the drive we're interested (Used exclusively for MPC-2000/ROE-200N)	
 
-	mxArray *mxCommandStr;								// Command string: Matlab data
-	int cmdStrLen;										// Command string: length
-	char *commandStr;									// Command string: converted C character array	
 	double *outVal;										// pointer to single value to return
 	double *outArray;									// pointer to array to return
     int x_des;
     int y_des;
     int z_des;
-	
-	//Configuration parameters
-	static int initialized = 0;							// whether the manips have been initialized	
-	static int numHandles = 0;							// number of entries in manipHandles[]
-	static FT_HANDLE manipHandles[maxManips];		    // Array containing handles
-	static int deviceNumbers[maxManips];				// Array containing the device number corresponding to the handle in manipHandles[]	
+	static int registered = 0;							// whether shutdownAll() has been registered with mexAtExit
+
+	//Background I/O threads have to be stopped before MATLAB unloads us, and the library's
+	//messages can only be printed from this thread
+	if (registered == 0) {
+		manipSetMessageHandler(printMessage);
+		mexAtExit(shutdownAll);
+		registered = 1;
+	}
+	//Print whatever the I/O threads had to say since the last call
+	manipFlushMessages();
 
 	//ensure that we have at least one input parameter, and if so, get the first parameter (the command string)
 	if (nrhs < 1) {
@@ -55,193 +136,250 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 		return;
 	}
 
-	//Get the command string
-	mxCommandStr = (mxArray*)prhs[0];
-	cmdStrLen = (int)mxGetN(mxCommandStr)+1;
-	commandStr = (char*)mxMalloc(cmdStrLen*sizeof(char));
-	mxGetString(mxCommandStr,commandStr,cmdStrLen);
+	//Find the command (by name or number) and check its inputs
+	int command = commandLookup(prhs[0]);
+	if (command < 0) {
+		mexPrintf("Invalid command.  Type %s('help') to see command listing.\n",FUNC_NAME);
+		return;
+	}
+	manipArgs args;
+	if (decodeArgs(command, nrhs, prhs, &args) == 0)
+		return;
 
-	// The following 5 commands don't require the manip 
+	switch (command) {
+	// The following commands don't require the manip 
 	//Command: Get Devices (no more parameters)
-	if (strcmp(commandStr,"numDevices") == 0) {	
-		numberOfDevices(&numDevs);
+	case id_numDevices:
+		manipNumDevices(&numDevs);
 		plhs[0] = mxCreateDoubleMatrix(1,1,mxREAL);
 		outVal = mxGetPr(plhs[0]);
 		outVal[0] = numDevs;
-	}
+		break;
 	//Command: Get the number of devices that are manipulators
-	else if (strcmp(commandStr,"numManips") == 0) {	
-		numberOfManips(&numManips);
+	case id_numManips:
+		manipNumManips(&numManips);
 		plhs[0] = mxCreateDoubleMatrix(1,1,mxREAL);
 		outVal = mxGetPr(plhs[0]);
 		outVal[0] = numManips;
-	}
+		break;
 	//Command: Get device name (device number)
-	else if (strcmp(commandStr,"deviceName") == 0) {	
-		//We require another parameter, so ensure it's been specified		
-		if (nrhs != 2) {
-			mexPrintf("Error. Using 'deviceName' requires exactly one other input parameter (the device number)\n");			
-		} else if (initialized == 1) {
-			mexPrintf("Error. 'deviceName' cannot be accessed once a device has been initialized\n");
-			char *devName;
-			mwSize buflen = 64;		
-			devName=(char*)mxCalloc(buflen, sizeof(char));
-			strcpy(devName,"error");
-			plhs[0] = mxCreateString(devName);
-		}
-		else {
-			//Get the other parameter (should be the device number)
-			devNum = (DWORD)*mxGetPr(prhs[1]);
-			// allocate memory for output string
-			char *devName;
-			mwSize buflen = 64;		
-			devName=(char*)mxCalloc(buflen, sizeof(char));
-			// get device name 
-			deviceDescription(devNum, devName);
-			// return the device name
-			plhs[0] = mxCreateString(devName);
-		}
+	case id_deviceName: {
+		manipDeviceEntry entry;
+		// get device name 
+		if (manipGetDevice((int)args.number[1], &entry) != MANIP_OK)
+			mexPrintf("%s('deviceName'): Error getting data to manipulator 1",FUNC_NAME);
+		// return the device name
+		plhs[0] = mxCreateString(entry.description);
+		break;
 	}
 	//Command: Get serial number(device number)
-	else if (strcmp(commandStr,"deviceSerial") == 0) {	
-		//We require another parameter, so ensure it's been specified		
-		if (nrhs != 2) {
-			mexPrintf("Error. Using 'deviceSerial' requires exactly one other input parameter (the device number)\n");			
+	case id_deviceSerial: {
+		manipDeviceEntry entry;
+		// get device serial number
+		if (manipGetDevice((int)args.number[1], &entry) != MANIP_OK)
+			mexPrintf("%s('deviceSerial'): Error getting data to manipulator 2\n",FUNC_NAME);
+		// return the serial number
+		plhs[0] = mxCreateString(entry.serial);
+		break;
+	}
+	//Command: setTransport (backend name, optional device paths)
+	//Selects how devices are found and opened: 'd2xx' (FTDI driver, the default) or 'termios'
+	//(Linux /dev/ttyUSB* through ftdi_sio).  For termios a ';' separated list of device paths
+	//can be given to use instead of scanning /dev/ttyUSB*.  'emulator' simulates controllers in
+	//software and takes its options in place of the paths.  Returns the backend in use.
+	case id_setTransport: {
+		char backendName[16];
+		char paths[1024];
+		backendName[0] = 0;
+		paths[0] = 0;
+		mxGetString(prhs[1], backendName, sizeof(backendName));
+		if (nrhs >= 3)
+			mxGetString(prhs[2], paths, sizeof(paths));
+		if (manipCount() >= 0) {
+			mexPrintf("Error. 'setTransport' cannot be used once a device has been initialized\n");
 		}
-		else if (initialized == 1) {
-			mexPrintf("Error. 'deviceSerial' cannot be accessed once a device has been initialized\n");
-			char *devName;
-			mwSize buflen = 64;		
-			devName=(char*)mxCalloc(buflen, sizeof(char));
-			strcpy(devName,"error");
-			plhs[0] = mxCreateString(devName);
+		else if (manipSetTransport(backendName, paths) != MANIP_OK) {
+			if (paths[0] == 0)
+				mexPrintf("Error. Transport '%s' isn't available in this build\n", backendName);
+			else
+				mexPrintf("Error. Transport '%s' isn't available in this build or doesn't accept '%s'\n", backendName, paths);
 		}
-		else {
-			//Get the other parameter (should be the device number)
-			devNum = (DWORD)*mxGetPr(prhs[1]);
-			// allocate memory for output string
-			char *devName;
-			mwSize buflen = 64;		
-			devName=(char*)mxCalloc(buflen, sizeof(char));
-			// get device name 
-			deviceSerial(devNum, devName);
-			// return the device name
-			plhs[0] = mxCreateString(devName);
+		plhs[0] = mxCreateString(manipTransportName());
+		break;
+	}
+	//Command: rescan (no more parameters)
+	//Enumerates the bus again.  Everything else answers from the list made by the last scan
+	//(made automatically the first time it's needed), so call this after plugging devices in
+	//or out.  Returns the number of devices and, as a second output, a struct array with the
+	//description, serial, locationId and isOpen of each.
+	case id_rescan: {
+		const char *fields[] = { "description", "serial", "locationId", "isOpen", "isManip" };
+		manipScan(&numDevs);
+		plhs[0] = mxCreateDoubleScalar(numDevs);
+		if (nlhs > 1) {
+			plhs[1] = mxCreateStructMatrix(numDevs, 1, 5, fields);
+			for (int i=0; i<numDevs; i++) {
+				manipDeviceEntry entry;
+				manipGetDevice(i, &entry);
+				mxSetField(plhs[1], i, "description", mxCreateString(entry.description));
+				mxSetField(plhs[1], i, "serial", mxCreateString(entry.serial));
+				mxSetField(plhs[1], i, "locationId", mxCreateDoubleScalar(entry.locationId));
+				mxSetField(plhs[1], i, "isOpen", mxCreateDoubleScalar(entry.isOpen));
+				mxSetField(plhs[1], i, "isManip", mxCreateDoubleScalar(entry.isManip));
+			}
 		}
+		break;
 	}
 	//Command: help (no more parameters). List all possible commands
-	else if (strcmp(commandStr,"help") == 0) {	
+	case id_help:
 		getCommands();
-	}
+		break;
+	//Command: commandId (optional command name)
+	//Returns the number of a command, which can be passed in place of its name to skip the
+	//name lookup, or with no input the names of all the commands (the first is number 0).
+	case id_commandId:
+		if (nrhs == 1) {
+			plhs[0] = mxCreateCellMatrix(numCommandIds,1);
+			for (int i=0; i<numCommandIds; i++)
+				mxSetCell(plhs[0], i, mxCreateString(commandSpecs[i].name));
+		}
+		else {
+			int id = commandLookup(prhs[1]);
+			if (id < 0)
+				mexPrintf("Error. There is no command called that.  Type %s('help') to see command listing.\n",FUNC_NAME);
+			plhs[0] = mxCreateDoubleScalar(id);
+		}
+		break;
 	//##########################################################################
-	//Command: initializeAllManips (no more parameters). Returns device numbers of MPC2000s
+	//Command: initializeAllManips (optional serial numbers). Returns device numbers of MPC2000s
+	//With a cell array of serial numbers, only those devices are opened, and manipulator i is
+	//always the i-th serial however the devices were enumerated.  Devices are opened in
+	//parallel; the optional second output is [deviceNumber status] for every device tried
+	//(devices that fail are left out of the manipulator numbering), the third the ms each
+	//spent opening, configuring, purging and waking up.
 	//##########################################################################
-	else if (strcmp(commandStr,"initialize") == 0) {
+	case id_initialize:
 		//Don't run this routine if we're already initialized
-		if (initialized == 1) {
+		if (manipCount() >= 0) {
 			plhs[0] = mxCreateDoubleMatrix(1,1,mxREAL);
 			outArray = mxGetPr(plhs[0]);
 			outArray[0] = 0;
 			mexPrintf("Already initialized.  Uninitialize first if you want to re-run this routine\n");
 		}
+		else if (nrhs == 2 && !mxIsCell(prhs[1]) && !mxIsChar(prhs[1])) {
+			plhs[0] = mxCreateDoubleMatrix(0,1,mxREAL);
+			mexPrintf("Error. 'initialize' takes at most one other input parameter (a cell array of serial numbers)\n");
+		}
 		else {			
-			DWORD numDevs;
-			DWORD numManips = 0;
-
-			numberOfDevices(&numDevs);
-
-			//get handles to the devices that are manipulators 
-			for (DWORD i=0;i<numDevs;i++) {
-				if (isManip(i) != 0) {
-					getHandle(i, &manipHandles[numManips]);
-					deviceNumbers[numManips] = i;
-					mexPrintf("%u is a manipulator\n",numManips);
-					numManips++;
+			char serials[MANIP_MAX_MANIPS][64];
+			const char *serialList[MANIP_MAX_MANIPS];
+			int numSerials = 0;
+			manipOpenResult results[MANIP_MAX_MANIPS];
+			int numTried = 0;
+
+			if (nrhs == 2) {
+				//the devices asked for, in the order asked for
+				numSerials = mxIsCell(prhs[1]) ? (int)mxGetNumberOfElements(prhs[1]) : 1;
+				if (numSerials > MANIP_MAX_MANIPS) {
+					mexPrintf("Error. At most %d manipulators can be initialized\n", MANIP_MAX_MANIPS);
+					numSerials = 0;
+				}
+				for (int i=0; i<numSerials; i++) {
+					const mxArray *item = mxIsCell(prhs[1]) ? mxGetCell(prhs[1], i) : prhs[1];
+					serials[i][0] = 0;
+					if (item != NULL && mxIsChar(item))
+						mxGetString(item, serials[i], sizeof(serials[i]));
+					serialList[i] = serials[i];
 				}
 			}
-			numHandles = numManips;			
-			initialized = 1;
-			mexPrintf("Initialized %u manipulators\n", numHandles);
+			if (nrhs < 2 || numSerials > 0)
+				manipInitialize(nrhs == 2 ? serialList : NULL, numSerials, results, &numTried);
 			// now return the device numbers of the manipulators
-			plhs[0] = mxCreateDoubleMatrix(numHandles,1,mxREAL);
+			numManips = manipCount() > 0 ? manipCount() : 0;
+			plhs[0] = mxCreateDoubleMatrix(numManips,1,mxREAL);
 			outArray = mxGetPr(plhs[0]);
-			for (int i=0;i<numHandles;i++)
-				outArray[i] = deviceNumbers[i];
+			for (int i=0;i<numManips;i++)
+				outArray[i] = manipDeviceNumber(i);
+			// the status of every device tried, and where its time went
+			if (nlhs > 1) {
+				plhs[1] = mxCreateDoubleMatrix(numTried,2,mxREAL);
+				outArray = mxGetPr(plhs[1]);
+				for (int i=0; i<numTried; i++) {
+					outArray[i] = results[i].deviceNumber;
+					outArray[i + numTried] = results[i].status;
+				}
+			}
+			if (nlhs > 2) {
+				plhs[2] = mxCreateDoubleMatrix(numTried,MANIP_INIT_PHASES,mxREAL);
+				outArray = mxGetPr(plhs[2]);
+				for (int i=0; i<numTried; i++) {
+					for (int phase=0; phase<MANIP_INIT_PHASES; phase++)
+						outArray[i + phase*numTried] = results[i].phaseMs[phase];
+				}
+			}
 		}
-	}
+		break;
 	//##########################################################################
 	//Command: uninitialize (no more parameters)
 	//##########################################################################
-	else if (strcmp(commandStr, "uninitialize") == 0) {
-		//Don't run this routine if we're not initialized
-		if (initialized == 0) {
-			mexPrintf("Not initialized.\n");
-		}
-		else {
-			for (DWORD i=0; i<numHandles; i++) {
-				FT_Close(manipHandles[i]);
-			}
-			mexPrintf("Uninitialized %u manipulators\n", numHandles);
-			numHandles = 0;
-			initialized = 0;
-		}
-	}
+	case id_uninitialize:
+		manipUninitialize();
+		break;
 	//Command: getDevicePosition (device number, drive number)
     //this command will return the values of the x
-	else if (strcmp(commandStr, "getPosition") == 0) {
-        //Don't run this routine if we're not initialized
-         if (initialized == 0) {
-             mexPrintf("Not initialized.\n");
-        }
-         //We require two other parameters, so ensure it's been specified
-         else if (nrhs != 3) {
-              mexPrintf("Error. Using 'getPosition' requires exactly two other input parameters (the device number and the drive number, respectively)\n");
-         }
-         else {
-              int exists = 0;
-              //Get the Device number
-              devNum = (DWORD)*mxGetPr(prhs[1]);
-              //Get the Drive Number
-              int driveNum;
-              driveNum = (DWORD) *mxGetPr(prhs[2]);
+	case id_getPosition: {
+         //Get the Drive Number
+         int driveNum = (int)args.number[2];
               
-              //create and initialize the input values...only kind of needed
-              int x;
-              x = 0;
-              int y;
-              y = 0;
-              int z;
-              z = 0;
+         //create and initialize the input values...only kind of needed
+         int x = 0;
+         int y = 0;
+         int z = 0;
               
-              where(manipHandles[devNum],driveNum,&x,&y,&z);
+         manipWhere(args.manip,driveNum,&x,&y,&z);
               
-              plhs[0] = mxCreateDoubleMatrix(1,3,mxREAL);
-              outVal = mxGetPr(plhs[0]);
-              outVal[0] = x;
-              outVal[1] = y;
-              outVal[2] = z;   
+         plhs[0] = mxCreateDoubleMatrix(1,3,mxREAL);
+         outVal = mxGetPr(plhs[0]);
+         outVal[0] = x;
+         outVal[1] = y;
+         outVal[2] = z;   
+         break;
+    }
+    //Command getPositionAll (no more parameters)
+    //Reads every drive of every manipulator with the devices queried in parallel.  Returns an
+    //Mx5 matrix of [device drive x y z] rows (x, y, z NaN where the read failed) and, as a
+    //second output, the status of each row.
+    case id_getPositionAll: {
+         int numRows = manipCount()*MANIP_MAX_DRIVES;
+         manipPosition *positions = (manipPosition*)mxCalloc(numRows > 0 ? numRows : 1, sizeof(manipPosition));
+         numRows = manipWhereAll(positions, numRows);
+         plhs[0] = mxCreateDoubleMatrix(numRows,5,mxREAL);
+         outArray = mxGetPr(plhs[0]);
+         for (int i=0; i<numRows; i++) {
+              int ok = (positions[i].status == MANIP_OK);
+              outArray[i] = positions[i].manip;
+              outArray[i + numRows] = positions[i].drive;
+              outArray[i + 2*numRows] = ok ? positions[i].x : mxGetNaN();
+              outArray[i + 3*numRows] = ok ? positions[i].y : mxGetNaN();
+              outArray[i + 4*numRows] = ok ? positions[i].z : mxGetNaN();
+         }
+         if (nlhs > 1) {
+              plhs[1] = mxCreateDoubleMatrix(numRows,1,mxREAL);
+              outArray = mxGetPr(plhs[1]);
+              for (int i=0; i<numRows; i++)
+                  outArray[i] = positions[i].status;
          }
+         mxFree(positions);
+         break;
     }
     //Command changePosition (device number, drive number, x,y,z position)
     //The x, y, and z values are in STEPS!!!! NOT MICRONS...so they can only be from 0 to 400e3!
-    else if (strcmp(commandStr, "changePosition") == 0) {
-       //Don't run this routine if  we're not initialized
-        if (initialized == 0) {
-              mexPrintf("Not initialized.\n");
-         }
-         //We require five other parameters, so ensure it's been specified
-         else if (nrhs != 6) {
-              mexPrintf("Error. Using 'changePosition' requires exactly 5 other input parameters (device number, drive number, x coord, y coord, z coord, IN THAT ORDER)\n");
-         }
-         else {
-         //Get the device number
-         devNum = (DWORD) *mxGetPr(prhs[1]);
-         
-         driveNum = (DWORD) *mxGetPr(prhs[2]); //we'll just assume devNum and driveNum are in range...yes this is sloppy...fuck you.
+    case id_changePosition:
+         driveNum = (int)args.number[2]; //we'll just assume driveNum is in range...yes this is sloppy.
          
-         x_des = (int) *mxGetPr(prhs[3]);
-         y_des = (int) *mxGetPr(prhs[4]);
-         z_des = (int) *mxGetPr(prhs[5]);
+         x_des = (int)args.number[3];
+         y_des = (int)args.number[4];
+         z_des = (int)args.number[5];
          
          if (x_des < 0 || x_des > 400e3) {
              mexPrintf("Error.  x value for 'changeposition' is out of valid range!  0 <= x <=400e3.\n");
@@ -253,366 +391,613 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
              mexPrintf("Error.  z value for 'changeposition' is out of valid range!  0 <= z <=400e3.\n");
          }
          
+         manipMove(args.manip,driveNum,x_des,y_des,z_des);
+         break;
+    //Command moveVerified (device number, drive number, x,y,z position, tolerance in steps,
+    //retries, timeout in ms)
+    //Moves, reads the position back and moves again until every axis is within tolerance, all
+    //on the device's I/O thread.  Returns the final [x y z] read back, the moves sent, the
+    //elapsed ms and the status (0 once within tolerance).
+    case id_moveVerified: {
+         manipVerifiedMove result;
+         driveNum = (int)args.number[2];
+         x_des = (int)args.number[3];
+         y_des = (int)args.number[4];
+         z_des = (int)args.number[5];
+         result.tolerance = (int)args.number[6];
+         result.maxRetries = (int)args.number[7];
+         result.timeoutMs = (int)args.number[8];
+         result.x = result.y = result.z = result.attempts = 0;
+         result.elapsedMs = 0;
+         int status = MANIP_OK;
+         if (x_des < 0 || x_des > 400e3 || y_des < 0 || y_des > 400e3 || z_des < 0 || z_des > 400e3) {
+              mexPrintf("Error.  x, y and z values for 'moveVerified' must be in range!  0 <= x,y,z <=400e3.\n");
+              status = MANIP_INVALID_PARAMETER;
+         }
+         else if ((status = manipMoveVerified(args.manip, driveNum, x_des, y_des, z_des, &result)) == MANIP_INVALID_PARAMETER) {
+              mexPrintf("Error. 'moveVerified' needs a drive number from 1 to %d and a tolerance, retries and timeout >= 0\n", MANIP_MAX_DRIVES);
+         }
+         plhs[0] = mxCreateDoubleMatrix(1,3,mxREAL);
+         outVal = mxGetPr(plhs[0]);
+         outVal[0] = result.x;
+         outVal[1] = result.y;
+         outVal[2] = result.z;
+         if (nlhs > 1)
+              plhs[1] = mxCreateDoubleScalar(result.attempts);
+         if (nlhs > 2)
+              plhs[2] = mxCreateDoubleScalar(result.elapsedMs);
+         if (nlhs > 3)
+              plhs[3] = mxCreateDoubleScalar(status);
+         break;
+    }
+    //Command changePositionAtSpeed (device number, drive number, x,y,z position, speed in um/s,
+    //fine resolution 0/1) and changePositionPlanned (device number, drive number, x,y,z position)
+    //Moves at the given speed, or at the fastest one the planner allows for the distance,
+    //sending the velocity command only when the drive last had another.  Returns the status,
+    //and optionally [speed fine velocitySent predicted_ms measured_ms].
+    case id_changePositionAtSpeed:
+    case id_changePositionPlanned: {
+         manipSpeedMove move;
+         memset(&move, 0, sizeof(move));
+         driveNum = (int)args.number[2];
+         x_des = (int)args.number[3];
+         y_des = (int)args.number[4];
+         z_des = (int)args.number[5];
+         const char *name = commandSpecs[command].name;
+         int status = MANIP_OK;
+         if (command == id_changePositionAtSpeed) {
+              move.speed = (int)args.number[6];
+              move.fine = args.number[7] != 0;
+              if (move.speed < 1) {
+                   mexPrintf("Error. 'changePositionAtSpeed' needs a speed from 1 to 32767 um/s\n");
+                   status = MANIP_INVALID_PARAMETER;
+              }
+         }
+         if (x_des < 0 || x_des > 400e3 || y_des < 0 || y_des > 400e3 || z_des < 0 || z_des > 400e3) {
+              mexPrintf("Error.  x, y and z values for '%s' must be in range!  0 <= x,y,z <=400e3.\n", name);
+              status = MANIP_INVALID_PARAMETER;
+         }
+         if (status == MANIP_OK && (status = manipMoveAtSpeed(args.manip, driveNum, x_des, y_des, z_des, &move)) == MANIP_INVALID_PARAMETER)
+              mexPrintf("Error. '%s' needs a drive number from 1 to %d and a speed from 1 to 32767 um/s\n", name, MANIP_MAX_DRIVES);
+         plhs[0] = mxCreateDoubleScalar(status);
+         if (nlhs > 1) {
+              plhs[1] = mxCreateDoubleMatrix(1,5,mxREAL);
+              outVal = mxGetPr(plhs[1]);
+              outVal[0] = move.speedUsed;
+              outVal[1] = move.fineUsed;
+              outVal[2] = move.velocitySent;
+              outVal[3] = move.predictedMs;
+              outVal[4] = move.measuredMs;
+         }
+         break;
+    }
+    //Command moveRelative (device number, drive number, x,y,z step)
+    //Moves by the given steps from the last known position, without asking the controller
+    //where it is unless that was lost to an error.  Returns the target sent, and optionally
+    //which axes were clamped to the travel range ([x y z], 1 if clamped) and the status.
+    case id_moveRelative: {
+         manipRelativeMove result;
+         result.x = result.y = result.z = result.clamped = result.queried = 0;
+         int status = manipMoveRelative(args.manip, (int)args.number[2], (int)args.number[3], (int)args.number[4], (int)args.number[5], &result);
+         if (status == MANIP_INVALID_PARAMETER)
+              mexPrintf("Error. 'moveRelative' needs a drive number from 1 to %d\n", MANIP_MAX_DRIVES);
+         else if (result.clamped != 0 && nlhs < 2)
+              mexPrintf("Warning. 'moveRelative' target was clamped to the valid range (0 <= x,y,z <= 400e3).\n");
+         plhs[0] = mxCreateDoubleMatrix(1,3,mxREAL);
+         outVal = mxGetPr(plhs[0]);
+         outVal[0] = result.x;
+         outVal[1] = result.y;
+         outVal[2] = result.z;
+         if (nlhs > 1) {
+              plhs[1] = mxCreateDoubleMatrix(1,3,mxREAL);
+              outVal = mxGetPr(plhs[1]);
+              outVal[0] = (result.clamped & 1) != 0;
+              outVal[1] = (result.clamped & 2) != 0;
+              outVal[2] = (result.clamped & 4) != 0;
+         }
+         if (nlhs > 2)
+              plhs[2] = mxCreateDoubleScalar(status);
+         break;
+    }
+    //Command moveAsync (device number, drive number, x,y,z position)
+    //Same as changePosition, but returns as soon as the move is queued
+    case id_moveAsync:
+         driveNum = (int)args.number[2];
+         x_des = (int)args.number[3];
+         y_des = (int)args.number[4];
+         z_des = (int)args.number[5];
          
-         move(manipHandles[devNum],driveNum,x_des,y_des,z_des);
-         
+         if (x_des < 0 || x_des > 400e3 || y_des < 0 || y_des > 400e3 || z_des < 0 || z_des > 400e3) {
+             mexPrintf("Error.  x, y and z values for 'moveAsync' must be in range!  0 <= x,y,z <=400e3.\n");
+         }
+         else {
+             manipMoveAsync(args.manip,driveNum,x_des,y_des,z_des);
+         }
+         break;
+    //Command setTarget (device number, drive number, x,y,z position)
+    //Replaces the drive's setpoint and returns at once.  The device's I/O thread sends only the
+    //newest setpoint each time the previous move finishes, so targets that arrive faster than
+    //the stage can follow are dropped instead of queueing up.  The optional output is
+    //[received sent coalesced failed] for the device.
+    case id_setTarget:
+         if (manipSetTarget(args.manip, (int)args.number[2], (int)args.number[3], (int)args.number[4], (int)args.number[5]) != MANIP_OK)
+              mexPrintf("Error. 'setTarget' needs a drive number from 1 to %d and x, y, z in range (0 <= x,y,z <= 400e3)\n", MANIP_MAX_DRIVES);
+         if (nlhs > 0) {
+              manipTargetCounters counters;
+              manipTargetCounts(args.manip, &counters);
+              plhs[0] = mxCreateDoubleMatrix(1,4,mxREAL);
+              outArray = mxGetPr(plhs[0]);
+              outArray[0] = counters.received;
+              outArray[1] = counters.sent;
+              outArray[2] = counters.coalesced;
+              outArray[3] = counters.failed;
+         }
+         break;
+    //Command moveMany (Nx5 matrix of [device number, drive number, x, y, z])
+    //Sends every row's move to its device at once, then waits for all of them.
+    //Returns the status of each row and, as a second output, its completion time in seconds.
+    case id_moveMany:
+         if (mxGetN(prhs[1]) != 5) {
+              mexPrintf("Error. Using 'moveMany' requires exactly one other input parameter (an Nx5 matrix of [device, drive, x, y, z] rows)\n");
+         }
+         else {
+              int numRows = (int)mxGetM(prhs[1]);
+              const double *rows = mxGetPr(prhs[1]);
+              manipMoveRequest *moves = (manipMoveRequest*)mxCalloc(numRows > 0 ? numRows : 1, sizeof(manipMoveRequest));
+              for (int i=0; i<numRows; i++) {
+                  moves[i].manip = (int)rows[i];
+                  moves[i].drive = (int)rows[i + numRows];
+                  moves[i].x = (int)rows[i + 2*numRows];
+                  moves[i].y = (int)rows[i + 3*numRows];
+                  moves[i].z = (int)rows[i + 4*numRows];
+              }
+              manipMoveMany(moves, numRows);
+              plhs[0] = mxCreateDoubleMatrix(numRows,1,mxREAL);
+              outArray = mxGetPr(plhs[0]);
+              for (int i=0; i<numRows; i++)
+                  outArray[i] = moves[i].status;
+              if (nlhs > 1) {
+                  plhs[1] = mxCreateDoubleMatrix(numRows,1,mxREAL);
+                  outArray = mxGetPr(plhs[1]);
+                  for (int i=0; i<numRows; i++)
+                      outArray[i] = moves[i].elapsed;
+              }
+              mxFree(moves);
+         }
+         break;
+    //Command startStream (device number, drive number, rate in Hz)
+    //The device's I/O thread polls the drive's position at the given rate whenever it isn't
+    //running another command, and keeps the timestamped samples for readStream
+    case id_startStream:
+         if (manipStartStream(args.manip, (int)args.number[2], args.number[3]) != MANIP_OK)
+              mexPrintf("Error. 'startStream' needs a drive number from 1 to %d and a positive rate\n", MANIP_MAX_DRIVES);
+         break;
+    //Command stopStream (device number)
+    case id_stopStream:
+         manipStopStream(args.manip);
+         break;
+    //Command readStream (device number)
+    //Returns every sample taken since the last call as a Kx4 matrix of [t x y z] rows, t in
+    //seconds since startStream.  The optional second output is [dropped missed failed]:
+    //samples lost to a full buffer, sample times skipped while busy, and failed polls.
+    case id_readStream: {
+         unsigned available = manipStreamAvailable(args.manip);
+         manipSample *samples = (manipSample*)mxCalloc(available > 0 ? available : 1, sizeof(manipSample));
+         available = manipReadStream(args.manip, samples, available);
+         plhs[0] = mxCreateDoubleMatrix(available,4,mxREAL);
+         outArray = mxGetPr(plhs[0]);
+         for (unsigned i=0; i<available; i++) {
+              outArray[i] = samples[i].t;
+              outArray[i + available] = samples[i].x;
+              outArray[i + 2*available] = samples[i].y;
+              outArray[i + 3*available] = samples[i].z;
+         }
+         mxFree(samples);
+         if (nlhs > 1) {
+              unsigned dropped, missed, failed;
+              manipStreamCounts(args.manip, &dropped, &missed, &failed);
+              plhs[1] = mxCreateDoubleMatrix(1,3,mxREAL);
+              outArray = mxGetPr(plhs[1]);
+              outArray[0] = dropped;
+              outArray[1] = missed;
+              outArray[2] = failed;
          }
+         break;
     }
-	else
-		mexPrintf("Invalid command.  Type %s('help') to see command listing.\n",FUNC_NAME);
-
-	// Finally, free the memory we used to create the command string
-	mxFree(commandStr);
+    //Command executePath (device number, drive number, Nx3 matrix of waypoints, dwell in ms)
+    //Checks every waypoint, then moves through them on the device's I/O thread without
+    //coming back to MATLAB in between.  Returns immediately; see pathStatus and abortPath.
+    case id_executePath:
+         if (mxGetN(prhs[3]) != 3) {
+              mexPrintf("Error. Using 'executePath' requires exactly 4 other input parameters (device number, drive number, Nx3 waypoint matrix, dwell in ms)\n");
+         }
+         else {
+              int numPoints = (int)mxGetM(prhs[3]);
+              const double *waypoints = mxGetPr(prhs[3]);
+              int *points = (int*)mxCalloc(numPoints > 0 ? 3*numPoints : 1, sizeof(int));
+              //Anything out of range (NaN included) becomes -1 for the library to reject
+              for (int i=0; i<numPoints; i++) {
+                  for (int k=0; k<3; k++) {
+                      double value = waypoints[i + k*numPoints];
+                      points[3*i + k] = (value >= 0 && value <= 400e3) ? (int)value : -1;
+                  }
+              }
+              manipExecutePath(args.manip, (int)args.number[2], points, numPoints, (int)args.number[4]);
+              mxFree(points);
+         }
+         break;
+    //Command pathStatus (device number)
+    //Returns [reached total status running] for the device's last path, and optionally the
+    //time (s since the path started) each waypoint was reached, NaN for those not yet reached
+    case id_pathStatus: {
+         manipPathProgress progress;
+         manipPathStatus(args.manip, &progress);
+         plhs[0] = mxCreateDoubleMatrix(1,4,mxREAL);
+         outArray = mxGetPr(plhs[0]);
+         outArray[0] = progress.reached;
+         outArray[1] = progress.total;
+         outArray[2] = progress.status;
+         outArray[3] = progress.running;
+         if (nlhs > 1) {
+              plhs[1] = mxCreateDoubleMatrix(progress.total,1,mxREAL);
+              outArray = mxGetPr(plhs[1]);
+              int reached = manipPathTimes(args.manip, outArray, progress.total);
+              for (int i=reached; i<progress.total; i++)
+                  outArray[i] = mxGetNaN();
+         }
+         break;
+    }
+    //Command abortPath (device number)
+    //Stops the device's path once the current waypoint is reached
+    case id_abortPath:
+         manipAbortPath(args.manip);
+         break;
+    //Command configureLink (device number, optional name/value pairs)
+    //Changes the serial line settings of one device: 'baudRate', 'latencyTimer' (ms),
+    //'usbTransferSize' (bytes), 'readTimeout' and 'writeTimeout' (ms).  The settings are saved
+    //against the device's serial number and reused by the next 'initialize'.  Returns the
+    //settings in effect as a struct.
+    case id_configureLink: {
+         manipLinkConfig settings;
+         int valid = 1;
+         manipGetLink(args.manip, &settings);
+         if (nrhs % 2 != 0) {
+              mexPrintf("Error. Using 'configureLink' requires the device number followed by name/value pairs\n");
+              valid = 0;
+         }
+         for (int i=2; valid && i+1<nrhs; i+=2) {
+              char name[32];
+              mxGetString(prhs[i], name, sizeof(name));
+              double value = args.number[i+1];
+              if (value < 0)
+                  valid = 0;
+              else if (strcmp(name, "baudRate") == 0 && value >= 300)
+                  settings.baudRate = (unsigned)value;
+              else if (strcmp(name, "latencyTimer") == 0 && value >= 1 && value <= 255)
+                  settings.latencyTimer = (unsigned)value;
+              else if (strcmp(name, "usbTransferSize") == 0 && value >= 64 && value <= 65536)
+                  settings.usbTransferSize = (unsigned)value;
+              else if (strcmp(name, "readTimeout") == 0 && value >= 10)
+                  settings.readTimeout = (unsigned)value;
+              else if (strcmp(name, "writeTimeout") == 0 && value >= 10)
+                  settings.writeTimeout = (unsigned)value;
+              else
+                  valid = 0;
+              if (!valid)
+                  mexPrintf("Error. Bad 'configureLink' setting '%s' (baudRate is at least 300, latencyTimer 1-255 ms, usbTransferSize 64-65536 bytes, readTimeout and writeTimeout at least 10 ms)\n", name);
+         }
+         if (valid && nrhs > 2 && manipConfigureLink(args.manip, &settings) != MANIP_OK)
+              mexPrintf("Error. The device didn't accept the new link settings\n");
+         manipGetLink(args.manip, &settings);
+         plhs[0] = linkSettingsStruct(&settings);
+         break;
+    }
+    //Command autotune (device number, optional drive number, optional samples per setting)
+    //Times 'C' queries under each latency timer / USB transfer size combination, then applies
+    //and saves the best.  Returns the settings chosen as a struct and, as a second output,
+    //the [latency transfer median_ms p99_ms] table it measured.
+    case id_autotune: {
+         int drive = (nrhs > 2) ? (int)args.number[2] : 1;
+         int samples = (nrhs > 3) ? (int)args.number[3] : 50;
+         if (drive < 1 || drive > MANIP_MAX_DRIVES || samples < 1) {
+              mexPrintf("Error. 'autotune' needs a drive number from 1 to %d and at least one sample\n", MANIP_MAX_DRIVES);
+         }
+         else {
+              manipLinkConfig settings;
+              mxArray *table = mxCreateDoubleMatrix(manipAutotuneRows(),4,mxREAL);
+              if (manipAutotune(args.manip, drive, samples, mxGetPr(table)) != MANIP_OK)
+                  mexPrintf("Error. 'autotune' couldn't get reliable replies with any setting; the previous settings were kept\n");
+              manipGetLink(args.manip, &settings);
+              plhs[0] = linkSettingsStruct(&settings);
+              if (nlhs > 1)
+                  plhs[1] = table;
+              else
+                  mxDestroyArray(table);
+         }
+         break;
+    }
+    //Command isMoving (device number)
+    //Returns 1 while moves queued with moveAsync are still running, 0 otherwise
+    case id_isMoving:
+         plhs[0] = mxCreateDoubleMatrix(1,1,mxREAL);
+         outVal = mxGetPr(plhs[0]);
+         outVal[0] = manipIsMoving(args.manip);
+         break;
+    //Command stats (device number)
+    //Returns a struct with a field for each timed operation (write, read, purge, driveChange,
+    //where, move, queueWait), each holding count, failures, mean_ms, p50_ms, p90_ms, p99_ms and
+    //max_ms since the device was initialized or resetStats was last called, a 'link' field with
+    //the reply error counts and the adaptive reply timeout, and a 'scheduler' field with the
+    //drive switches the I/O thread's scheduler saved.
+    case id_stats:
+         plhs[0] = statsStruct(args.manip);
+         break;
+    //Command resetStats (optional device number; all devices if left out)
+    case id_resetStats:
+         manipResetStats(nrhs == 1 ? -1 : args.manip);
+         break;
+    //Command trace ([file name, number of records])
+    //With a file, starts recording every transaction with every device into it (a ring of
+    //'records' entries, default 65536) and returns the status.  With no input, stops and
+    //returns the number of transactions recorded.
+    case id_trace:
+         if (nrhs >= 2) {
+              char path[1024];
+              path[0] = 0;
+              mxGetString(prhs[1], path, sizeof(path));
+              int status = manipStartTrace(path, nrhs >= 3 ? (unsigned)args.number[2] : 0);
+              if (status != MANIP_OK)
+                   mexPrintf("Error. 'trace' couldn't create a trace file '%s'\n", path);
+              plhs[0] = mxCreateDoubleScalar(status);
+         }
+         else
+              plhs[0] = mxCreateDoubleScalar((double)manipStopTrace());
+         break;
+    //Command connect ([socket path])
+    //Use the manipulators a manipDaemon has open instead of opening them here, so they stay
+    //open through 'clear mex' and can be shared with other programs.  Returns the number of
+    //manipulators the daemon has, or -1 if it couldn't connect.
+    case id_connect: {
+         char path[108];
+         path[0] = 0;
+         if (nrhs >= 2)
+              mxGetString(prhs[1], path, sizeof(path));
+         int status = manipConnect(path);
+         if (status == MANIP_DEVICE_NOT_OPENED)
+              mexPrintf("Error. 'connect' can't be used while manipulators are initialized here (or on Windows)\n");
+         else if (status != MANIP_OK)
+              mexPrintf("Error. Couldn't connect to manipDaemon (status %d).  Is it running?\n", status);
+         plhs[0] = mxCreateDoubleScalar(status == MANIP_OK ? manipCount() : -1);
+         break;
+    }
+    //Command disconnect (no more parameters)
+    //Stop using the daemon's manipulators (they stay open in the daemon)
+    case id_disconnect:
+         manipDisconnect();
+         break;
+    //Command daemonTimes (no more parameters)
+    //Returns [requests meanRoundTrip_ms meanOverhead_ms maxOverhead_ms] since connecting, where
+    //overhead is the round trip less the time the daemon spent on the request
+    case id_daemonTimes: {
+         manipDaemonTimes times;
+         manipGetDaemonTimes(&times);
+         plhs[0] = mxCreateDoubleMatrix(1,4,mxREAL);
+         outArray = mxGetPr(plhs[0]);
+         outArray[0] = times.requests;
+         outArray[1] = times.meanRoundTripMs;
+         outArray[2] = times.meanOverheadMs;
+         outArray[3] = times.maxOverheadMs;
+         break;
+    }
+    //Command publish ([shared memory name])
+    //Publish every drive's latest position in POSIX shared memory for other programs to read
+    //(the name defaults to /manipControl.positions); see manipPositions.h.  Returns the status.
+    case id_publish: {
+         char name[256];
+         name[0] = 0;
+         if (nrhs >= 2)
+              mxGetString(prhs[1], name, sizeof(name));
+         int status = manipStartPublishing(name);
+         if (status == MANIP_DEVICE_NOT_OPENED)
+              mexPrintf("Error. 'publish': another running process is already publishing under that name\n");
+         else if (status != MANIP_OK)
+              mexPrintf("Error. 'publish' couldn't create the shared memory (a name must start with '/'; not on Windows)\n");
+         plhs[0] = mxCreateDoubleScalar(status);
+         break;
+    }
+    //Command unpublish (no more parameters)
+    case id_unpublish:
+         manipStopPublishing();
+         break;
+    //Command waitMove (device number, timeout in ms)
+    //Blocks until the device's queued moves are done or the timeout expires.  Returns 1 if
+    //the moves finished (and, as a second output, the status of the last one), 0 on timeout.
+    case id_waitMove: {
+         int lastStatus = 0;
+         int done = manipWaitMove(args.manip, (int)args.number[2], &lastStatus);
+         plhs[0] = mxCreateDoubleMatrix(1,1,mxREAL);
+         outVal = mxGetPr(plhs[0]);
+         outVal[0] = done;
+         if (nlhs > 1) {
+              plhs[1] = mxCreateDoubleMatrix(1,1,mxREAL);
+              outVal = mxGetPr(plhs[1]);
+              outVal[0] = lastStatus;
+         }
+         break;
+    }
+	}
 }
 
 //##############################################################################
-//################HOW MANY DEVICES/OF A CERTAIN KIND????########################
+//#####################COMMAND LOOKUP###########################################
 //##############################################################################
 
-// Return the number of devices connected to the computer
-FT_STATUS numberOfDevices(DWORD* numDevs)
-{
-	FT_STATUS ftStatus;	
+#define COMMAND_CASE(name, minArgs, maxArgs, inputs, needsInit, usage) case commandHash(#name): id = id_##name; break;
 
-	// Get the number of connected devices.  There should be two devices
-	ftStatus = FT_ListDevices(numDevs,NULL,FT_LIST_NUMBER_ONLY);
-	if (ftStatus == FT_OK) {
-		// FT_ListDevices OK, number of devices connected is in numDevs		
+// Number of the command named (or numbered) by a MATLAB argument [-1 if there isn't one].
+// No allocation: the name is copied to the stack, hashed, and confirmed with one strcmp.
+int commandLookup(const mxArray *arg)
+{
+	int id = -1;
+	if (mxIsDouble(arg) && mxGetNumberOfElements(arg) == 1) {
+		double number = *mxGetPr(arg);
+		return (number >= 0 && number < numCommandIds) ? (int)number : -1;
 	}
-	else {
-		// FT_ListDevices failed
-		*numDevs = 0;
-		
+	char name[32];
+	if (!mxIsChar(arg) || mxGetString(arg, name, sizeof(name)) != 0)
+		return -1;
+	switch (commandHash(name)) {
+		MANIP_COMMANDS(COMMAND_CASE)
 	}
-	return ftStatus;
+	if (id >= 0 && strcmp(name, commandSpecs[id].name) != 0)
+		id = -1;
+	return id;
 }
 
-FT_STATUS numberOfManips(DWORD* numManips)
+// Check a call's inputs against its command's spec, printing what's wrong if anything is.
+// Numbers are copied into args->number and the manipulator input resolved to args->manip.
+// Returns 1 if the command can go ahead.
+int decodeArgs(int command, int nrhs, const mxArray *prhs[], manipArgs *args)
 {
-	DWORD numDevs;
-	FT_STATUS ftStatus;
-
-	*numManips = 0;
-	ftStatus = numberOfDevices(&numDevs);
-	for (DWORD i=0;i<numDevs;i++) {
-		if (isManip(i) != 0) {
-			(*numManips)++;
-		}
-	}
-	return ftStatus;
-}
-//##############################################################################
-//######################RETURNS INFO ON DEVICE##################################
-//##############################################################################
-// Return the description (name) of the specified device
-FT_STATUS deviceDescription(DWORD deviceNumber, char* deviceName)
-{
-	FT_STATUS ftStatus;	
-	DWORD devIndex = deviceNumber; //we need to copy the device number for some reason
-	char Buffer[64]; // more than enough room!
-
-	ftStatus = FT_ListDevices((PVOID)devIndex,Buffer,FT_LIST_BY_INDEX|FT_OPEN_BY_DESCRIPTION);
-	if (ftStatus == FT_OK) {
-	// FT_ListDevices OK, description is in Buffer		
-		strcpy(deviceName, Buffer);
+	const manipCommandSpec *spec = &commandSpecs[command];
+	args->count = nrhs;
+	args->manip = -1;
+	if (spec->needsInit == 2 && manipConnected()) {
+		mexPrintf("Error. '%s' only works on manipulators initialized here, not on manipDaemon's (see 'connect')\n", spec->name);
+		return 0;
 	}
-	else {
-		mexPrintf("%s('deviceName'): Error getting data to manipulator 1",FUNC_NAME);
+	if (spec->needsInit && manipCount() < 0) {
+		mexPrintf("Not initialized.\n");
+		return 0;
 	}
-	return ftStatus;
-}
-
-// Return the serial number of the specified device
-FT_STATUS deviceSerial(DWORD deviceNumber, char* deviceName)
-{
-	FT_STATUS ftStatus;	
-	DWORD devIndex = deviceNumber; //we need to copy the device number for some reason
-	char Buffer[64]; // more than enough room!
-
-	ftStatus = FT_ListDevices((PVOID)devIndex,Buffer,FT_LIST_BY_INDEX|FT_OPEN_BY_SERIAL_NUMBER);
-	if (ftStatus == FT_OK) {
-	// FT_ListDevices OK, description is in Buffer		
-		strcpy(deviceName, Buffer);
+	if (nrhs-1 < spec->minArgs || nrhs-1 > spec->maxArgs) {
+		mexPrintf("Error. Using '%s' requires %s('%s'%s)\n", spec->name, FUNC_NAME, spec->name, spec->usage);
+		return 0;
 	}
-	else {
-		mexPrintf("%s('deviceSerial'): Error getting data to manipulator 2\n",FUNC_NAME);
+	for (int i=1; i<nrhs; i++) {
+		const mxArray *arg = prhs[i];
+		char kind = spec->inputs[i-1];
+		args->number[i] = 0;
+		if (kind == 'd') {
+			if (!mxIsDouble(arg) || mxGetNumberOfElements(arg) != 1) {
+				mexPrintf("Error. Input %d of '%s' must be a number (%s('%s'%s))\n", i, spec->name, FUNC_NAME, spec->name, spec->usage);
+				return 0;
+			}
+			args->number[i] = *mxGetPr(arg);
+		}
+		else if (kind == 's' && !mxIsChar(arg)) {
+			mexPrintf("Error. Input %d of '%s' must be a string (%s('%s'%s))\n", i, spec->name, FUNC_NAME, spec->name, spec->usage);
+			return 0;
+		}
+		else if (kind == 'M' && !mxIsDouble(arg)) {
+			mexPrintf("Error. Input %d of '%s' must be a numeric matrix (%s('%s'%s))\n", i, spec->name, FUNC_NAME, spec->name, spec->usage);
+			return 0;
+		}
+		else if (kind == 'm') {
+			args->manip = sessionNumber(arg);
+			if (args->manip < 0) {
+				mexPrintf("Error. Device number for '%s' is out of range or not an initialized serial number (%d devices initialized)\n", spec->name, manipCount());
+				return 0;
+			}
+		}
 	}
-	return ftStatus;
+	return 1;
 }
 
-//##############################################################################
-//##################CHECKS TO SEE DEVICE TYPES##################################
-//##############################################################################
-
-// Checks to see if the device is a Manipulator [1 yes, 0 no]
-int isManip(DWORD deviceNumber) 
+// Which open manipulator a MATLAB argument refers to: either its number or its serial
+// number [-1 if neither matches]
+int sessionNumber(const mxArray *arg)
 {
-	char devDesc[64];
-	deviceDescription(deviceNumber,devDesc);
-	// we have a manip
-	if (strcmp(devDesc,"Sutter Instrument ROE-200") == 0)
-    //if (strcmp(devDesc,"Sutter Instrument Lambda SC") == 0)
-		return 1;
-	// the device is not a Manip
-	else
-		return 0;
+	if (mxIsChar(arg)) {
+		char serial[64];
+		mxGetString(arg, serial, sizeof(serial));
+		return manipFind(serial);
+	}
+	if (mxGetNumberOfElements(arg) < 1 || !mxIsDouble(arg))
+		return -1;
+	double number = *mxGetPr(arg);
+	if (number < 0 || number >= manipCount())
+		return -1;
+	return (int)number;
 }
-//##############################################################################
-//##############################################################################
-//##############################################################################
 
-// Create a handle to the device that allows writing
-FT_STATUS getHandle(DWORD deviceNumber, FT_HANDLE *deviceHandle)
+// The library's messages, printed from MATLAB's thread (the only one mexPrintf works on)
+void printMessage(const char *message)
 {
-	FT_STATUS ftStatus;
-    //FT_HANDLE ftHandle1;
-
-	//Get the serial number of the device
-	char devSerial[128];	
-	// get device name 
-	deviceSerial(deviceNumber, devSerial);
-	mexPrintf("Getting handle to device %u (serial %s)\n", deviceNumber, devSerial);
-
-    //ftStatus = FT_OpenEx("SIDDUI9M", FT_OPEN_BY_SERIAL_NUMBER, &ftHandle1);
-	ftStatus = FT_OpenEx(devSerial, FT_OPEN_BY_SERIAL_NUMBER, deviceHandle);
-    //ftStatus = FT_Open(0,deviceHandle);
-	if (ftStatus != FT_OK) {
-		mexPrintf("Couldn't open manipulator %u\n", deviceNumber);
-		return ftStatus;
-	}
-    
-    //*deviceHandle = ftHandle1;  
-    
-    //mexPrintf("Good So Far (2)\n");
-	//Set up the channel properly
-	FT_SetDataCharacteristics (*deviceHandle, FT_BITS_8, FT_STOP_BITS_1,FT_PARITY_NONE);
-    //mexPrintf("Set Data Characteristics\n");
-	FT_SetFlowControl (*deviceHandle, FT_FLOW_NONE, 0,0);
-    //mexPrintf("Set Flow Control\n");
-	FT_SetTimeouts(*deviceHandle,500,500);
-    //mexPrintf("Set Timeouts\n");
-	FT_Purge(*deviceHandle,FT_PURGE_RX|FT_PURGE_TX);
-    //mexPrintf("Purged everything\n");
-	FT_SetLatencyTimer(*deviceHandle,16);
-    //mexPrintf("Set Latency Timer\n");
-	FT_SetBaudRate(*deviceHandle,128000);
-    //mexPrintf("Set Baud Rate\n");
-	FT_SetUSBParameters(*deviceHandle,64,0);
-    //mexPrintf("Set USB Parameters\n");
-	
-	//Maybe resetting the device will help???
-	//FT_ResetDevice(*deviceHandle);
-
-	//Write 238 (0xEE) to have the controller begin accepting commands	
-	#define initWriteSize 1
-	char TxBuffer[initWriteSize];	
-	TxBuffer[0] = 238;
-	DWORD bytesWritten;
-
-	ftStatus = FT_Write(*deviceHandle, TxBuffer, initWriteSize, &bytesWritten);
-	if (ftStatus != FT_OK){
-		mexPrintf("%s('getHandle'): Error writing to manipulator %u\n",FUNC_NAME, deviceNumber);
-    }
-    else {
-        mexPrintf("%s Successfully initially written to device.\n");
-    }
-	return ftStatus;
+	mexPrintf("%s", message);
 }
 
-//##############################################################################
-//##############################################################################
-
-
-FT_STATUS where(FT_HANDLE ftHandle, int drive, int* xout, int* yout, int* zout) 
+mxArray* linkSettingsStruct(const manipLinkConfig *settings)
 {
-	FT_STATUS ftStatus;
-		
-	//Begin by flushing the buffer
-	FT_Purge(ftHandle, FT_PURGE_RX | FT_PURGE_TX);
-    
-    DWORD bytesWritten;
-    
-    //change the manipulator drive, if needed...
-    driveChange(ftHandle, drive);
-   
-	//Send the command to get the status
-	char BytesToWrite[1];
-    BytesToWrite[0]= 0x43;
-    //The 'C' command which tells the manipulator to get current position hex: 0x43
-    
-	ftStatus = FT_Write(ftHandle, BytesToWrite , 1, &bytesWritten);
-	if (ftStatus != FT_OK) {
-		mexPrintf("%s('status'): Error writing");		
-		return ftStatus;
-	}
-    //mexPrintf("Successfully wrote %u byte(s).  Specifically we sent: %s\n", bytesWritten, BytesToWrite);
-
-	//Now we need to read the response			
-	DWORD BytesReceived;  //use for reference and debugging
-	//receive the values
-    
-    //input arrays:
-    char RxBuffer[64];
-    int input[32];
-    //just to be safe, set all the values to zero!  Sloppy I know.
-    input[0]=0;
-    input[1]=0;
-    input[2]=0;
-    input[3]=0;
-    input[4]=0;
-    input[5]=0;
-    input[6]=0;
-    input[7]=0;
-    input[8]=0;
-    input[9]=0;
-    input[10]=0;
-    input[11]=0;
-    
-    ftStatus = FT_Read(ftHandle,&input[0],1,&BytesReceived);  //First byte is some new line garbage...read it and then forget it.
-    ftStatus = FT_Read(ftHandle,&input[0],1,&BytesReceived);
-    ftStatus = FT_Read(ftHandle,&input[1],1,&BytesReceived);
-    ftStatus = FT_Read(ftHandle,&input[2],1,&BytesReceived);
-    ftStatus = FT_Read(ftHandle,&input[3],1,&BytesReceived);
-    ftStatus = FT_Read(ftHandle,&input[4],1,&BytesReceived);
-    ftStatus = FT_Read(ftHandle,&input[5],1,&BytesReceived);
-    ftStatus = FT_Read(ftHandle,&input[6],1,&BytesReceived);
-    ftStatus = FT_Read(ftHandle,&input[7],1,&BytesReceived);
-    ftStatus = FT_Read(ftHandle,&input[8],1,&BytesReceived);
-    ftStatus = FT_Read(ftHandle,&input[9],1,&BytesReceived);
-    ftStatus = FT_Read(ftHandle,&input[10],1,&BytesReceived);
-    ftStatus = FT_Read(ftHandle,&input[11],1,&BytesReceived);
-    //Read out whatever other garbage is sitting in the output buffer.
-    ftStatus = FT_Read(ftHandle,&RxBuffer[0],14,&BytesReceived);  
-    
-    /*mexPrintf("0:%d 1: %d 2: %d 3: %d\n", input[0], input[1], input[2], input[3]);
-    mexPrintf("0:%d 1: %d 2: %d 3: %d\n", input[4], input[5], input[6], input[7]);
-    mexPrintf("0:%d 1: %d 2: %d 3: %d\n", input[8], input[9], input[10], input[11]);
-    */
-	//ftStatus = FT_Read(ftHandle,&RxBuffer[0],14,&BytesReceived);
-	if (ftStatus == FT_OK) {
-		//mexPrintf("Successfully read %u bytes.  Response: %s\n", BytesReceived, RxBuffer);
-		//Bytes 0 through 3 are the first long (x) value IN REVERSE SIGNIFICANT BYTE ORDER, 
-        //Bytes 4 through 7 are the second long (y) value IN REVERSE SIGNIFICANT BYTE ORDER,
-        //Bytes 8 through 11 are the third long (z) value IN REVERSE SIGNIFICANT BYTE ORDER,
-        //Byte 12 should be a carriage return  JDS (5/05/2009)
-        
-        //The above comment should be noted that the output stream from the manipulator consists of at at least 13 bytes
-        //The first is some new line (binary: ...00010) and then we have the twelve bytes in ascending significant order.
-        //There's probably a carriage return at the end of this but I really don't care at this point.  I will flush/delete
-        //the buffer anyways so its no big deal.
-		
-        //Each drive moves in 62.5 nm steps, so take the data, weight it appropriately,
-        //then assign it to the proper pointer.  The output is in steps...NOT MICRONS! OR NANOMETERS!
-        //So *xout, *yout, and *zout have a range of 0 to 400e3 steps, which corresponds to 0 to 25 mm
-        
-        //Take each input and weight it according to its significance and then assign to the pointers supplied:
-        
-        *xout = (input[0]+256*input[1]+256*256*input[2] + 256*256*256*input[3]);
-        
-        *yout = (input[4]+256*input[5]+256*256*input[6] + 256*256*256*input[7]);
-    
-        *zout = (input[8]+256*input[9]+256*256*input[10] + 256*256*256*input[11]);
-         
-        return ftStatus;
-    }
-	else {
-		mexPrintf("%s('status'): Error reading response\n",FUNC_NAME);
-		return ftStatus;
-	}		
+	const char *fields[] = { "baudRate", "latencyTimer", "usbTransferSize", "readTimeout", "writeTimeout" };
+	mxArray *out = mxCreateStructMatrix(1, 1, 5, fields);
+	mxSetField(out, 0, "baudRate", mxCreateDoubleScalar(settings->baudRate));
+	mxSetField(out, 0, "latencyTimer", mxCreateDoubleScalar(settings->latencyTimer));
+	mxSetField(out, 0, "usbTransferSize", mxCreateDoubleScalar(settings->usbTransferSize));
+	mxSetField(out, 0, "readTimeout", mxCreateDoubleScalar(settings->readTimeout));
+	mxSetField(out, 0, "writeTimeout", mxCreateDoubleScalar(settings->writeTimeout));
+	return out;
 }
 
-FT_STATUS move(FT_HANDLE ftHandle, int drive, int x, int y, int z)
+// One field per operation, each a struct of its counters and latency percentiles (ms)
+mxArray* statsStruct(int manip)
 {
-    FT_STATUS ftStatus;
-		
-	//Begin by flushing the buffer
-	FT_Purge(ftHandle, FT_PURGE_RX | FT_PURGE_TX);
-    
-    DWORD bytesWritten;
-    char RxBuffer[12];
-    //Change the manipulator drive (if needed...)
-    driveChange(ftHandle, drive);
-    
-    //Send the command to get the status
-	char input[13];
-    //The 'M' command which tells the manipulator to move, damnit. hex: 0x4D
-    input[0] = 0x4D;
-    
-    input[1] = char(x);
-    input[2] = char((x >> 8));
-    input[3] = char((x >> 16));
-    input[4] = char((x >> 24));
-    
-    input[5] = char(y);
-    input[6] = char((y >> 8));
-    input[7] = char((y >> 16));
-    input[8] = char((y >> 24));
-    
-    input[9] = char(z);
-    input[10] = char((z >> 8));
-    input[11] = char((z >> 16));
-    input[12] = char((z >> 24));
-    
-	ftStatus = FT_Write(ftHandle, input , 13, &bytesWritten);
-    //Read out the carriage return from the manip
-    ftStatus = FT_Read(ftHandle,&RxBuffer[0],3,&bytesWritten);
-	if (ftStatus != FT_OK) {
-		mexPrintf("%s('status'): Error writing");		
-		return ftStatus;
+	manipOpSummary summaries[16];
+	const char *opFields[17];
+	const char *fields[] = { "count", "failures", "mean_ms", "p50_ms", "p90_ms", "p99_ms", "max_ms" };
+	const char *linkFields[] = { "timeouts", "badFrames", "resyncs", "retries", "gaveUp", "roundTrip_ms", "replyTimeout_ms" };
+	const char *schedulerFields[] = { "requests", "reordered", "forced", "switches", "switchesAvoided", "meanWait_ms", "p99Wait_ms" };
+	int numOps = manipGetStats(manip, summaries, 15);
+	for (int op=0; op<numOps; op++)
+		opFields[op] = summaries[op].name;
+	opFields[numOps] = "link";
+	opFields[numOps+1] = "scheduler";
+	mxArray *out = mxCreateStructMatrix(1, 1, numOps+2, opFields);
+	for (int op=0; op<numOps; op++) {
+		const manipOpSummary *summary = &summaries[op];
+		mxArray *item = mxCreateStructMatrix(1, 1, 7, fields);
+		mxSetField(item, 0, "count", mxCreateDoubleScalar(summary->count));
+		mxSetField(item, 0, "failures", mxCreateDoubleScalar(summary->failures));
+		mxSetField(item, 0, "mean_ms", mxCreateDoubleScalar(summary->meanMs));
+		mxSetField(item, 0, "p50_ms", mxCreateDoubleScalar(summary->p50Ms));
+		mxSetField(item, 0, "p90_ms", mxCreateDoubleScalar(summary->p90Ms));
+		mxSetField(item, 0, "p99_ms", mxCreateDoubleScalar(summary->p99Ms));
+		mxSetField(item, 0, "max_ms", mxCreateDoubleScalar(summary->maxMs));
+		mxSetField(out, 0, summary->name, item);
 	}
-    else{
-    //mexPrintf("Successfully wrote %u byte(s).  Specifically we sent: %s\n", bytesWritten, input);
-    return ftStatus;
-    }
-    return ftStatus;
-   
+	manipLinkHealth health;
+	memset(&health, 0, sizeof(health));
+	manipGetLinkHealth(manip, &health);
+	mxArray *link = mxCreateStructMatrix(1, 1, 7, linkFields);
+	mxSetField(link, 0, "timeouts", mxCreateDoubleScalar(health.timeouts));
+	mxSetField(link, 0, "badFrames", mxCreateDoubleScalar(health.badFrames));
+	mxSetField(link, 0, "resyncs", mxCreateDoubleScalar(health.resyncs));
+	mxSetField(link, 0, "retries", mxCreateDoubleScalar(health.retries));
+	mxSetField(link, 0, "gaveUp", mxCreateDoubleScalar(health.gaveUp));
+	mxSetField(link, 0, "roundTrip_ms", mxCreateDoubleScalar(health.roundTripMs));
+	mxSetField(link, 0, "replyTimeout_ms", mxCreateDoubleScalar(health.replyTimeoutMs));
+	mxSetField(out, 0, "link", link);
+	manipSchedulerStats scheduler;
+	memset(&scheduler, 0, sizeof(scheduler));
+	manipGetSchedulerStats(manip, &scheduler);
+	mxArray *sched = mxCreateStructMatrix(1, 1, 7, schedulerFields);
+	mxSetField(sched, 0, "requests", mxCreateDoubleScalar(scheduler.requests));
+	mxSetField(sched, 0, "reordered", mxCreateDoubleScalar(scheduler.reordered));
+	mxSetField(sched, 0, "forced", mxCreateDoubleScalar(scheduler.forced));
+	mxSetField(sched, 0, "switches", mxCreateDoubleScalar(scheduler.switches));
+	mxSetField(sched, 0, "switchesAvoided", mxCreateDoubleScalar(scheduler.switchesAvoided));
+	mxSetField(sched, 0, "meanWait_ms", mxCreateDoubleScalar(scheduler.meanWaitMs));
+	mxSetField(sched, 0, "p99Wait_ms", mxCreateDoubleScalar(scheduler.p99WaitMs));
+	mxSetField(out, 0, "scheduler", sched);
+	return out;
 }
 
-FT_STATUS driveChange(FT_HANDLE ftHandle, int drive)
+// Registered with mexAtExit: stop the I/O threads and close the handles on 'clear mex'
+void shutdownAll()
 {
-    FT_STATUS ftStatus;
-		
-	//Begin by flushing the buffer
-	FT_Purge(ftHandle, FT_PURGE_RX);
-    
-    DWORD bytesWritten;
-   
-    //create char array to hold commands for drive change
-    char driveChange[2];
-    driveChange[0] = 0x49;
-    
-    //determine which drive to change to
-    if (drive == 1){
-        driveChange[1] = 0x01;
-    }
-    else if (drive == 2){
-        driveChange[1] = 0x02;
-    }
-    else {
-        mexPrintf("%s('status'): Error reading response.  Drive value is incorrect in FT_STATUS_where\n",FUNC_NAME);
-		return ftStatus;
-    }
-    
-    //####################
-    DWORD BytesReceived;
-	//receive the values
-    char RxBuffer[64];
-    //####################
-    
-    //Change the drive...
-    ftStatus = FT_Write(ftHandle, driveChange , 2, &bytesWritten);
-	if (ftStatus != FT_OK) {
-		mexPrintf("%s('status'): Error writing");		
-		return ftStatus;
-	}
-    //Read out the carriage return from the manip
-    ftStatus = FT_Read(ftHandle,&RxBuffer[0],3,&BytesReceived);
-    //mexPrintf("Successfully read %u bytes.  Response: %s\n", BytesReceived, RxBuffer);
-    
-    if (ftStatus == FT_OK) {
-        //mexPrintf("Drive Change written. Successfully wrote %u byte(s).  Specifically we sent: %s\n", bytesWritten, driveChange);
-    }
-    return ftStatus;
+	manipUninitialize();
+	manipStopTrace();
+	manipStopPublishing();
 }
 
 //##############################################################################
@@ -628,8 +1013,38 @@ void getCommands() {
 	mexPrintf("%s('numDevices'): return the number of FTD2XX devices connected to the computer.\n",FUNC_NAME);
 	mexPrintf("%s('deviceName',deviceNumber): return the name of the FTD2XX device number <deviceNumber>.\n",FUNC_NAME);
 	mexPrintf("%s('deviceSerial',deviceNumber): return the serial number of the FTD2XX device number <deviceNumber>.\n",FUNC_NAME);
-	mexPrintf("%s('initialize'): Initialize all the manipulators connected to the computer.  Returns a vector of the initialized device numbers.\n",FUNC_NAME);
+	mexPrintf("%s('setTransport',name[,paths]): Choose how devices are opened: 'd2xx', (Linux) 'termios', optionally with a ';' separated list of tty paths, or 'emulator', optionally with 'name=value;...' options.\n",FUNC_NAME);
+	mexPrintf("%s('rescan'): Enumerate the devices again (after plugging in or out).  Returns the number of devices, and optionally a struct array describing them.\n",FUNC_NAME);
+	mexPrintf("%s('initialize'[,{serial,...}]): Initialize all the manipulators connected to the computer, or just the listed serial numbers in that order.  Returns a vector of the initialized device numbers, and optionally [deviceNumber status] and per-phase times (ms) for every device tried.\n",FUNC_NAME);
 	mexPrintf("%s('uninitialize'): Releases control of all the manipulators connected to the computer.\n",FUNC_NAME);
     mexPrintf("%s('changePosition',deviceNumber,driveNumber,X,Y,Z): Change the x,y,z position of the particular device and drive.\n",FUNC_NAME);
     mexPrintf("%s('getPosition',deviceNumber,driveNumber): Obtain the x,y,z position of the particular device and drive.\n",FUNC_NAME);
+    mexPrintf("%s('getPositionAll'): Read every drive of every manipulator at once.  Returns [device drive x y z] rows, and optionally each row's status.\n",FUNC_NAME);
+    mexPrintf("%s('moveAsync',deviceNumber,driveNumber,X,Y,Z): Start a move and return immediately.\n",FUNC_NAME);
+    mexPrintf("%s('moveVerified',deviceNumber,driveNumber,X,Y,Z,tolSteps,maxRetries,timeoutMs): Move and correct until within tolerance.  Returns the final position, and optionally the moves sent, elapsed ms and status.\n",FUNC_NAME);
+    mexPrintf("%s('changePositionAtSpeed',deviceNumber,driveNumber,X,Y,Z,speed,fine): Move at speed um/s, at fine (1) or coarse (0) resolution.  Returns the status, and optionally [speed fine velocitySent predicted_ms measured_ms].\n",FUNC_NAME);
+    mexPrintf("%s('changePositionPlanned',deviceNumber,driveNumber,X,Y,Z): Move at the fastest speed the planner allows for the distance.  Returns the same as changePositionAtSpeed.\n",FUNC_NAME);
+    mexPrintf("%s('moveRelative',deviceNumber,driveNumber,dX,dY,dZ): Move by dX,dY,dZ steps from the last known position.  Returns the target, and optionally which axes were clamped and the status.\n",FUNC_NAME);
+    mexPrintf("%s('setTarget',deviceNumber,driveNumber,X,Y,Z): Replace the drive's setpoint and return; only the newest is sent once the stage is free.  Optionally returns [received sent coalesced failed].\n",FUNC_NAME);
+    mexPrintf("%s('moveMany',[device,drive,X,Y,Z;...]): Run one move per row, all devices at once.  Returns each row's status and completion time (s).\n",FUNC_NAME);
+    mexPrintf("%s('startStream',deviceNumber,driveNumber,rateHz): Start polling the position of a drive in the background.\n",FUNC_NAME);
+    mexPrintf("%s('readStream',deviceNumber): Return the samples taken since the last call as [t x y z] rows, and optionally [dropped missed failed] counts.\n",FUNC_NAME);
+    mexPrintf("%s('stopStream',deviceNumber): Stop polling the device's position.\n",FUNC_NAME);
+    mexPrintf("%s('executePath',deviceNumber,driveNumber,waypoints,dwellMs): Move through an Nx3 list of waypoints in the background.\n",FUNC_NAME);
+    mexPrintf("%s('pathStatus',deviceNumber): Returns [reached total status running] for the last path, and optionally each waypoint's completion time (s).\n",FUNC_NAME);
+    mexPrintf("%s('abortPath',deviceNumber): Stop the running path after the current waypoint.\n",FUNC_NAME);
+    mexPrintf("%s('configureLink',deviceNumber,name,value,...): Change and save a device's link settings (baudRate, latencyTimer, usbTransferSize, readTimeout, writeTimeout).\n",FUNC_NAME);
+    mexPrintf("%s('autotune',deviceNumber[,driveNumber,samples]): Find, apply and save the fastest latency timer / USB transfer size.\n",FUNC_NAME);
+    mexPrintf("%s('isMoving',deviceNumber): Returns 1 while moves started with moveAsync are still running.\n",FUNC_NAME);
+    mexPrintf("%s('waitMove',deviceNumber,timeoutMs): Wait for the device's moves to finish.  Returns 1 if they did, 0 on timeout.\n",FUNC_NAME);
+    mexPrintf("%s('stats',deviceNumber): Latency counters and p50/p90/p99/max (ms) of the device's writes, reads, purges, drive changes, position queries, moves and queue waits, with link error and drive scheduling counts.\n",FUNC_NAME);
+    mexPrintf("%s('resetStats'[,deviceNumber]): Zero the 'stats' of one device, or of all of them.\n",FUNC_NAME);
+    mexPrintf("%s('connect'[,socketPath]): Use the manipulators a running manipDaemon has open.  Returns how many it has.\n",FUNC_NAME);
+    mexPrintf("%s('disconnect'): Stop using the daemon's manipulators.\n",FUNC_NAME);
+    mexPrintf("%s('daemonTimes'): [requests meanRoundTrip_ms meanOverhead_ms maxOverhead_ms] of the calls sent to the daemon.\n",FUNC_NAME);
+    mexPrintf("%s('trace'[,file,records]): Record every write, read and purge to a memory-mapped file (ring of 'records', default 65536); with no input, stop.  manipTraceDecode converts the file to CSV.\n",FUNC_NAME);
+    mexPrintf("%s('publish'[,name]): Publish every drive's latest position in shared memory for other programs (see manipPositions.h).\n",FUNC_NAME);
+    mexPrintf("%s('unpublish'): Stop publishing positions.\n",FUNC_NAME);
+    mexPrintf("%s('commandId'[,commandName]): Return a command's number, which can be passed instead of its name, or with no input the list of command names.\n",FUNC_NAME);
+    mexPrintf("Any deviceNumber of an initialized manipulator can also be given as its serial number.\n");
 } // void getCommands()
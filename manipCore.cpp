@@ -0,0 +1,2421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdarg.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "manipCore.h"
+#include "manipTransport.h"
+#include "manipProtocol.h"
+#include "manipTrace.h"
+#include "manipPositions.h"
+#include "manipDaemon.h"
+
+//The device layer behind manipControl (see manipCore.h for the API).  Internally every open
+//controller is a manipSession, driven by its own I/O thread (manipWorker).
+
+// Constants
+#define FUNC_NAME "ManipControl"	//What messages are prefixed with (the MEX function's name)
+#define maxManips MANIP_MAX_MANIPS	//The maximum number of manipulators that can be controlled using this program
+#define maxDrives MANIP_MAX_DRIVES	//The number of drives an MPC-2000/ROE-200N can switch between
+#define maxDevices 64				//The most USB serial devices the enumeration cache keeps
+#define numInitPhases MANIP_INIT_PHASES	//getHandle() is timed as: open, configure, purge, wake-up write
+#define maxSteps 400000				//End of travel on every axis (25 mm in 62.5 nm steps)
+#define traceDefaultRecords 65536		//Transactions a trace keeps when no size is given (4 MB)
+#define maxReplyRetries 2			//Times a command is sent again after a late, short or misframed reply
+#define minRttSamples 4				//Round trips timed before the reply timeout adapts to them
+#define replyMarginMs 2				//Slack on top of the adaptive reply timeout
+#define maxMoveMs 30000				//Longest the end of a move is waited for while its length can't be estimated
+#define minBaudRate 300				//Slowest serial rate a link may be set to (0 would hang up the line)
+#define minLinkTimeoutMs 10			//Shortest read or write timeout a link may be set to
+#define minLearnSteps 1000			//Shortest move the move speed is learned from
+#define stepsPerUm 16				//Steps per um of travel: a speed of 1 um/s is 16 steps/s
+#define plannerLevels 5				//Speeds the move planner chooses between
+#define plannerFineSteps 1600		//Moves shorter than this (100 um) are planned at fine resolution
+#define commandQueueSize 64			//Commands that can be waiting for a device's I/O thread (must be a power of two)
+#define schedulerWindow 32			//Commands the I/O thread looks at when choosing which to run next
+#define maxBypass 4					//Times a command can be overtaken by ones for the other drive
+#define maxTargetBypass 4			//Commands run while a setTarget target waits before it gets a turn
+#define streamBufferSize 65536		//Position samples a stream can hold between readStream calls (must be a power of two)
+#define numTuneLatencies 5			//Latency timer values autotune tries...
+#define numTuneTransfers 4			//...times the USB transfer sizes it tries
+
+struct manipWorker;
+
+// Everything we know about one opened controller.  One of these per initialized device.
+typedef struct {
+	manipTransport link;						// connection to the controller
+	DWORD deviceNumber;							// FTD2XX device number the handle was opened from
+	char serial[64];							// serial number the handle was opened by
+	manipLinkSettings settings;					// connection parameters (as applied by getHandle())
+	//Last known state
+	int activeDrive;							// drive currently selected on the controller, 0 = unknown
+	FT_STATUS lastStatus;						// status of the last command sent
+	//Position model: updated by every good 'C' reply and every completed 'M', and dropped by
+	//sessionError.  Only the I/O thread touches it; moveRelative works from it.
+	int positionKnown[maxDrives+1];				// whether lastPosition[drive] is valid (indexed by drive number)
+	int lastPosition[maxDrives+1][3];			// last x,y,z read back from or sent to each drive (steps)
+	//Reply timing (I/O thread only).  'C' and 'I' replies are waited for replyTimeout(),
+	//worked out from their measured round trips, and 'M' replies for moveTimeout(), from
+	//the move's length and the speed moves have been seen to go at.
+	double rttMs;								// smoothed round trip of a 'C' or 'I'
+	double rttVarMs;							// and its mean deviation
+	int rttSamples;								// round trips timed since the link settings last changed
+	double msPerStep;							// move time per step of the longest axis (0: not measured yet)
+	//Last velocity command sent to each drive (I/O thread only), so that it is only sent
+	//again when it changes.  Dropped by sessionError, as a lost reply leaves it in doubt.
+	int speedKnown[maxDrives+1];				// whether speed[drive] and fine[drive] are what the drive has
+	int speed[maxDrives+1];						// um/s
+	int fine[maxDrives+1];
+	struct manipWorker *worker;					// I/O thread that owns the handle (NULL until started)
+	double initMs[numInitPhases];				// how long each part of getHandle() took
+} manipSession;
+
+// Commands understood by a device's I/O thread
+enum { cmdQuit, cmdWhere, cmdMove, cmdStartStream, cmdStopStream, cmdRunPath, cmdConfigure, cmdAutotune, cmdWhereAll, cmdMoveVerified, cmdMoveRelative, cmdTimedMove };
+
+// Completion record for a command whose caller wants to hear back about it
+typedef struct {
+	std::atomic<int> done;						// set by the I/O thread once the fields below are filled in
+	FT_STATUS status;
+	int x, y, z;
+	std::chrono::steady_clock::time_point completed;
+} manipReply;
+
+typedef struct {
+	int type;									// cmdQuit, cmdWhere, cmdMove, ...
+	int drive;
+	int x, y, z;
+	manipReply *reply;							// NULL for fire and forget (moveAsync)
+	void *data;									// cmdConfigure: manipLinkSettings, cmdAutotune: result table, cmdWhereAll: one manipPosition per drive,
+												// cmdMoveVerified: manipVerifiedMove, cmdMoveRelative: manipRelativeMove, cmdTimedMove: manipSpeedMove
+	std::chrono::steady_clock::time_point queued;	// set by submitCommand
+	int bypassed;								// times it was overtaken in the scheduler window
+} manipCommand;
+
+// The thread that does all the FTDI I/O for one device, and the queue that feeds it
+struct manipWorker {
+	manipSession *session;
+	std::thread thread;
+	//Ring with a single consumer (the I/O thread).  Callers on different threads take
+	//callerLock to fill a slot, which is uncontended when there is only one of them; the I/O
+	//thread takes no lock to empty one.  wakeLock is only used to sleep when there is nothing to do.
+	manipCommand queue[commandQueueSize];
+	std::atomic<unsigned> head;					// next slot the I/O thread will take
+	std::atomic<unsigned> tail;					// next slot a caller will fill
+	std::mutex callerLock;						// one caller at a time fills the queue, drains the stream or uploads a path
+	std::mutex wakeLock;
+	std::condition_variable wake;				// signalled when a command is queued
+	std::condition_variable finished;			// signalled when a command completes
+	//Drive-aware scheduling (I/O thread only).  Commands are taken off the ring into this
+	//window, and nextCommand() picks the one to run, so that the commands for both drives
+	//waiting together cost as few 'I' drive changes as they can.
+	manipCommand window[schedulerWindow];
+	int windowLength;
+	int arrivalDrive;							// drive of the last drive command taken off the ring
+	int lastDrive;								// drive of the last drive command run
+	std::atomic<unsigned> movesQueued;			// moves handed to the thread so far
+	std::atomic<unsigned> movesDone;			// moves the thread has completed
+	FT_STATUS lastMoveStatus;					// status of the most recently completed move
+	//Position streaming.  While a stream is running the thread polls the drive whenever it
+	//has no commands to run, and writes into a single producer / single consumer ring that
+	//readStream drains.  The ring is allocated by the first startStream and reused after that.
+	int streaming;								// only touched by the I/O thread
+	int streamDrive;
+	std::chrono::steady_clock::duration streamPeriod;
+	std::chrono::steady_clock::time_point streamStart;
+	std::chrono::steady_clock::time_point nextSample;
+	manipSample *stream;
+	std::atomic<unsigned> streamHead;			// next sample readStream will take
+	std::atomic<unsigned> streamTail;			// next slot the I/O thread will fill
+	std::atomic<unsigned> streamDropped;		// samples lost because the ring was full
+	std::atomic<unsigned> streamMissed;			// sample times skipped because the thread was busy
+	std::atomic<unsigned> streamFailed;			// polls that didn't get a valid reply
+	//Waypoint path uploaded by executePath.  The arrays belong to the callers (under
+	//callerLock) while pathPending is 0 and to the I/O thread while it is 1.
+	int pathDrive;
+	int pathLength;
+	int pathCapacity;							// waypoints pathPoints and pathTimes have room for
+	int pathDwellMs;							// pause after reaching each waypoint
+	int *pathPoints;							// x,y,z of each waypoint, one after the other
+	double *pathTimes;							// completion time of each waypoint (s since the path started)
+	std::atomic<int> pathPending;				// a path has been queued and hasn't finished
+	std::atomic<int> pathDone;					// waypoints reached so far
+	std::atomic<int> pathAbort;					// set by abortPath, checked between waypoints
+	FT_STATUS pathStatus;						// FT_OK, or the status of the move that failed
+	//Latest-value setpoints from setTarget, one slot per drive.  A new target overwrites one
+	//that hasn't been sent yet, so however fast they arrive the device is only ever one move
+	//behind the newest.  The I/O thread sends them when it has no commands queued, or after
+	//maxTargetBypass commands have run ahead of one, so a busy queue can't starve them.
+	std::mutex targetLock;
+	int targetPending[maxDrives+1];				// whether target[drive] is waiting to be sent
+	int target[maxDrives+1][3];
+	int targetNext;								// drive to look at first, so neither drive starves the other
+	int targetBypassed;							// commands run since a target started waiting (I/O thread only)
+	std::atomic<int> targetsWaiting;			// number of drives with a target pending
+	std::atomic<unsigned> targetsReceived;
+	std::atomic<unsigned> targetsSent;
+	std::atomic<unsigned> targetsCoalesced;		// overwritten before they were sent
+	std::atomic<unsigned> targetsFailed;		// sent, but the move failed
+	//Latency of everything the I/O thread does with the device (see 'stats')
+	manipStats stats;
+};
+
+// Function prototypes
+FT_STATUS scanDevices();
+FT_STATUS numberOfDevices(DWORD*);
+FT_STATUS numberOfManips(DWORD*);
+FT_STATUS deviceDescription(DWORD, char*);
+FT_STATUS deviceSerial(DWORD, char*);
+int isManip(DWORD);
+int findDevice(const char*);
+FT_STATUS getHandle(DWORD, manipSession*);
+void closeSession(manipSession*);
+void sessionError(manipSession*, FT_STATUS);
+FT_STATUS where(manipSession*,int,int*,int*,int*);
+FT_STATUS move(manipSession*,int,int,int,int);
+FT_STATUS moveReached(manipSession*,int,int,int,int);
+FT_STATUS driveChange(manipSession*,int);
+FT_STATUS setVelocity(manipSession*,int,int,int,int*);
+FT_STATUS exchange(manipSession*,const char*,DWORD,unsigned char*,DWORD,int,ULONG,int*);
+template<class Command, class Reply> FT_STATUS exchangeFrames(manipSession*,const Command&,Reply&,int,ULONG,int*);
+int replyFramed(const unsigned char*,DWORD,int);
+int realignPosition(manipTransport*,positionReply*,int);
+ULONG replyTimeout(manipSession*);
+ULONG moveTimeout(manipSession*,int,int,int,int);
+void rttSample(manipSession*,double);
+void linkSettingsChanged(manipSession*);
+int longestAxis(const int*,int,int,int);
+void drainStale(manipTransport*);
+void manipPrintf(const char*, ...);
+void flushMessages();
+void startWorker(manipSession*);
+void publishManips();
+void stopWorker(manipSession*);
+void submitCommand(manipWorker*, const manipCommand*);
+int driveCommandType(int);
+void fillWindow(manipWorker*);
+void nextCommand(manipWorker*, manipCommand*);
+void waitReply(manipWorker*, manipReply*);
+void callWorker(manipSession*, manipCommand*, manipReply*);
+FT_STATUS workerWhere(manipSession*,int,int*,int*,int*);
+FT_STATUS workerMove(manipSession*,int,int,int,int);
+void queueMove(manipSession*,int,int,int,int,manipReply*);
+void moveAsync(manipSession*,int,int,int,int);
+void moveMany(manipMoveRequest*,int);
+int whereAll(manipPosition*,int);
+void runWhereAll(manipSession*,manipPosition*);
+int waitMove(manipSession*,int);
+FT_STATUS startStream(manipSession*,int,double);
+void stopStream(manipSession*);
+unsigned readStream(manipSession*,manipSample*,unsigned);
+void takeSample(manipWorker*);
+FT_STATUS executePath(manipSession*,int,const int*,int,int);
+void abortPath(manipSession*);
+FT_STATUS runPath(manipWorker*);
+FT_STATUS moveVerified(manipSession*,int,int,int,int,manipVerifiedMove*);
+FT_STATUS runMoveVerified(manipSession*,int,int,int,int,manipVerifiedMove*);
+FT_STATUS moveRelative(manipSession*,int,int,int,int,manipRelativeMove*);
+FT_STATUS runMoveRelative(manipSession*,int,int,int,int,manipRelativeMove*);
+void planSpeed(int,int*,int*);
+FT_STATUS moveAtSpeed(manipSession*,int,int,int,int,manipSpeedMove*);
+FT_STATUS runTimedMove(manipSession*,int,int,int,int,manipSpeedMove*);
+int clampAxis(long long,int*);
+void setTarget(manipSession*,int,int,int,int);
+int sendTarget(manipWorker*);
+FT_STATUS configureLink(manipSession*,const manipLinkSettings*);
+FT_STATUS autotune(manipSession*,int,int,double*);
+FT_STATUS runAutotune(manipSession*,int,int,double*);
+void linkFileName(char*,size_t);
+int linkSettingsValid(const manipLinkSettings*);
+int loadLinkSettings(const char*,manipLinkSettings*);
+void saveLinkSettings(const char*,const manipLinkSettings*);
+void workerMain(manipWorker*);
+manipSession* sessionFor(int);
+
+//Configuration parameters
+static std::mutex coreLock;							// held by initialize/uninitialize/setTransport and enumeration
+static std::atomic<int> initialized(0);				// whether the manips have been initialized
+static std::atomic<int> numHandles(0);				// number of entries in manipSessions[] (read without coreLock by sessionFor)
+static manipSession manipSessions[maxManips];		// Array containing the handle and cached state of each device
+static manipDeviceInfo deviceList[maxDevices];		// What the last scan of the bus found (see scanDevices())
+static DWORD numListed = 0;							// number of entries in deviceList[]
+static int deviceListValid = 0;						// whether deviceList[] has been filled since the last setTransport
+
+//##############################################################################
+//################HOW MANY DEVICES/OF A CERTAIN KIND????########################
+//##############################################################################
+
+// Take a fresh snapshot of the devices on the bus.  Open manipulators keep their numbers;
+// only the device (bus) numbers they map to are updated.
+FT_STATUS scanDevices()
+{
+	FT_STATUS ftStatus;
+
+	ftStatus = transportScan(deviceList, maxDevices, &numListed);
+	if (numListed > maxDevices)
+		numListed = maxDevices;
+	deviceListValid = 1;
+	for (int i=0; i<numHandles; i++) {
+		int found = findDevice(manipSessions[i].serial);
+		if (found >= 0)
+			manipSessions[i].deviceNumber = found;
+	}
+	return ftStatus;
+}
+
+// Return the number of devices connected to the computer (as of the last scan)
+FT_STATUS numberOfDevices(DWORD* numDevs)
+{
+	FT_STATUS ftStatus = FT_OK;	
+
+	if (deviceListValid == 0)
+		ftStatus = scanDevices();
+	*numDevs = numListed;
+	return ftStatus;
+}
+
+FT_STATUS numberOfManips(DWORD* numManips)
+{
+	DWORD numDevs;
+	FT_STATUS ftStatus;
+
+	*numManips = 0;
+	ftStatus = numberOfDevices(&numDevs);
+	for (DWORD i=0;i<numDevs;i++) {
+		if (isManip(i) != 0) {
+			(*numManips)++;
+		}
+	}
+	return ftStatus;
+}
+//##############################################################################
+//######################RETURNS INFO ON DEVICE##################################
+//##############################################################################
+// Return the description (name) of the specified device
+FT_STATUS deviceDescription(DWORD deviceNumber, char* deviceName)
+{
+	DWORD numDevs;
+	FT_STATUS ftStatus = numberOfDevices(&numDevs);	
+
+	if (ftStatus == FT_OK && deviceNumber >= numDevs)
+		ftStatus = FT_DEVICE_NOT_FOUND;
+	if (ftStatus == FT_OK)
+		strcpy(deviceName, deviceList[deviceNumber].description);
+	else {
+		deviceName[0] = 0;
+		manipPrintf("%s('deviceName'): Error getting data to manipulator 1",FUNC_NAME);
+	}
+	return ftStatus;
+}
+
+// Return the serial number of the specified device
+FT_STATUS deviceSerial(DWORD deviceNumber, char* deviceName)
+{
+	DWORD numDevs;
+	FT_STATUS ftStatus = numberOfDevices(&numDevs);	
+
+	if (ftStatus == FT_OK && deviceNumber >= numDevs)
+		ftStatus = FT_DEVICE_NOT_FOUND;
+	if (ftStatus == FT_OK)
+		strcpy(deviceName, deviceList[deviceNumber].serial);
+	else {
+		deviceName[0] = 0;
+		manipPrintf("%s('deviceSerial'): Error getting data to manipulator 2\n",FUNC_NAME);
+	}
+	return ftStatus;
+}
+
+//##############################################################################
+//##################CHECKS TO SEE DEVICE TYPES##################################
+//##############################################################################
+
+// Checks to see if the device is a Manipulator [1 yes, 0 no]
+int isManip(DWORD deviceNumber) 
+{
+	char devDesc[64];
+	devDesc[0] = 0;
+	deviceDescription(deviceNumber,devDesc);
+	// we have a manip
+	if (strcmp(devDesc,"Sutter Instrument ROE-200") == 0)
+    //if (strcmp(devDesc,"Sutter Instrument Lambda SC") == 0)
+		return 1;
+	// the device is not a Manip
+	else
+		return 0;
+}
+
+// Device number of the device with the given serial number [-1 if there isn't one]
+int findDevice(const char *serial)
+{
+	DWORD numDevs;
+	numberOfDevices(&numDevs);
+	for (DWORD i=0; i<numDevs; i++) {
+		if (strcmp(deviceList[i].serial, serial) == 0)
+			return i;
+	}
+	return -1;
+}
+
+//##############################################################################
+//##############################################################################
+//##############################################################################
+
+// Create a handle to the device that allows writing, and start a fresh session for it.
+// 'initialize' runs one of these per device on its own thread, so only manipPrintf here.
+FT_STATUS getHandle(DWORD deviceNumber, manipSession *session)
+{
+	FT_STATUS ftStatus;
+
+	memset(session, 0, sizeof(manipSession));
+	session->deviceNumber = deviceNumber;
+	session->settings.baudRate = 128000;
+	session->settings.latencyTimer = 16;
+	session->settings.usbTransferSize = 64;
+	session->settings.readTimeout = 500;
+	session->settings.writeTimeout = 500;
+
+	//Get the serial number of the device
+	deviceSerial(deviceNumber, session->serial);
+	//Use what configureLink/autotune settled on last time, if anything
+	if (loadLinkSettings(session->serial, &session->settings))
+		manipPrintf("Using saved link settings for %s (latency %u ms, transfer %u bytes)\n", session->serial,
+		          (unsigned)session->settings.latencyTimer, (unsigned)session->settings.usbTransferSize);
+	manipPrintf("Getting handle to device %u (serial %s, %s)\n", deviceNumber, session->serial, transportName(transportSelected()));
+
+	//Open it and set up the channel properly
+	std::chrono::steady_clock::time_point openStart = std::chrono::steady_clock::now();
+	ftStatus = transportOpen(&session->link, session->serial, &session->settings, session->initMs);
+	session->link.traceDevice = (int)deviceNumber;
+	traceRecord((int)deviceNumber, traceOpen, 0, 0, ftStatus, session->serial, (DWORD)strlen(session->serial), openStart);
+	if (ftStatus != FT_OK) {
+		manipPrintf("Couldn't open manipulator %u\n", deviceNumber);
+		session->lastStatus = ftStatus;
+		return ftStatus;
+	}
+
+	//Write 238 (0xEE) to have the controller begin accepting commands
+	wakeCommand wake = encodeWake();
+	DWORD bytesWritten;
+
+	std::chrono::steady_clock::time_point wakeStart = std::chrono::steady_clock::now();
+	ftStatus = transportWrite(&session->link, (const char*)wake.bytes, wakeCommand::size, &bytesWritten);
+	session->initMs[3] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wakeStart).count();
+	if (ftStatus != FT_OK){
+		manipPrintf("%s('getHandle'): Error writing to manipulator %u\n",FUNC_NAME, deviceNumber);
+    }
+    else {
+        manipPrintf("%s Successfully initially written to device.\n",FUNC_NAME);
+    }
+	//We don't know which drive the controller is on until we select one ourselves
+	session->activeDrive = 0;
+	session->lastStatus = ftStatus;
+	return ftStatus;
+}
+
+// Release the handle and forget everything cached about the device
+void closeSession(manipSession *session)
+{
+	transportClose(&session->link);
+	memset(session, 0, sizeof(manipSession));
+}
+
+// Record a failed command.  After an error we can't trust what the controller is doing,
+// so drop the cached drive selection and force the next command to re-select it, and
+// forget where the drives are (a move that timed out may have stopped anywhere) and what
+// speed they were last given.
+void sessionError(manipSession *session, FT_STATUS ftStatus)
+{
+	session->lastStatus = ftStatus;
+	session->activeDrive = 0;
+	memset(session->positionKnown, 0, sizeof(session->positionKnown));
+	memset(session->speedKnown, 0, sizeof(session->speedKnown));
+}
+
+//##############################################################################
+//##############################################################################
+
+
+FT_STATUS where(manipSession* session, int drive, int* xout, int* yout, int* zout) 
+{
+	FT_STATUS ftStatus = FT_OK;
+	manipTransport *link = &session->link;
+	manipStatsTimer timer(link->stats, statWhere, &ftStatus);
+
+	//No unconditional purge here: the reply is read as one exact frame, so the receive
+	//queue only needs flushing when something is actually left over (or after a bad frame)
+	drainStale(link);
+
+	//change the manipulator drive, if needed...
+	ftStatus = driveChange(session, drive);
+	if (ftStatus != FT_OK)
+		return ftStatus;
+
+	//The 'C' command which tells the manipulator to get current position hex: 0x43.  The
+	//whole reply is read in a single transfer (one USB round trip, not thirteen), and comes
+	//back in steps (see manipProtocol.h).
+	positionReply reply;
+	ftStatus = exchangeFrames(session, encodePositionQuery(), reply, drive, replyTimeout(session), NULL);
+	if (ftStatus == FT_OK)
+		decodePosition(reply, xout, yout, zout);
+	if (ftStatus != FT_OK) {
+		manipPrintf("%s('status'): No valid position reply (status %u)\n",FUNC_NAME, (unsigned)ftStatus);
+		sessionError(session, ftStatus);
+		return ftStatus;
+	}
+	session->lastStatus = FT_OK;
+	session->positionKnown[drive] = 1;
+	session->lastPosition[drive][0] = *xout;
+	session->lastPosition[drive][1] = *yout;
+	session->lastPosition[drive][2] = *zout;
+	positionsRecord((int)(session - manipSessions), drive, session->lastPosition[drive]);
+	return ftStatus;
+}
+
+// Flush the receive queue, but only if there is something in it.  FT_GetQueueStatus (or
+// FIONREAD) is answered by the driver without a USB transaction, unlike FT_Purge.
+void drainStale(manipTransport *link)
+{
+	DWORD queued = 0;
+	if (transportQueueStatus(link, &queued) == FT_OK && queued == 0)
+		return;
+	transportPurge(link, FT_PURGE_RX);
+}
+
+FT_STATUS move(manipSession* session, int drive, int x, int y, int z)
+{
+	FT_STATUS ftStatus = FT_OK;
+	manipTransport *link = &session->link;
+	manipStatsTimer timer(link->stats, statMove, &ftStatus);
+
+	//Begin by flushing whatever is left in the receive queue
+	drainStale(link);
+
+	//Change the manipulator drive (if needed...)
+	ftStatus = driveChange(session, drive);
+	if (ftStatus != FT_OK)
+		return ftStatus;
+
+	//The 'M' command which tells the manipulator to move, damnit. hex: 0x4D
+	moveCommand command = encodeMove(x, y, z);
+
+	//The controller sends its carriage return once the move is over, so wait for as long
+	//as the move should take rather than the reply timeout
+	int known = session->positionKnown[drive];
+	int steps = known ? longestAxis(session->lastPosition[drive], x, y, z) : 0;
+	moveReply reply;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	FT_STATUS replied = exchangeFrames(session, command, reply, 0, moveTimeout(session, drive, x, y, z), NULL);
+	ftStatus = replied;
+	if (replied == FT_IO_ERROR)
+		ftStatus = moveReached(session, drive, x, y, z);
+	if (ftStatus != FT_OK) {
+		manipPrintf("%s('changePosition'): No reply to move (status %u)\n",FUNC_NAME, (unsigned)ftStatus);
+		if (replied == FT_IO_ERROR)
+			statsError(link->stats, errGaveUp);
+		sessionError(session, ftStatus);
+		return ftStatus;
+	}
+	//Learn how fast the drive goes from clean, long enough moves (at the speed it powered up
+	//with: once it has been sent one, moveTimeout() works from that)
+	if (known && replied == FT_OK && steps >= minLearnSteps && !session->speedKnown[drive]) {
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() - session->rttMs;
+		double sample = (ms > 0 ? ms : 0) / steps;
+		session->msPerStep = session->msPerStep > 0 ? 0.75*session->msPerStep + 0.25*sample : sample;
+	}
+	session->lastStatus = FT_OK;
+	session->positionKnown[drive] = 1;
+	session->lastPosition[drive][0] = x;
+	session->lastPosition[drive][1] = y;
+	session->lastPosition[drive][2] = z;
+	positionsRecord((int)(session - manipSessions), drive, session->lastPosition[drive]);
+	return ftStatus;
+}
+
+// After an 'M' whose CR was late or misframed: whether the drive got to (x,y,z) anyway.  The
+// controller answers the 'C' once the move is over, behind the late CR (which drainStale()
+// or realignPosition() steps over); a drive still going after where()'s retries, or one that
+// stopped somewhere else, leaves the move failed.
+FT_STATUS moveReached(manipSession* session, int drive, int x, int y, int z)
+{
+	int at[3];
+	FT_STATUS ftStatus = where(session, drive, &at[0], &at[1], &at[2]);
+	if (ftStatus == FT_OK && (at[0] != x || at[1] != y || at[2] != z))
+		ftStatus = FT_IO_ERROR;
+	return ftStatus;
+}
+
+// Select the drive the following command applies to.  The controller remembers the
+// selection, so the 'I' round trip is only sent when the drive actually changes.
+FT_STATUS driveChange(manipSession* session, int drive)
+{
+	FT_STATUS ftStatus;
+	manipTransport *link = &session->link;
+
+	if (drive < 1 || drive > maxDrives) {
+		manipPrintf("%s('status'): Error reading response.  Drive value is incorrect in FT_STATUS_where\n",FUNC_NAME);
+		return FT_INVALID_PARAMETER;
+	}
+	if (session->activeDrive == drive) {
+		return FT_OK;
+	}
+	//Only actual switches are timed
+	ftStatus = FT_OK;
+	manipStatsTimer timer(link->stats, statDriveChange, &ftStatus);
+
+	//Begin by flushing anything left in the receive queue
+	drainStale(link);
+
+	//Change the drive, and read out the carriage return from the manip
+	driveReply reply;
+	ftStatus = exchangeFrames(session, encodeDriveChange(drive), reply, 0, replyTimeout(session), NULL);
+	if (ftStatus != FT_OK) {
+		manipPrintf("%s('status'): No reply to drive change (status %u)\n",FUNC_NAME, (unsigned)ftStatus);
+		sessionError(session, ftStatus);
+		return ftStatus;
+	}
+	session->activeDrive = drive;
+	return ftStatus;
+}
+
+// Give drive a new speed (um/s) and resolution.  Like the drive selection, the controller
+// keeps it, so the 'V' round trip is only sent when it differs from the last one sent; sent
+// (may be NULL) gets 1 if it was.
+FT_STATUS setVelocity(manipSession *session, int drive, int speed, int fine, int *sent)
+{
+	FT_STATUS ftStatus;
+
+	if (sent != NULL)
+		*sent = 0;
+	fine = fine != 0;
+	if (session->speedKnown[drive] && session->speed[drive] == speed && session->fine[drive] == fine)
+		return FT_OK;
+	ftStatus = driveChange(session, drive);
+	if (ftStatus != FT_OK)
+		return ftStatus;
+	drainStale(&session->link);
+	velocityReply reply;
+	ftStatus = exchangeFrames(session, encodeVelocity(speed, fine), reply, 0, replyTimeout(session), NULL);
+	if (ftStatus != FT_OK) {
+		manipPrintf("%s('changePositionAtSpeed'): No reply to velocity change (status %u)\n",FUNC_NAME, (unsigned)ftStatus);
+		sessionError(session, ftStatus);
+		return ftStatus;
+	}
+	if (sent != NULL)
+		*sent = 1;
+	session->speedKnown[drive] = 1;
+	session->speed[drive] = speed;
+	session->fine[drive] = fine;
+	return ftStatus;
+}
+
+//##############################################################################
+//#####################REPLIES AND TIMEOUTS#####################################
+//##############################################################################
+
+// Send a command and read its reply of replyLength bytes.  Every reply ends in a carriage
+// return, and a 'C' reply (positionReply) starts with the drive number.  A reply
+// that doesn't arrive in timeoutMs, or is misframed, is counted; the receive queue is then
+// flushed and the command sent again, up to maxReplyRetries times.  A 'C' reply that is only
+// pushed back by stray bytes is realigned in place instead.  A late 'C' or 'I' doubles the
+// timeout for the next try.  An 'M' is never sent again: if the drive is still going, the
+// first move's CR would answer the second and the second's would misframe whatever came
+// next, so move() asks where the drive got to instead.  attempts (may be NULL) gets the
+// number of times the command was sent.
+FT_STATUS exchange(manipSession *session, const char *command, DWORD commandLength, unsigned char *reply, DWORD replyLength, int drive, ULONG timeoutMs, int *attempts)
+{
+	manipTransport *link = &session->link;
+	FT_STATUS ftStatus = FT_OK;
+	int isMove = ((unsigned char)command[0] == protoMove);			//an 'M' reply waits for the move, so it isn't a round trip
+
+	for (int attempt=0; ; attempt++) {
+		if (attempts != NULL)
+			*attempts = attempt + 1;
+		if (attempt > 0)
+			statsError(link->stats, errRetry);
+		DWORD bytesWritten = 0, received = 0;
+		std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+		ftStatus = transportWrite(link, command, commandLength, &bytesWritten);
+		if (ftStatus == FT_OK)
+			ftStatus = transportSetReadTimeout(link, timeoutMs);
+		if (ftStatus == FT_OK)
+			ftStatus = transportRead(link, reply, replyLength, &received);
+		//The driver itself failing isn't something sending again will fix
+		if (ftStatus != FT_OK)
+			break;
+		if (received == replyLength && replyFramed(reply, replyLength, drive)) {
+			if (!isMove)
+				rttSample(session, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+			return FT_OK;
+		}
+		ftStatus = FT_IO_ERROR;
+		if (received < replyLength) {
+			statsError(link->stats, errTimeout);
+		}
+		else {
+			statsError(link->stats, errBadFrame);
+			if (replyLength == positionReply::size && realignPosition(link, (positionReply*)reply, drive)) {
+				statsError(link->stats, errResync);
+				return FT_OK;
+			}
+		}
+		//Whatever is in the receive queue now belongs to no command of ours
+		transportPurge(link, FT_PURGE_RX);
+		statsError(link->stats, errResync);
+		//move() counts a move as given up on only if the drive didn't get there either
+		if (isMove)
+			return ftStatus;
+		if (attempt >= maxReplyRetries)
+			break;
+		//A reply that was merely slow gets longer next time; if the link really has slowed
+		//down, the round trips timed from then on raise replyTimeout() itself
+		if (received < replyLength)
+			timeoutMs = timeoutMs*2 < session->settings.readTimeout ? timeoutMs*2 : session->settings.readTimeout;
+	}
+	statsError(link->stats, errGaveUp);
+	return ftStatus;
+}
+
+// exchange() with frames from manipProtocol.h, which carry their own lengths
+template<class Command, class Reply>
+FT_STATUS exchangeFrames(manipSession *session, const Command &command, Reply &reply, int drive, ULONG timeoutMs, int *attempts)
+{
+	return exchange(session, (const char*)command.bytes, Command::size, reply.bytes, Reply::size, drive, timeoutMs, attempts);
+}
+
+// Whether a whole reply is framed as expected (drive: see exchange())
+int replyFramed(const unsigned char *reply, DWORD replyLength, int drive)
+{
+	if (replyLength == positionReply::size)
+		return positionFramed(*(const positionReply*)reply, drive);
+	return reply[replyLength-1] == protocolCR;
+}
+
+// A 'C' reply with stray carriage returns in front of it (from a reply that came too late)
+// starts with the drive number further in, and the rest of it is already in the receive
+// queue.  Shift the frame down and read the rest; 1 if that gives a good frame.  Never
+// waits: anything else is left to a flush and a fresh command.
+int realignPosition(manipTransport *link, positionReply *reply, int drive)
+{
+	unsigned char *bytes = reply->bytes;
+	int offset = 0;
+	while (offset < positionReply::size && bytes[offset] == protocolCR)
+		offset++;
+	DWORD queued = 0, received = 0;
+	if (offset == 0 || offset == positionReply::size || bytes[offset] != drive ||
+	    transportQueueStatus(link, &queued) != FT_OK || queued < (DWORD)offset)
+		return 0;
+	memmove(bytes, bytes + offset, positionReply::size - offset);
+	return transportRead(link, bytes + positionReply::size - offset, offset, &received) == FT_OK &&
+	       received == (DWORD)offset && positionFramed(*reply, drive);
+}
+
+// How long to wait for a 'C' or 'I' reply: the smoothed round trip plus four times its
+// deviation (as TCP does), no less than the latency timer and no more than the configured
+// read timeout.  Until a few round trips have been timed, the read timeout.
+ULONG replyTimeout(manipSession *session)
+{
+	ULONG limit = session->settings.readTimeout;
+	if (session->rttSamples < minRttSamples)
+		return limit;
+	double ms = session->rttMs + 4*session->rttVarMs + replyMarginMs;
+	double least = session->settings.latencyTimer + replyMarginMs;
+	if (ms < least)
+		ms = least;
+	return ms >= limit ? limit : (ULONG)ceil(ms);
+}
+
+// How long to wait for the end of a move: half as long again as a move that length takes
+// at the speed last sent to the drive (or, if it hasn't been sent one, has taken before),
+// plus a reply timeout, or maxMoveMs if there's nothing to go on.  An estimate isn't capped:
+// a slow move can take minutes, and giving up on it early would send the 'M' again mid-move.
+ULONG moveTimeout(manipSession *session, int drive, int x, int y, int z)
+{
+	double msPerStep = session->speedKnown[drive] ? 1000.0 / ((double)session->speed[drive] * stepsPerUm) : session->msPerStep;
+	if (msPerStep <= 0 || !session->positionKnown[drive])
+		return maxMoveMs;
+	double ms = 1.5 * longestAxis(session->lastPosition[drive], x, y, z) * msPerStep + replyTimeout(session) + 50;
+	return (ULONG)ceil(ms);
+}
+
+void rttSample(manipSession *session, double ms)
+{
+	if (session->rttSamples == 0) {
+		session->rttMs = ms;
+		session->rttVarMs = ms / 2;
+	}
+	else {
+		session->rttVarMs = 0.75*session->rttVarMs + 0.25*fabs(ms - session->rttMs);
+		session->rttMs = 0.875*session->rttMs + 0.125*ms;
+	}
+	session->rttSamples++;
+	if (session->link.stats != NULL) {
+		session->link.stats->roundTripUs.store((unsigned)(session->rttMs * 1000), std::memory_order_relaxed);
+		session->link.stats->replyTimeoutUs.store((unsigned)replyTimeout(session) * 1000, std::memory_order_relaxed);
+	}
+}
+
+// New latency timer or transfer size: the round trips measured so far no longer apply
+void linkSettingsChanged(manipSession *session)
+{
+	session->rttSamples = 0;
+	if (session->link.stats != NULL)
+		session->link.stats->replyTimeoutUs.store((unsigned)session->settings.readTimeout * 1000, std::memory_order_relaxed);
+}
+
+// Steps the axis that has furthest to go has to travel
+int longestAxis(const int *from, int x, int y, int z)
+{
+	int longest = abs(x - from[0]);
+	if (abs(y - from[1]) > longest)
+		longest = abs(y - from[1]);
+	if (abs(z - from[2]) > longest)
+		longest = abs(z - from[2]);
+	return longest;
+}
+
+//##############################################################################
+//#####################BACKGROUND I/O THREADS###################################
+//##############################################################################
+
+// Each initialized device gets one thread that does all of its FTDI I/O, so a long move
+// doesn't have to hold up the caller.  manipWhere and manipMove hand their command to
+// that thread and wait for the reply; manipMoveAsync hands it over and returns.
+
+static std::mutex messageLock;
+static char messages[4096];						// output from other threads waiting to be printed
+static size_t messagesLength = 0;
+static void (*messageHandler)(const char*) = NULL;	// where messages go (NULL: stderr)
+static std::thread::id handlerThread;				// the only thread messageHandler is called from
+
+// The handler may only be called from the thread that set it (mexPrintf only works on
+// MATLAB's own thread).  Anything printed from another thread is held here and shown the
+// next time that thread calls in.
+void manipPrintf(const char* format, ...)
+{
+	char line[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	if (messageHandler == NULL) {
+		fputs(line, stderr);
+		return;
+	}
+	if (std::this_thread::get_id() == handlerThread) {
+		messageHandler(line);
+		return;
+	}
+	std::lock_guard<std::mutex> guard(messageLock);
+	size_t length = strlen(line);
+	if (messagesLength + length < sizeof(messages)) {
+		memcpy(&messages[messagesLength], line, length + 1);
+		messagesLength += length;
+	}
+}
+
+void flushMessages()
+{
+	if (messageHandler == NULL || std::this_thread::get_id() != handlerThread)
+		return;
+	std::lock_guard<std::mutex> guard(messageLock);
+	if (messagesLength > 0) {
+		messageHandler(messages);
+		messagesLength = 0;
+	}
+}
+
+void startWorker(manipSession *session)
+{
+	manipWorker *worker = new manipWorker();
+	worker->session = session;
+	worker->head = 0;
+	worker->tail = 0;
+	worker->windowLength = 0;
+	worker->arrivalDrive = 0;
+	worker->lastDrive = 0;
+	worker->movesQueued = 0;
+	worker->movesDone = 0;
+	worker->lastMoveStatus = FT_OK;
+	worker->streaming = 0;
+	worker->stream = NULL;
+	worker->streamHead = 0;
+	worker->streamTail = 0;
+	worker->streamDropped = 0;
+	worker->streamMissed = 0;
+	worker->streamFailed = 0;
+	worker->pathLength = 0;
+	worker->pathCapacity = 0;
+	worker->pathPoints = NULL;
+	worker->pathTimes = NULL;
+	worker->pathPending = 0;
+	worker->pathDone = 0;
+	worker->pathAbort = 0;
+	worker->pathStatus = FT_OK;
+	memset(worker->targetPending, 0, sizeof(worker->targetPending));
+	worker->targetNext = 1;
+	worker->targetBypassed = 0;
+	worker->targetsWaiting = 0;
+	worker->targetsReceived = 0;
+	worker->targetsSent = 0;
+	worker->targetsCoalesced = 0;
+	worker->targetsFailed = 0;
+	statsReset(&worker->stats);
+	session->link.stats = &worker->stats;
+	linkSettingsChanged(session);
+	worker->stats.roundTripUs = 0;
+	session->worker = worker;
+	worker->thread = std::thread(workerMain, worker);
+}
+
+// Let the thread finish what is already queued, then join it
+void stopWorker(manipSession *session)
+{
+	manipWorker *worker = session->worker;
+	if (worker == NULL)
+		return;
+	manipCommand quit = manipCommand();
+	quit.type = cmdQuit;
+	submitCommand(worker, &quit);
+	worker->thread.join();
+	session->link.stats = NULL;
+	delete[] worker->stream;
+	delete[] worker->pathPoints;
+	delete[] worker->pathTimes;
+	delete worker;
+	session->worker = NULL;
+}
+
+// Queue a command for the I/O thread
+void submitCommand(manipWorker *worker, const manipCommand *command)
+{
+	std::lock_guard<std::mutex> caller(worker->callerLock);
+	unsigned tail = worker->tail.load(std::memory_order_relaxed);
+	//The queue only fills up if callers get commandQueueSize moves ahead of the device
+	while (tail - worker->head.load(std::memory_order_acquire) >= commandQueueSize) {
+		std::unique_lock<std::mutex> lock(worker->wakeLock);
+		worker->finished.wait_for(lock, std::chrono::milliseconds(10));
+	}
+	manipCommand *slot = &worker->queue[tail & (commandQueueSize-1)];
+	*slot = *command;
+	slot->queued = std::chrono::steady_clock::now();
+	worker->tail.store(tail + 1, std::memory_order_release);
+	//Taking the lock before notifying means the thread can't miss the wake-up between
+	//finding the queue empty and going to sleep
+	{
+		std::lock_guard<std::mutex> guard(worker->wakeLock);
+	}
+	worker->wake.notify_one();
+}
+
+void waitReply(manipWorker *worker, manipReply *reply)
+{
+	std::unique_lock<std::mutex> lock(worker->wakeLock);
+	worker->finished.wait(lock, [reply]{ return reply->done.load() != 0; });
+}
+
+// Run a command on the device's I/O thread and wait for it to finish
+void callWorker(manipSession *session, manipCommand *command, manipReply *reply)
+{
+	reply->done = 0;
+	command->reply = reply;
+	submitCommand(session->worker, command);
+	waitReply(session->worker, reply);
+	flushMessages();
+}
+
+// Synchronous position query, run on the device's I/O thread
+FT_STATUS workerWhere(manipSession *session, int drive, int* xout, int* yout, int* zout)
+{
+	manipReply reply;
+	manipCommand command;
+	command.type = cmdWhere;
+	command.drive = drive;
+	command.x = command.y = command.z = 0;
+	callWorker(session, &command, &reply);
+	*xout = reply.x;
+	*yout = reply.y;
+	*zout = reply.z;
+	return reply.status;
+}
+
+// Synchronous move, run on the device's I/O thread (after anything already queued)
+FT_STATUS workerMove(manipSession *session, int drive, int x, int y, int z)
+{
+	manipReply reply;
+	reply.done = 0;
+	queueMove(session, drive, x, y, z, &reply);
+	waitReply(session->worker, &reply);
+	flushMessages();
+	return reply.status;
+}
+
+// Hand a move to the device's I/O thread.  reply may be NULL if nobody is waiting for it.
+void queueMove(manipSession *session, int drive, int x, int y, int z, manipReply *reply)
+{
+	manipCommand command;
+	command.type = cmdMove;
+	command.drive = drive;
+	command.x = x;
+	command.y = y;
+	command.z = z;
+	command.reply = reply;
+	session->worker->movesQueued++;
+	submitCommand(session->worker, &command);
+}
+
+// Queue a move and return straight away.  Use waitMove()/isMoving to find out when it's done.
+void moveAsync(manipSession *session, int drive, int x, int y, int z)
+{
+	queueMove(session, drive, x, y, z, NULL);
+}
+
+// Run a list of moves.  Every move is queued before any is waited on, so each device works
+// through its own moves while the others do the same; the total time is that of the busiest
+// device, not the sum.  Moves that fail validation aren't sent and get FT_INVALID_PARAMETER.
+// Each move's elapsed is the time in seconds from the start of the call to its completion.
+void moveMany(manipMoveRequest *moves, int numMoves)
+{
+	manipReply *replies = new manipReply[numMoves];
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (int i=0; i<numMoves; i++) {
+		const manipMoveRequest *request = &moves[i];
+		replies[i].done = 0;
+		if (sessionFor(request->manip) == NULL || request->drive < 1 || request->drive > maxDrives ||
+		    request->x < 0 || request->x > maxSteps || request->y < 0 || request->y > maxSteps ||
+		    request->z < 0 || request->z > maxSteps) {
+			manipPrintf("Error.  Row %d of 'moveMany' is out of range and was skipped.\n", i+1);
+			replies[i].status = FT_INVALID_PARAMETER;
+			replies[i].completed = start;
+			replies[i].done = 1;
+			continue;
+		}
+		queueMove(&manipSessions[request->manip], request->drive, request->x, request->y, request->z, &replies[i]);
+	}
+	for (int i=0; i<numMoves; i++) {
+		if (replies[i].done.load() == 0)
+			waitReply(manipSessions[moves[i].manip].worker, &replies[i]);
+		moves[i].status = replies[i].status;
+		moves[i].elapsed = std::chrono::duration<double>(replies[i].completed - start).count();
+	}
+	delete[] replies;
+	flushMessages();
+}
+
+// Read every drive of every manipulator into positions (room for numHandles*maxDrives rows,
+// ordered by manipulator then drive).  One command per device is queued before any reply is
+// waited for, so the devices' USB round trips overlap; each device's I/O thread reads its
+// drives starting with the one already selected, so it switches drives at most once.
+// Returns the number of rows filled.
+int whereAll(manipPosition *positions, int maxRows)
+{
+	manipReply replies[maxManips];
+	int numDevices = numHandles;
+	if (numDevices*maxDrives > maxRows)
+		numDevices = maxRows / maxDrives;
+
+	for (int i=0; i<numDevices; i++) {
+		manipCommand command;
+		command.type = cmdWhereAll;
+		command.drive = 0;
+		command.x = command.y = command.z = 0;
+		command.reply = &replies[i];
+		command.data = &positions[i*maxDrives];
+		replies[i].done = 0;
+		submitCommand(manipSessions[i].worker, &command);
+	}
+	for (int i=0; i<numDevices; i++)
+		waitReply(manipSessions[i].worker, &replies[i]);
+	flushMessages();
+	return numDevices*maxDrives;
+}
+
+// Query each drive in turn, the selected one first (I/O thread only)
+void runWhereAll(manipSession *session, manipPosition *positions)
+{
+	int first = (session->activeDrive >= 1 && session->activeDrive <= maxDrives) ? session->activeDrive : 1;
+	for (int k=0; k<maxDrives; k++) {
+		int drive = (first - 1 + k) % maxDrives + 1;
+		manipPosition *position = &positions[drive-1];
+		position->manip = (int)(session - manipSessions);
+		position->drive = drive;
+		position->x = position->y = position->z = 0;
+		position->status = where(session, drive, &position->x, &position->y, &position->z);
+	}
+}
+
+// Wait up to timeoutMs for every queued move to finish.  Returns 1 if they did, 0 on timeout.
+int waitMove(manipSession *session, int timeoutMs)
+{
+	manipWorker *worker = session->worker;
+	std::unique_lock<std::mutex> lock(worker->wakeLock);
+	int done = worker->finished.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+		[worker]{ return worker->movesDone.load() == worker->movesQueued.load(); });
+	lock.unlock();
+	flushMessages();
+	return done;
+}
+
+// Start (or retarget) a stream of position samples from one drive at rateHz.  Samples that
+// haven't been read yet are thrown away, so the stream's timestamps always start at zero.
+FT_STATUS startStream(manipSession *session, int drive, double rateHz)
+{
+	manipWorker *worker = session->worker;
+	if (drive < 1 || drive > maxDrives || !(rateHz > 0))
+		return FT_INVALID_PARAMETER;
+	if (worker->stream == NULL)
+		worker->stream = new manipSample[streamBufferSize];
+	worker->streamDropped = 0;
+	worker->streamMissed = 0;
+	worker->streamFailed = 0;
+
+	manipReply reply;
+	manipCommand command;
+	command.type = cmdStartStream;
+	command.drive = drive;
+	command.x = (int)(1e6 / rateHz);			// period in microseconds
+	command.y = command.z = 0;
+	callWorker(session, &command, &reply);
+	//The thread reports where the ring stood when the new stream began; skip up to there
+	worker->streamHead.store((unsigned)reply.x, std::memory_order_release);
+	return reply.status;
+}
+
+void stopStream(manipSession *session)
+{
+	manipReply reply;
+	manipCommand command;
+	command.type = cmdStopStream;
+	command.drive = 0;
+	command.x = command.y = command.z = 0;
+	callWorker(session, &command, &reply);
+}
+
+// Copy up to maxSamples samples out of the stream.  Returns the number of samples copied.
+unsigned readStream(manipSession *session, manipSample *out, unsigned maxSamples)
+{
+	manipWorker *worker = session->worker;
+	if (worker->stream == NULL)
+		return 0;
+	std::lock_guard<std::mutex> caller(worker->callerLock);
+	unsigned head = worker->streamHead.load(std::memory_order_relaxed);
+	unsigned available = worker->streamTail.load(std::memory_order_acquire) - head;
+	if (available > maxSamples)
+		available = maxSamples;
+	for (unsigned i=0; i<available; i++)
+		out[i] = worker->stream[(head + i) & (streamBufferSize-1)];
+	worker->streamHead.store(head + available, std::memory_order_release);
+	return available;
+}
+
+// Take one stream sample (I/O thread only)
+void takeSample(manipWorker *worker)
+{
+	int x, y, z;
+	std::chrono::steady_clock::time_point now;
+
+	if (where(worker->session, worker->streamDrive, &x, &y, &z) != FT_OK) {
+		worker->streamFailed++;
+	}
+	else {
+		now = std::chrono::steady_clock::now();
+		unsigned tail = worker->streamTail.load(std::memory_order_relaxed);
+		if (tail - worker->streamHead.load(std::memory_order_acquire) >= streamBufferSize) {
+			worker->streamDropped++;
+		}
+		else {
+			manipSample *sample = &worker->stream[tail & (streamBufferSize-1)];
+			sample->t = std::chrono::duration<double>(now - worker->streamStart).count();
+			sample->x = x;
+			sample->y = y;
+			sample->z = z;
+			worker->streamTail.store(tail + 1, std::memory_order_release);
+		}
+	}
+	//Keep to the original schedule; if we've fallen behind, count the sample times we skipped
+	now = std::chrono::steady_clock::now();
+	worker->nextSample += worker->streamPeriod;
+	while (worker->nextSample <= now) {
+		worker->nextSample += worker->streamPeriod;
+		worker->streamMissed++;
+	}
+}
+
+// Upload numPoints x,y,z waypoints and start running them on the I/O thread.  Every point
+// is checked before anything moves.  Returns straight away; the path counts as one move for
+// isMoving/waitMove, and pathStatus reports how far it has got.
+FT_STATUS executePath(manipSession *session, int drive, const int *waypoints, int numPoints, int dwellMs)
+{
+	manipWorker *worker = session->worker;
+	std::unique_lock<std::mutex> caller(worker->callerLock);
+	if (worker->pathPending.load() != 0) {
+		manipPrintf("Error. A path is already running on this device.  Use 'abortPath' or 'waitMove' first.\n");
+		return FT_DEVICE_NOT_OPENED;
+	}
+	if (drive < 1 || drive > maxDrives || numPoints < 1 || dwellMs < 0) {
+		manipPrintf("Error. 'executePath' needs a drive number from 1 to %d, at least one waypoint and a dwell >= 0\n", maxDrives);
+		return FT_INVALID_PARAMETER;
+	}
+	for (int i=0; i<numPoints; i++) {
+		for (int k=0; k<3; k++) {
+			int value = waypoints[3*i + k];
+			if (value < 0 || value > maxSteps) {
+				manipPrintf("Error.  Waypoint %d of 'executePath' is out of valid range!  0 <= x,y,z <=400e3.  Nothing was moved.\n", i+1);
+				return FT_INVALID_PARAMETER;
+			}
+		}
+	}
+
+	if (numPoints > worker->pathCapacity) {
+		delete[] worker->pathPoints;
+		delete[] worker->pathTimes;
+		worker->pathPoints = new int[3*numPoints];
+		worker->pathTimes = new double[numPoints];
+		worker->pathCapacity = numPoints;
+	}
+	memcpy(worker->pathPoints, waypoints, 3*numPoints*sizeof(int));
+	worker->pathDrive = drive;
+	worker->pathLength = numPoints;
+	worker->pathDwellMs = dwellMs;
+	worker->pathDone = 0;
+	worker->pathAbort = 0;
+	worker->pathStatus = FT_OK;
+	worker->pathPending = 1;
+	caller.unlock();
+
+	manipCommand command;
+	command.type = cmdRunPath;
+	command.drive = drive;
+	command.x = command.y = command.z = 0;
+	command.reply = NULL;
+	worker->movesQueued++;
+	submitCommand(worker, &command);
+	return FT_OK;
+}
+
+// Stop a running path after the waypoint it is on
+void abortPath(manipSession *session)
+{
+	manipWorker *worker = session->worker;
+	worker->pathAbort = 1;
+	{
+		std::lock_guard<std::mutex> guard(worker->wakeLock);
+	}
+	worker->wake.notify_one();
+}
+
+// Send the path's moves back to back (I/O thread only)
+FT_STATUS runPath(manipWorker *worker)
+{
+	FT_STATUS ftStatus = FT_OK;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (int i=0; i<worker->pathLength && worker->pathAbort.load() == 0; i++) {
+		const int *point = &worker->pathPoints[3*i];
+		ftStatus = move(worker->session, worker->pathDrive, point[0], point[1], point[2]);
+		if (ftStatus != FT_OK)
+			break;
+		worker->pathTimes[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		worker->pathDone.store(i + 1, std::memory_order_release);
+		if (worker->pathDwellMs > 0 && i+1 < worker->pathLength) {
+			//abortPath wakes us up early
+			std::unique_lock<std::mutex> lock(worker->wakeLock);
+			worker->wake.wait_for(lock, std::chrono::milliseconds(worker->pathDwellMs),
+				[worker]{ return worker->pathAbort.load() != 0; });
+		}
+	}
+	worker->pathStatus = ftStatus;
+	return ftStatus;
+}
+
+// Move, read the position back, and move again until every axis is within result->tolerance
+// steps of the target, at most result->maxRetries more times and not after timeoutMs.  Runs
+// on the I/O thread so none of the settle loop goes back through the caller; counts as one
+// move for isMoving/waitMove.  FT_IO_ERROR if the drive never got within tolerance.
+FT_STATUS moveVerified(manipSession *session, int drive, int x, int y, int z, manipVerifiedMove *result)
+{
+	manipReply reply;
+	manipCommand command;
+	command.type = cmdMoveVerified;
+	command.drive = drive;
+	command.x = x;
+	command.y = y;
+	command.z = z;
+	command.data = result;
+	session->worker->movesQueued++;
+	callWorker(session, &command, &reply);
+	return reply.status;
+}
+
+// The settle loop itself (I/O thread only)
+FT_STATUS runMoveVerified(manipSession *session, int drive, int x, int y, int z, manipVerifiedMove *result)
+{
+	FT_STATUS ftStatus;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	result->attempts = 0;
+	result->x = result->y = result->z = 0;
+	for (;;) {
+		result->attempts++;
+		ftStatus = move(session, drive, x, y, z);
+		FT_STATUS located = where(session, drive, &result->x, &result->y, &result->z);
+		if (located == FT_OK && abs(result->x - x) <= result->tolerance &&
+		    abs(result->y - y) <= result->tolerance && abs(result->z - z) <= result->tolerance) {
+			ftStatus = FT_OK;
+			break;
+		}
+		if (ftStatus == FT_OK)
+			ftStatus = located;
+		if (ftStatus == FT_OK)
+			ftStatus = FT_IO_ERROR;
+		//A failed move is only sent again once the drive answers where it is: one still under
+		//way would answer the new 'M' with its own CR
+		if (located != FT_OK)
+			break;
+		result->elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (result->attempts > result->maxRetries || result->elapsedMs >= result->timeoutMs)
+			break;
+	}
+	result->elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return ftStatus;
+}
+
+// Move by (dx,dy,dz) steps from where the drive is.  The target is worked out on the I/O
+// thread from the position model, after any moves already queued, so a nudge costs one 'M'
+// and no 'C' unless the model was lost to an error or reconnect.  Counts as a move for
+// isMoving/waitMove.
+FT_STATUS moveRelative(manipSession *session, int drive, int dx, int dy, int dz, manipRelativeMove *result)
+{
+	manipReply reply;
+	manipCommand command;
+	command.type = cmdMoveRelative;
+	command.drive = drive;
+	command.x = dx;
+	command.y = dy;
+	command.z = dz;
+	command.data = result;
+	session->worker->movesQueued++;
+	callWorker(session, &command, &reply);
+	return reply.status;
+}
+
+// Limit one axis of a relative target to the travel range; returns 1 if it had to
+int clampAxis(long long position, int *out)
+{
+	if (position < 0) {
+		*out = 0;
+		return 1;
+	}
+	if (position > maxSteps) {
+		*out = maxSteps;
+		return 1;
+	}
+	*out = (int)position;
+	return 0;
+}
+
+// I/O thread side of moveRelative
+FT_STATUS runMoveRelative(manipSession *session, int drive, int dx, int dy, int dz, manipRelativeMove *result)
+{
+	FT_STATUS ftStatus = FT_OK;
+	int x, y, z;
+
+	result->x = result->y = result->z = 0;
+	result->clamped = 0;
+	result->queried = 0;
+	if (!session->positionKnown[drive]) {
+		result->queried = 1;
+		ftStatus = where(session, drive, &x, &y, &z);
+		if (ftStatus != FT_OK)
+			return ftStatus;
+	}
+	const int *from = session->lastPosition[drive];
+	if (clampAxis((long long)from[0] + dx, &result->x))
+		result->clamped |= 1;
+	if (clampAxis((long long)from[1] + dy, &result->y))
+		result->clamped |= 2;
+	if (clampAxis((long long)from[2] + dz, &result->z))
+		result->clamped |= 4;
+	return move(session, drive, result->x, result->y, result->z);
+}
+
+// The fastest speed (um/s) a move of steps may be made at, and whether at fine resolution.
+// Short moves are slowed down so the stage doesn't overshoot or jolt the tissue; long ones go
+// as fast as the drives will.
+void planSpeed(int steps, int *speed, int *fine)
+{
+	static const int distances[plannerLevels-1] = { 160, 1600, 16000, 80000 };	// 10 um, 100 um, 1 mm, 5 mm
+	static const int speeds[plannerLevels] = { 100, 400, 1500, 2500, 3000 };
+	int level = 0;
+	while (level < plannerLevels-1 && steps > distances[level])
+		level++;
+	*speed = speeds[level];
+	*fine = steps < plannerFineSteps;
+}
+
+// Move at move->speed um/s (0: let planSpeed choose), sending the velocity command first only
+// if the drive was last given a different one, and time the move against the time the speed
+// says it should take.  Counts as a move for isMoving/waitMove.
+FT_STATUS moveAtSpeed(manipSession *session, int drive, int x, int y, int z, manipSpeedMove *result)
+{
+	manipReply reply;
+	manipCommand command;
+	command.type = cmdTimedMove;
+	command.drive = drive;
+	command.x = x;
+	command.y = y;
+	command.z = z;
+	command.data = result;
+	session->worker->movesQueued++;
+	callWorker(session, &command, &reply);
+	return reply.status;
+}
+
+// I/O thread side of moveAtSpeed.  The distance has to be known to plan or predict the
+// move, so the position is read first if the model lost it.
+FT_STATUS runTimedMove(manipSession *session, int drive, int x, int y, int z, manipSpeedMove *result)
+{
+	FT_STATUS ftStatus = FT_OK;
+	int position[3];
+
+	result->speedUsed = result->fineUsed = result->velocitySent = result->queried = 0;
+	result->predictedMs = result->measuredMs = 0;
+	if (!session->positionKnown[drive]) {
+		result->queried = 1;
+		ftStatus = where(session, drive, &position[0], &position[1], &position[2]);
+		if (ftStatus != FT_OK)
+			return ftStatus;
+	}
+	int steps = longestAxis(session->lastPosition[drive], x, y, z);
+	result->speedUsed = result->speed;
+	result->fineUsed = result->fine != 0;
+	if (result->speed <= 0)
+		planSpeed(steps, &result->speedUsed, &result->fineUsed);
+	ftStatus = setVelocity(session, drive, result->speedUsed, result->fineUsed, &result->velocitySent);
+	if (ftStatus != FT_OK)
+		return ftStatus;
+	//Travel at the set speed, plus the 'M' and its reply getting across the link
+	result->predictedMs = 1000.0 * steps / ((double)result->speedUsed * stepsPerUm) + session->rttMs;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ftStatus = move(session, drive, x, y, z);
+	result->measuredMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return ftStatus;
+}
+
+// Make (x,y,z) the drive's newest setpoint and return.  If the previous one hasn't been sent
+// yet it is dropped and counted as coalesced.  A pending target counts as a queued move for
+// isMoving/waitMove.
+void setTarget(manipSession *session, int drive, int x, int y, int z)
+{
+	manipWorker *worker = session->worker;
+	worker->targetsReceived++;
+	{
+		std::lock_guard<std::mutex> guard(worker->targetLock);
+		if (worker->targetPending[drive]) {
+			worker->targetsCoalesced++;
+		}
+		else {
+			worker->targetPending[drive] = 1;
+			worker->movesQueued++;
+			worker->targetsWaiting++;
+		}
+		worker->target[drive][0] = x;
+		worker->target[drive][1] = y;
+		worker->target[drive][2] = z;
+	}
+	{
+		std::lock_guard<std::mutex> guard(worker->wakeLock);
+	}
+	worker->wake.notify_one();
+}
+
+// Send the newest pending target of one drive, if there is one (I/O thread only).  Returns
+// 1 if a move was sent.
+int sendTarget(manipWorker *worker)
+{
+	int drive = 0, x = 0, y = 0, z = 0;
+	{
+		std::lock_guard<std::mutex> guard(worker->targetLock);
+		for (int k=0; k<maxDrives && drive == 0; k++) {
+			int candidate = (worker->targetNext - 1 + k) % maxDrives + 1;
+			if (worker->targetPending[candidate])
+				drive = candidate;
+		}
+		if (drive == 0)
+			return 0;
+		worker->targetPending[drive] = 0;
+		worker->targetsWaiting--;
+		worker->targetNext = drive % maxDrives + 1;
+		worker->targetBypassed = 0;
+		x = worker->target[drive][0];
+		y = worker->target[drive][1];
+		z = worker->target[drive][2];
+	}
+	FT_STATUS ftStatus = move(worker->session, drive, x, y, z);
+	worker->targetsSent++;
+	if (ftStatus != FT_OK)
+		worker->targetsFailed++;
+	{
+		std::lock_guard<std::mutex> guard(worker->wakeLock);
+		worker->lastMoveStatus = ftStatus;
+		worker->movesDone++;
+	}
+	worker->finished.notify_all();
+	return 1;
+}
+
+//##############################################################################
+//#####################LINK SETTINGS############################################
+//##############################################################################
+
+// Apply new serial line settings on the device's I/O thread and remember them for next time
+FT_STATUS configureLink(manipSession *session, const manipLinkSettings *settings)
+{
+	manipLinkSettings requested = *settings;
+	manipReply reply;
+	manipCommand command;
+	command.type = cmdConfigure;
+	command.drive = 0;
+	command.x = command.y = command.z = 0;
+	command.data = &requested;
+	callWorker(session, &command, &reply);
+	if (reply.status == FT_OK)
+		saveLinkSettings(session->serial, &session->settings);
+	return reply.status;
+}
+
+// Try every latency timer / USB transfer size combination, timing samplesPerSetting 'C'
+// queries on drive with each.  results gets one [latency transfer median_ms p99_ms] row per
+// combination (column major, numTuneLatencies*numTuneTransfers rows).  The combination with
+// the lowest median (then the lowest p99) is applied and saved.
+FT_STATUS autotune(manipSession *session, int drive, int samplesPerSetting, double *results)
+{
+	manipReply reply;
+	manipCommand command;
+	command.type = cmdAutotune;
+	command.drive = drive;
+	command.x = samplesPerSetting;
+	command.y = command.z = 0;
+	command.data = results;
+	callWorker(session, &command, &reply);
+	if (reply.status == FT_OK)
+		saveLinkSettings(session->serial, &session->settings);
+	return reply.status;
+}
+
+// The sweep itself (I/O thread only)
+FT_STATUS runAutotune(manipSession *session, int drive, int samplesPerSetting, double *results)
+{
+	static const UCHAR latencies[numTuneLatencies] = { 1, 2, 4, 8, 16 };
+	static const ULONG transfers[numTuneTransfers] = { 64, 128, 256, 512 };
+	const int numRows = numTuneLatencies*numTuneTransfers;
+	manipLinkSettings original = session->settings;
+	manipLinkSettings best = original;
+	double bestMedian = 0, bestP99 = 0;
+	int found = 0;
+	double *times = new double[samplesPerSetting];
+
+	for (int row=0; row<numRows; row++) {
+		manipLinkSettings trial = original;
+		trial.latencyTimer = latencies[row / numTuneTransfers];
+		trial.usbTransferSize = transfers[row % numTuneTransfers];
+		results[row] = trial.latencyTimer;
+		results[row + numRows] = trial.usbTransferSize;
+		results[row + 2*numRows] = NAN;
+		results[row + 3*numRows] = NAN;
+		if (transportConfigure(&session->link, &trial) != FT_OK)
+			continue;
+		session->settings = trial;
+		linkSettingsChanged(session);
+
+		int x, y, z, good = 0;
+		where(session, drive, &x, &y, &z);		//settle the drive selection before timing
+		for (int i=0; i<samplesPerSetting; i++) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (where(session, drive, &x, &y, &z) != FT_OK)
+				continue;
+			times[good++] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		//A setting that loses replies doesn't count, however fast the rest were
+		if (good < samplesPerSetting)
+			continue;
+		std::sort(times, times + good);
+		double median = times[good/2];
+		double p99 = times[(int)ceil(0.99*good) - 1];
+		results[row + 2*numRows] = median;
+		results[row + 3*numRows] = p99;
+		if (!found || median < bestMedian || (median == bestMedian && p99 < bestP99)) {
+			best = trial;
+			bestMedian = median;
+			bestP99 = p99;
+			found = 1;
+		}
+	}
+	delete[] times;
+
+	FT_STATUS ftStatus = transportConfigure(&session->link, &best);
+	session->settings = best;
+	linkSettingsChanged(session);
+	if (ftStatus == FT_OK && !found)
+		ftStatus = FT_IO_ERROR;
+	return ftStatus;
+}
+
+// Where configureLink/autotune results are kept: $MANIPCONTROL_LINKFILE if set, otherwise a
+// file in the user's home (APPDATA on Windows)
+void linkFileName(char *fileName, size_t length)
+{
+	const char *path = getenv("MANIPCONTROL_LINKFILE");
+	if (path != NULL && path[0] != 0) {
+		snprintf(fileName, length, "%s", path);
+		return;
+	}
+#ifdef _WIN32
+	path = getenv("APPDATA");
+	snprintf(fileName, length, "%s\\manipControl_links.txt", path != NULL ? path : ".");
+#else
+	path = getenv("HOME");
+	snprintf(fileName, length, "%s/.manipControl_links", path != NULL ? path : ".");
+#endif
+}
+
+// Whether settings can be applied: a baud rate of 0 hangs up the line, and a read timeout
+// of 0 leaves no time for any reply
+int linkSettingsValid(const manipLinkSettings *settings)
+{
+	return settings->baudRate >= minBaudRate && settings->latencyTimer >= 1 &&
+	       settings->usbTransferSize >= 64 && settings->usbTransferSize <= 65536 &&
+	       settings->readTimeout >= minLinkTimeoutMs && settings->writeTimeout >= minLinkTimeoutMs;
+}
+
+// One line per device: serial baudRate latencyTimer usbTransferSize readTimeout writeTimeout.
+// A line with settings that can't be applied (from an older version) is ignored.
+int loadLinkSettings(const char *serial, manipLinkSettings *settings)
+{
+	char fileName[512];
+	char line[256];
+	int found = 0;
+	linkFileName(fileName, sizeof(fileName));
+	FILE *file = fopen(fileName, "r");
+	if (file == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char lineSerial[64];
+		unsigned baud, latency, transfer, readTimeout, writeTimeout;
+		if (sscanf(line, "%63s %u %u %u %u %u", lineSerial, &baud, &latency, &transfer, &readTimeout, &writeTimeout) == 6 &&
+		    strcmp(lineSerial, serial) == 0 && latency <= 255) {
+			manipLinkSettings saved;
+			saved.baudRate = baud;
+			saved.latencyTimer = (UCHAR)latency;
+			saved.usbTransferSize = transfer;
+			saved.readTimeout = readTimeout;
+			saved.writeTimeout = writeTimeout;
+			if (linkSettingsValid(&saved)) {
+				*settings = saved;
+				found = 1;
+			}
+		}
+	}
+	fclose(file);
+	return found;
+}
+
+// Rewrite the file with this device's line replaced
+void saveLinkSettings(const char *serial, const manipLinkSettings *settings)
+{
+	char fileName[512];
+	char tempName[520];
+	char line[256];
+	linkFileName(fileName, sizeof(fileName));
+	snprintf(tempName, sizeof(tempName), "%s.tmp", fileName);
+	FILE *out = fopen(tempName, "w");
+	if (out == NULL) {
+		manipPrintf("%s: Couldn't save link settings to %s\n", FUNC_NAME, fileName);
+		return;
+	}
+	FILE *in = fopen(fileName, "r");
+	if (in != NULL) {
+		while (fgets(line, sizeof(line), in) != NULL) {
+			char lineSerial[64];
+			if (sscanf(line, "%63s", lineSerial) == 1 && strcmp(lineSerial, serial) == 0)
+				continue;
+			fputs(line, out);
+		}
+		fclose(in);
+	}
+	fprintf(out, "%s %u %u %u %u %u\n", serial, (unsigned)settings->baudRate, (unsigned)settings->latencyTimer,
+	        (unsigned)settings->usbTransferSize, (unsigned)settings->readTimeout, (unsigned)settings->writeTimeout);
+	fclose(out);
+	remove(fileName);
+	rename(tempName, fileName);
+}
+
+// Whether a command works on one drive only, so that it may be run ahead of or after the
+// other drive's commands (where, move, moveVerified, moveRelative, moveAtSpeed)
+int driveCommandType(int type)
+{
+	return type == cmdWhere || type == cmdMove || type == cmdMoveVerified || type == cmdMoveRelative || type == cmdTimedMove;
+}
+
+// Move whatever has been queued from the ring into the scheduler window, as far as there is
+// room (I/O thread only)
+void fillWindow(manipWorker *worker)
+{
+	unsigned head = worker->head.load(std::memory_order_relaxed);
+	unsigned tail = worker->tail.load(std::memory_order_acquire);
+	while (head != tail && worker->windowLength < schedulerWindow) {
+		manipCommand *command = &worker->window[worker->windowLength++];
+		*command = worker->queue[head & (commandQueueSize-1)];
+		command->bypassed = 0;
+		head++;
+		if (driveCommandType(command->type)) {
+			statsSchedule(&worker->stats, schedRequests);
+			if (worker->arrivalDrive != 0 && command->drive != worker->arrivalDrive)
+				statsSchedule(&worker->stats, schedArrivalSwitches);
+			worker->arrivalDrive = command->drive;
+		}
+	}
+	worker->head.store(head, std::memory_order_release);
+}
+
+// Take the next command to run out of the window (I/O thread only).  A drive's commands
+// always run in the order they were queued, and nothing is run ahead of a command that
+// isn't for one drive (configure, streams, paths, quit, ...).  Up to there, the oldest
+// command for the drive already selected goes first, saving the 'I' round trips of
+// switching away and back, unless the oldest command of all has already been overtaken
+// maxBypass times.  With the window empty, this is the order commands were queued in.
+void nextCommand(manipWorker *worker, manipCommand *command)
+{
+	manipCommand *window = worker->window;
+	int active = worker->session->activeDrive;
+	int pick = 0;
+	if (driveCommandType(window[0].type) && window[0].drive != active) {
+		for (int i=1; i<worker->windowLength && driveCommandType(window[i].type); i++) {
+			if (window[i].drive == active) {
+				pick = i;
+				break;
+			}
+		}
+		if (pick > 0 && window[0].bypassed >= maxBypass) {
+			statsSchedule(&worker->stats, schedForced);
+			pick = 0;
+		}
+	}
+	if (pick > 0) {
+		for (int i=0; i<pick; i++)
+			window[i].bypassed++;
+		statsSchedule(&worker->stats, schedReordered);
+	}
+	*command = window[pick];
+	worker->windowLength--;
+	for (int i=pick; i<worker->windowLength; i++)
+		window[i] = window[i+1];
+	if (driveCommandType(command->type)) {
+		if (worker->lastDrive != 0 && command->drive != worker->lastDrive)
+			statsSchedule(&worker->stats, schedSwitches);
+		worker->lastDrive = command->drive;
+	}
+}
+
+void workerMain(manipWorker *worker)
+{
+	manipSession *session = worker->session;
+	for (;;) {
+		fillWindow(worker);
+		if (worker->windowLength == 0) {
+			//Nothing queued: send the newest setpoint if there is one, take a stream sample if
+			//one is due, otherwise sleep until the next command, setpoint (or sample)
+			unsigned head = worker->head.load(std::memory_order_relaxed);
+			if (worker->targetsWaiting.load() > 0 && sendTarget(worker))
+				continue;
+			if (worker->streaming && std::chrono::steady_clock::now() >= worker->nextSample) {
+				takeSample(worker);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(worker->wakeLock);
+			if (worker->streaming)
+				worker->wake.wait_until(lock, worker->nextSample, [worker, head]{ return worker->tail.load() != head || worker->targetsWaiting.load() > 0; });
+			else
+				worker->wake.wait(lock, [worker, head]{ return worker->tail.load() != head || worker->targetsWaiting.load() > 0; });
+			continue;
+		}
+		//Commands are waiting, but a target has waited through enough of them
+		if (worker->targetsWaiting.load() > 0) {
+			if (worker->targetBypassed >= maxTargetBypass && sendTarget(worker))
+				continue;
+			worker->targetBypassed++;
+		}
+		manipCommand command;
+		nextCommand(worker, &command);
+		if (command.type == cmdQuit)
+			break;
+		statsRecord(&worker->stats, statQueueWait, command.queued, FT_OK);
+
+		FT_STATUS ftStatus = FT_OK;
+		int x = command.x, y = command.y, z = command.z;
+		if (command.type == cmdWhere)
+			ftStatus = where(session, command.drive, &x, &y, &z);
+		else if (command.type == cmdMove)
+			ftStatus = move(session, command.drive, x, y, z);
+		else if (command.type == cmdStartStream) {
+			worker->streaming = 1;
+			worker->streamDrive = command.drive;
+			worker->streamPeriod = std::chrono::microseconds(command.x);
+			worker->streamStart = std::chrono::steady_clock::now();
+			worker->nextSample = worker->streamStart;
+			x = (int)worker->streamTail.load(std::memory_order_relaxed);
+		}
+		else if (command.type == cmdStopStream)
+			worker->streaming = 0;
+		else if (command.type == cmdRunPath)
+			ftStatus = runPath(worker);
+		else if (command.type == cmdConfigure) {
+			ftStatus = transportConfigure(&session->link, (const manipLinkSettings*)command.data);
+			if (ftStatus == FT_OK) {
+				session->settings = *(const manipLinkSettings*)command.data;
+				linkSettingsChanged(session);
+			}
+		}
+		else if (command.type == cmdAutotune)
+			ftStatus = runAutotune(session, command.drive, command.x, (double*)command.data);
+		else if (command.type == cmdWhereAll)
+			runWhereAll(session, (manipPosition*)command.data);
+		else if (command.type == cmdMoveVerified)
+			ftStatus = runMoveVerified(session, command.drive, x, y, z, (manipVerifiedMove*)command.data);
+		else if (command.type == cmdMoveRelative)
+			ftStatus = runMoveRelative(session, command.drive, x, y, z, (manipRelativeMove*)command.data);
+		else if (command.type == cmdTimedMove)
+			ftStatus = runTimedMove(session, command.drive, x, y, z, (manipSpeedMove*)command.data);
+
+		{
+			std::lock_guard<std::mutex> guard(worker->wakeLock);
+			if (command.type == cmdMove || command.type == cmdRunPath || command.type == cmdMoveVerified ||
+			    command.type == cmdMoveRelative || command.type == cmdTimedMove) {
+				worker->lastMoveStatus = ftStatus;
+				worker->movesDone++;
+			}
+			if (command.type == cmdRunPath)
+				worker->pathPending = 0;
+			if (command.reply != NULL) {
+				command.reply->status = ftStatus;
+				command.reply->x = x;
+				command.reply->y = y;
+				command.reply->z = z;
+				command.reply->completed = std::chrono::steady_clock::now();
+				command.reply->done = 1;
+			}
+		}
+		worker->finished.notify_all();
+	}
+}
+
+//##############################################################################
+//#####################LIBRARY INTERFACE########################################
+//##############################################################################
+
+// The open session of manipulator number manip [NULL if there isn't one]
+manipSession* sessionFor(int manip)
+{
+	if (manip < 0 || manip >= numHandles)
+		return NULL;
+	return &manipSessions[manip];
+}
+
+int manipApiVersion(void)
+{
+	return MANIP_API_VERSION;
+}
+
+void manipSetMessageHandler(void (*handler)(const char*))
+{
+	std::lock_guard<std::mutex> guard(messageLock);
+	messageHandler = handler;
+	handlerThread = std::this_thread::get_id();
+}
+
+void manipFlushMessages(void)
+{
+	flushMessages();
+}
+
+int manipSetTransport(const char *name, const char *options)
+{
+	std::lock_guard<std::mutex> guard(coreLock);
+	if (initialized == 1)
+		return FT_DEVICE_NOT_OPENED;
+	for (int i=0; i<numTransports; i++) {
+		if (strcmp(name, transportName(i)) != 0)
+			continue;
+		FT_STATUS ftStatus = transportSelect(i, options != NULL ? options : "");
+		//The device list belongs to the old backend
+		deviceListValid = 0;
+		return ftStatus;
+	}
+	return FT_INVALID_PARAMETER;
+}
+
+const char* manipTransportName(void)
+{
+	return transportName(transportSelected());
+}
+
+int manipScan(int *numDevices)
+{
+	std::lock_guard<std::mutex> guard(coreLock);
+	FT_STATUS ftStatus = scanDevices();
+	*numDevices = numListed;
+	return ftStatus;
+}
+
+int manipNumDevices(int *numDevices)
+{
+	std::lock_guard<std::mutex> guard(coreLock);
+	DWORD numDevs = 0;
+	FT_STATUS ftStatus = numberOfDevices(&numDevs);
+	*numDevices = numDevs;
+	return ftStatus;
+}
+
+int manipNumManips(int *numManips)
+{
+	std::lock_guard<std::mutex> guard(coreLock);
+	DWORD count = 0;
+	FT_STATUS ftStatus = numberOfManips(&count);
+	*numManips = count;
+	return ftStatus;
+}
+
+int manipGetDevice(int device, manipDeviceEntry *entry)
+{
+	std::lock_guard<std::mutex> guard(coreLock);
+	DWORD numDevs;
+	FT_STATUS ftStatus = numberOfDevices(&numDevs);
+	memset(entry, 0, sizeof(manipDeviceEntry));
+	if (ftStatus == FT_OK && (device < 0 || (DWORD)device >= numDevs))
+		ftStatus = FT_DEVICE_NOT_FOUND;
+	if (ftStatus != FT_OK)
+		return ftStatus;
+	const manipDeviceInfo *info = &deviceList[device];
+	snprintf(entry->description, sizeof(entry->description), "%s", info->description);
+	snprintf(entry->serial, sizeof(entry->serial), "%s", info->serial);
+	entry->locationId = info->locationId;
+	entry->isOpen = info->isOpen;
+	entry->isManip = isManip(device);
+	return FT_OK;
+}
+
+int manipFindDevice(const char *serial)
+{
+	std::lock_guard<std::mutex> guard(coreLock);
+	return findDevice(serial);
+}
+
+int manipInitialize(const char *const *serials, int numSerials, manipOpenResult *results, int *numTried)
+{
+	if (clientConnected()) {
+		*numTried = 0;
+		return FT_DEVICE_NOT_OPENED;
+	}
+	std::lock_guard<std::mutex> guard(coreLock);
+	DWORD numDevs;
+	int chosen[maxManips];
+	int numChosen = 0;
+
+	*numTried = 0;
+	if (initialized == 1)
+		return FT_DEVICE_NOT_OPENED;
+	numberOfDevices(&numDevs);
+
+	if (serials != NULL) {
+		//the devices asked for, in the order asked for
+		if (numSerials > maxManips) {
+			manipPrintf("Error. At most %d manipulators can be initialized\n", maxManips);
+			return FT_INVALID_PARAMETER;
+		}
+		for (int i=0; i<numSerials; i++) {
+			if ((chosen[numChosen++] = findDevice(serials[i])) < 0) {
+				manipPrintf("Error. No device with serial number '%s' (try 'rescan')\n", serials[i]);
+				return FT_DEVICE_NOT_FOUND;
+			}
+		}
+	}
+	else {
+		for (DWORD i=0; i<numDevs && numChosen<maxManips; i++) {
+			if (isManip(i) != 0)
+				chosen[numChosen++] = i;
+		}
+	}
+
+	//get handles to the devices that are manipulators, all at once; each one spends
+	//most of its time waiting on USB round trips
+	manipSession opened[maxManips];
+	FT_STATUS status[maxManips];
+	std::thread openers[maxManips];
+	for (int i=0; i<numChosen; i++)
+		openers[i] = std::thread([&opened, &status, &chosen, i]() { status[i] = getHandle(chosen[i], &opened[i]); });
+	for (int i=0; i<numChosen; i++)
+		openers[i].join();
+	flushMessages();
+
+	//keep the ones that opened; the rest are reported in results
+	numHandles = 0;
+	for (int i=0; i<numChosen; i++) {
+		results[i].deviceNumber = opened[i].deviceNumber;
+		results[i].status = status[i];
+		memcpy(results[i].phaseMs, opened[i].initMs, sizeof(results[i].phaseMs));
+		if (status[i] != FT_OK) {
+			manipPrintf("Device %u (serial %s) failed to initialize (status %u)\n", opened[i].deviceNumber, opened[i].serial, (unsigned)status[i]);
+			closeSession(&opened[i]);
+			continue;
+		}
+		//A session is filled in and its thread started before numHandles lets sessionFor see it
+		int manip = numHandles.load();
+		manipSessions[manip] = opened[i];
+		startWorker(&manipSessions[manip]);
+		manipPrintf("%u is a manipulator\n", (unsigned)manip);
+		numHandles.store(manip + 1);
+	}
+	*numTried = numChosen;
+	initialized = 1;
+	publishManips();
+	manipPrintf("Initialized %u manipulators\n", (unsigned)numHandles.load());
+	return FT_OK;
+}
+
+// Stop the I/O threads and close the handles
+void manipUninitialize(void)
+{
+	if (clientConnected()) {
+		manipDisconnect();
+		return;
+	}
+	std::lock_guard<std::mutex> guard(coreLock);
+	if (initialized == 0)
+		return;
+	for (int i=0; i<numHandles; i++) {
+		stopWorker(&manipSessions[i]);
+		closeSession(&manipSessions[i]);
+	}
+	manipPrintf("Uninitialized %u manipulators\n", (unsigned)numHandles.load());
+	numHandles = 0;
+	initialized = 0;
+	publishManips();
+}
+
+int manipCount(void)
+{
+	if (clientConnected())
+		return clientCount();
+	return initialized ? numHandles.load() : -1;
+}
+
+int manipFind(const char *serial)
+{
+	if (clientConnected())
+		return clientFind(serial);
+	for (int i=0; i<numHandles; i++) {
+		if (strcmp(manipSessions[i].serial, serial) == 0)
+			return i;
+	}
+	return -1;
+}
+
+int manipDeviceNumber(int manip)
+{
+	if (clientConnected())
+		return clientDeviceNumber(manip);
+	manipSession *session = sessionFor(manip);
+	return session != NULL ? (int)session->deviceNumber : -1;
+}
+
+int manipWhere(int manip, int drive, int *x, int *y, int *z)
+{
+	if (clientConnected())
+		return clientWhere(manip, drive, x, y, z);
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	return workerWhere(session, drive, x, y, z);
+}
+
+int manipMove(int manip, int drive, int x, int y, int z)
+{
+	if (clientConnected())
+		return clientMove(daemonMove, manip, drive, x, y, z);
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	if (drive < 1 || drive > maxDrives || x < 0 || x > maxSteps || y < 0 || y > maxSteps || z < 0 || z > maxSteps)
+		return FT_INVALID_PARAMETER;
+	return workerMove(session, drive, x, y, z);
+}
+
+int manipMoveAsync(int manip, int drive, int x, int y, int z)
+{
+	if (clientConnected())
+		return clientMove(daemonMoveAsync, manip, drive, x, y, z);
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	if (drive < 1 || drive > maxDrives || x < 0 || x > maxSteps || y < 0 || y > maxSteps || z < 0 || z > maxSteps)
+		return FT_INVALID_PARAMETER;
+	moveAsync(session, drive, x, y, z);
+	return FT_OK;
+}
+
+void manipMoveMany(manipMoveRequest *moves, int numMoves)
+{
+	if (clientConnected()) {
+		clientMoveMany(moves, numMoves);
+		return;
+	}
+	moveMany(moves, numMoves);
+}
+
+int manipWhereAll(manipPosition *positions, int maxRows)
+{
+	if (clientConnected())
+		return clientWhereAll(positions, maxRows);
+	return whereAll(positions, maxRows);
+}
+
+int manipSetTarget(int manip, int drive, int x, int y, int z)
+{
+	if (clientConnected())
+		return clientMove(daemonSetTarget, manip, drive, x, y, z);
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	if (drive < 1 || drive > maxDrives || x < 0 || x > maxSteps || y < 0 || y > maxSteps || z < 0 || z > maxSteps)
+		return FT_INVALID_PARAMETER;
+	setTarget(session, drive, x, y, z);
+	return FT_OK;
+}
+
+int manipTargetCounts(int manip, manipTargetCounters *counters)
+{
+	if (clientConnected())
+		return clientTargetCounts(manip, counters);
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	counters->received = session->worker->targetsReceived.load();
+	counters->sent = session->worker->targetsSent.load();
+	counters->coalesced = session->worker->targetsCoalesced.load();
+	counters->failed = session->worker->targetsFailed.load();
+	return FT_OK;
+}
+
+int manipMoveVerified(int manip, int drive, int x, int y, int z, manipVerifiedMove *result)
+{
+	if (clientConnected())
+		return clientMoveVerified(manip, drive, x, y, z, result);
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	if (drive < 1 || drive > maxDrives || result->tolerance < 0 || result->maxRetries < 0 || result->timeoutMs < 0 ||
+	    x < 0 || x > maxSteps || y < 0 || y > maxSteps || z < 0 || z > maxSteps)
+		return FT_INVALID_PARAMETER;
+	return moveVerified(session, drive, x, y, z, result);
+}
+
+int manipMoveRelative(int manip, int drive, int dx, int dy, int dz, manipRelativeMove *result)
+{
+	if (clientConnected())
+		return clientMoveRelative(manip, drive, dx, dy, dz, result);
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	if (drive < 1 || drive > maxDrives)
+		return FT_INVALID_PARAMETER;
+	return moveRelative(session, drive, dx, dy, dz, result);
+}
+
+int manipMoveAtSpeed(int manip, int drive, int x, int y, int z, manipSpeedMove *move)
+{
+	if (clientConnected())
+		return clientMoveAtSpeed(manip, drive, x, y, z, move);
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	if (drive < 1 || drive > maxDrives || move->speed < 0 || move->speed > protocolMaxSpeed ||
+	    x < 0 || x > maxSteps || y < 0 || y > maxSteps || z < 0 || z > maxSteps)
+		return FT_INVALID_PARAMETER;
+	return moveAtSpeed(session, drive, x, y, z, move);
+}
+
+int manipIsMoving(int manip)
+{
+	if (clientConnected())
+		return clientIsMoving(manip);
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return 0;
+	return session->worker->movesDone.load() != session->worker->movesQueued.load();
+}
+
+int manipWaitMove(int manip, int timeoutMs, int *lastStatus)
+{
+	if (clientConnected())
+		return clientWaitMove(manip, timeoutMs, lastStatus);
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return 0;
+	int done = waitMove(session, timeoutMs);
+	if (lastStatus != NULL)
+		*lastStatus = session->worker->lastMoveStatus;
+	return done;
+}
+
+int manipStartStream(int manip, int drive, double rateHz)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	return startStream(session, drive, rateHz);
+}
+
+int manipStopStream(int manip)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	stopStream(session);
+	return FT_OK;
+}
+
+unsigned manipStreamAvailable(int manip)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return 0;
+	return session->worker->streamTail.load() - session->worker->streamHead.load();
+}
+
+unsigned manipReadStream(int manip, manipSample *samples, unsigned maxSamples)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return 0;
+	return readStream(session, samples, maxSamples);
+}
+
+int manipStreamCounts(int manip, unsigned *dropped, unsigned *missed, unsigned *failed)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	*dropped = session->worker->streamDropped.load();
+	*missed = session->worker->streamMissed.load();
+	*failed = session->worker->streamFailed.load();
+	return FT_OK;
+}
+
+int manipExecutePath(int manip, int drive, const int *waypoints, int numPoints, int dwellMs)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	return executePath(session, drive, waypoints, numPoints, dwellMs);
+}
+
+int manipAbortPath(int manip)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	abortPath(session);
+	return FT_OK;
+}
+
+int manipPathStatus(int manip, manipPathProgress *progress)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	manipWorker *worker = session->worker;
+	//executePath sets pathLength under callerLock
+	std::lock_guard<std::mutex> caller(worker->callerLock);
+	progress->running = worker->pathPending.load();
+	progress->reached = worker->pathDone.load(std::memory_order_acquire);
+	progress->total = worker->pathLength;
+	progress->status = progress->running ? (int)FT_OK : (int)worker->pathStatus;
+	return FT_OK;
+}
+
+int manipPathTimes(int manip, double *times, int maxTimes)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return 0;
+	manipWorker *worker = session->worker;
+	//executePath replaces pathTimes under callerLock
+	std::lock_guard<std::mutex> caller(worker->callerLock);
+	int reached = worker->pathDone.load(std::memory_order_acquire);
+	if (reached > maxTimes)
+		reached = maxTimes;
+	memcpy(times, worker->pathTimes, reached*sizeof(double));
+	return reached;
+}
+
+int manipGetLink(int manip, manipLinkConfig *config)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	config->baudRate = session->settings.baudRate;
+	config->latencyTimer = session->settings.latencyTimer;
+	config->usbTransferSize = session->settings.usbTransferSize;
+	config->readTimeout = session->settings.readTimeout;
+	config->writeTimeout = session->settings.writeTimeout;
+	return FT_OK;
+}
+
+int manipConfigureLink(int manip, const manipLinkConfig *config)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	if (config->latencyTimer > 255)
+		return FT_INVALID_PARAMETER;
+	manipLinkSettings settings;
+	settings.baudRate = config->baudRate;
+	settings.latencyTimer = (UCHAR)config->latencyTimer;
+	settings.usbTransferSize = config->usbTransferSize;
+	settings.readTimeout = config->readTimeout;
+	settings.writeTimeout = config->writeTimeout;
+	if (!linkSettingsValid(&settings))
+		return FT_INVALID_PARAMETER;
+	return configureLink(session, &settings);
+}
+
+int manipAutotune(int manip, int drive, int samplesPerSetting, double *results)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	if (drive < 1 || drive > maxDrives || samplesPerSetting < 1)
+		return FT_INVALID_PARAMETER;
+	return autotune(session, drive, samplesPerSetting, results);
+}
+
+int manipAutotuneRows(void)
+{
+	return numTuneLatencies*numTuneTransfers;
+}
+
+int manipGetStats(int manip, manipOpSummary *summaries, int maxOps)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return 0;
+	for (int op=0; op<numStats && op<maxOps; op++) {
+		const manipOpStats *opStats = &session->worker->stats.op[op];
+		manipOpSummary *summary = &summaries[op];
+		summary->name = statsName(op);
+		summary->count = opStats->count.load(std::memory_order_relaxed);
+		summary->failures = opStats->failures.load(std::memory_order_relaxed);
+		summary->meanMs = summary->count ? opStats->totalNs.load(std::memory_order_relaxed) / 1e6 / summary->count : 0;
+		summary->p50Ms = statsPercentile(opStats, 0.50);
+		summary->p90Ms = statsPercentile(opStats, 0.90);
+		summary->p99Ms = statsPercentile(opStats, 0.99);
+		summary->maxMs = opStats->maxNs.load(std::memory_order_relaxed) / 1e6;
+	}
+	return numStats;
+}
+
+int manipGetLinkHealth(int manip, manipLinkHealth *health)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	const manipStats *stats = &session->worker->stats;
+	health->timeouts = stats->errors[errTimeout].load(std::memory_order_relaxed);
+	health->badFrames = stats->errors[errBadFrame].load(std::memory_order_relaxed);
+	health->resyncs = stats->errors[errResync].load(std::memory_order_relaxed);
+	health->retries = stats->errors[errRetry].load(std::memory_order_relaxed);
+	health->gaveUp = stats->errors[errGaveUp].load(std::memory_order_relaxed);
+	health->roundTripMs = stats->roundTripUs.load(std::memory_order_relaxed) / 1000.0;
+	health->replyTimeoutMs = stats->replyTimeoutUs.load(std::memory_order_relaxed) / 1000.0;
+	return FT_OK;
+}
+
+int manipGetSchedulerStats(int manip, manipSchedulerStats *scheduler)
+{
+	manipSession *session = sessionFor(manip);
+	if (session == NULL)
+		return FT_INVALID_HANDLE;
+	const manipStats *stats = &session->worker->stats;
+	const manipOpStats *wait = &stats->op[statQueueWait];
+	unsigned arrivalSwitches = stats->sched[schedArrivalSwitches].load(std::memory_order_relaxed);
+	scheduler->requests = stats->sched[schedRequests].load(std::memory_order_relaxed);
+	scheduler->reordered = stats->sched[schedReordered].load(std::memory_order_relaxed);
+	scheduler->forced = stats->sched[schedForced].load(std::memory_order_relaxed);
+	scheduler->switches = stats->sched[schedSwitches].load(std::memory_order_relaxed);
+	scheduler->switchesAvoided = arrivalSwitches > scheduler->switches ? arrivalSwitches - scheduler->switches : 0;
+	unsigned waits = wait->count.load(std::memory_order_relaxed);
+	scheduler->meanWaitMs = waits ? wait->totalNs.load(std::memory_order_relaxed) / 1e6 / waits : 0;
+	scheduler->p99WaitMs = statsPercentile(wait, 0.99);
+	return FT_OK;
+}
+
+int manipResetStats(int manip)
+{
+	if (manip != -1 && sessionFor(manip) == NULL)
+		return FT_INVALID_HANDLE;
+	for (int i=0; i<numHandles; i++) {
+		if (manip == -1 || i == manip)
+			statsReset(&manipSessions[i].worker->stats);
+	}
+	return FT_OK;
+}
+
+// Tell the position publisher which manipulators there are (under coreLock)
+void publishManips()
+{
+	const char *serials[maxManips];
+	for (int i=0; i<numHandles; i++)
+		serials[i] = manipSessions[i].serial;
+	positionsSetManips(initialized ? numHandles.load() : -1, serials);
+}
+
+int manipStartPublishing(const char *name)
+{
+	if (name == NULL || name[0] == 0)
+		name = getenv("MANIPCONTROL_SHM");
+	if (name == NULL || name[0] == 0)
+		name = POSITIONS_DEFAULT_NAME;
+	std::lock_guard<std::mutex> guard(coreLock);
+	FT_STATUS ftStatus = positionsStart(name);
+	if (ftStatus == FT_OK)
+		publishManips();
+	return ftStatus;
+}
+
+void manipStopPublishing(void)
+{
+	positionsStop();
+}
+
+int manipStartTrace(const char *path, unsigned records)
+{
+	if (path == NULL || path[0] == 0)
+		return FT_INVALID_PARAMETER;
+	return traceStart(path, records > 0 ? records : traceDefaultRecords);
+}
+
+unsigned long long manipStopTrace(void)
+{
+	return traceStop();
+}
+
+unsigned long long manipTraceCount(void)
+{
+	return traceCount();
+}
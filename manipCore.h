@@ -0,0 +1,299 @@
+#ifndef MANIP_CORE_H
+#define MANIP_CORE_H
+
+//Device layer of manipControl as a plain C library: enumeration, opening, position queries,
+//moves, streaming, paths, link settings and latency statistics for Sutter MPC-200/ROE-200
+//controllers.  manipControl.cpp (the MEX function) is one user of it; C, C++ and anything with
+//a C FFI (Python ctypes, ...) can link it directly and talk to the devices with no MATLAB in
+//the loop.
+//
+//Build it on its own (no MATLAB needed), e.g. on Linux:
+//  g++ -std=c++11 -O2 -shared -fPIC manipCore.cpp manipTransport.cpp manipEmulator.cpp manipTrace.cpp manipPositions.cpp manipClient.cpp -lftd2xx -lrt -o libmanipcore.so
+//and on Windows define MANIP_BUILD_DLL when building a DLL.
+//
+//Threads: once manipInitialize has returned, the calls on manipulators may be made from any
+//thread.  Calls on different manipulators run in parallel, and calls on the same one are run
+//in order by its I/O thread.  manipInitialize, manipUninitialize, manipSetTransport and the
+//enumeration calls are serialized by a library lock, but not against the calls on
+//manipulators: don't initialize or uninitialize while other threads are using them.
+//
+//Unless stated otherwise functions return MANIP_OK (0) on success or an FT_STATUS code (see
+//ftd2xx.h; the common ones are below).  Manipulators are numbered from 0 in the order
+//manipInitialize opened them.
+
+#if defined(_WIN32) && defined(MANIP_BUILD_DLL)
+#define MANIP_API __declspec(dllexport)
+#else
+#define MANIP_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MANIP_API_VERSION 1
+#define MANIP_OK 0
+#define MANIP_INVALID_HANDLE 1			//No such manipulator
+#define MANIP_DEVICE_NOT_FOUND 2
+#define MANIP_DEVICE_NOT_OPENED 3		//Also: already initialized, or a path is already running
+#define MANIP_IO_ERROR 4				//Also: a bad reply, or moveVerified ended off target
+#define MANIP_INVALID_PARAMETER 6
+#define MANIP_MAX_MANIPS 16				//Most manipulators that can be open at once
+#define MANIP_MAX_DRIVES 2				//Drives an MPC-2000/ROE-200N can switch between (numbered from 1)
+#define MANIP_INIT_PHASES 4				//manipInitialize times: open, configure, purge, wake-up write
+
+// One device found on the bus
+typedef struct {
+	char description[64];
+	char serial[64];
+	unsigned locationId;						// where on the USB tree it is plugged in (0 if unknown)
+	int isOpen;									// already opened, by us or another program (D2XX only)
+	int isManip;								// whether it is a manipulator controller
+} manipDeviceEntry;
+
+// What happened to one device manipInitialize tried to open
+typedef struct {
+	int deviceNumber;
+	int status;
+	double phaseMs[MANIP_INIT_PHASES];
+} manipOpenResult;
+
+// Serial line settings of one manipulator
+typedef struct {
+	unsigned baudRate;
+	unsigned latencyTimer;						// ms
+	unsigned usbTransferSize;					// bytes
+	unsigned readTimeout;						// ms
+	unsigned writeTimeout;						// ms
+} manipLinkConfig;
+
+// One move of manipMoveMany; status and elapsed are filled in
+typedef struct {
+	int manip, drive;
+	int x, y, z;								// steps
+	int status;
+	double elapsed;								// s from the start of the call to completion
+} manipMoveRequest;
+
+// Where one drive is, as read by manipWhereAll
+typedef struct {
+	int manip, drive;
+	int x, y, z;								// steps
+	int status;
+} manipPosition;
+
+// Settings and outcome of manipMoveVerified
+typedef struct {
+	int tolerance;								// steps allowed off target, on each axis
+	int maxRetries;								// moves sent after the first, at most
+	int timeoutMs;								// no retry is started after this
+	//Filled in
+	int x, y, z;								// last position read back
+	int attempts;								// moves sent
+	double elapsedMs;
+} manipVerifiedMove;
+
+// Outcome of manipMoveRelative
+typedef struct {
+	int x, y, z;								// target sent (steps)
+	int clamped;								// axes limited to 0..400e3: 1 = x, 2 = y, 4 = z
+	int queried;								// 1 if the position had to be read first
+} manipRelativeMove;
+
+// Settings and outcome of manipMoveAtSpeed
+typedef struct {
+	int speed;									// um/s, 1 to 32767, or 0 to have the planner choose
+	int fine;									// 1 for fine resolution (ignored when the planner chooses)
+	//Filled in
+	int speedUsed, fineUsed;					// what the drive moved at
+	int velocitySent;							// 1 if a velocity command was sent (the drive had a different one)
+	int queried;								// 1 if the position had to be read first
+	double predictedMs;							// travel time at speedUsed plus a round trip
+	double measuredMs;							// from sending the move to its reply
+} manipSpeedMove;
+
+// What manipSetTarget has done so far on one manipulator
+typedef struct {
+	unsigned received;							// targets set
+	unsigned sent;								// moves sent for them
+	unsigned coalesced;							// replaced by a newer target before being sent
+	unsigned failed;							// sent, but the move failed
+} manipTargetCounters;
+
+// One timestamped position from a stream
+typedef struct {
+	double t;									// seconds since manipStartStream
+	int x, y, z;
+} manipSample;
+
+// Progress of the last path given to manipExecutePath
+typedef struct {
+	int reached;								// waypoints reached so far
+	int total;
+	int status;									// 0, or the status of the move that failed
+	int running;
+} manipPathProgress;
+
+// Latency summary of one timed operation (write, read, purge, driveChange, where, move)
+typedef struct {
+	const char *name;
+	unsigned count;
+	unsigned failures;
+	double meanMs, p50Ms, p90Ms, p99Ms, maxMs;
+} manipOpSummary;
+
+MANIP_API int manipApiVersion(void);
+
+// Messages (progress and errors) go to handler, called only from the thread that set it; what
+// other threads print is held until that thread next calls into the library or calls
+// manipFlushMessages.  With no handler they go straight to stderr.
+MANIP_API void manipSetMessageHandler(void (*handler)(const char *message));
+MANIP_API void manipFlushMessages(void);
+
+// Transport backend used to find and open devices: "d2xx", "termios" or "emulator", with
+// its options (termios: device paths, emulator: 'name=value;...'; may be NULL).  Only
+// before manipInitialize.
+MANIP_API int manipSetTransport(const char *name, const char *options);
+MANIP_API const char* manipTransportName(void);
+
+// The device list is taken once and kept; manipScan takes it again
+MANIP_API int manipScan(int *numDevices);
+MANIP_API int manipNumDevices(int *numDevices);
+MANIP_API int manipNumManips(int *numManips);
+MANIP_API int manipGetDevice(int device, manipDeviceEntry *entry);
+MANIP_API int manipFindDevice(const char *serial);				// device number, -1 if none
+
+// Open the devices with the given serial numbers, in that order, or every manipulator if
+// serials is NULL.  results (room for MANIP_MAX_MANIPS) gets one entry per device tried, and
+// numTried how many that was.  Devices that fail to open aren't numbered as manipulators.
+MANIP_API int manipInitialize(const char *const *serials, int numSerials, manipOpenResult *results, int *numTried);
+MANIP_API void manipUninitialize(void);
+MANIP_API int manipCount(void);									// manipulators open, -1 before manipInitialize
+MANIP_API int manipFind(const char *serial);					// manipulator number, -1 if none
+MANIP_API int manipDeviceNumber(int manip);
+
+// Positions are in steps (62.5 nm, 0 to 400e3); a move outside that is MANIP_INVALID_PARAMETER
+MANIP_API int manipWhere(int manip, int drive, int *x, int *y, int *z);
+MANIP_API int manipMove(int manip, int drive, int x, int y, int z);
+MANIP_API int manipMoveAsync(int manip, int drive, int x, int y, int z);
+MANIP_API void manipMoveMany(manipMoveRequest *moves, int numMoves);
+// Read every drive of every manipulator, all devices at once.  positions needs room for
+// manipCount()*MANIP_MAX_DRIVES rows; returns the number filled (manipulator, then drive order).
+MANIP_API int manipWhereAll(manipPosition *positions, int maxRows);
+// Move, read back and correct until within result->tolerance, on the manipulator's I/O
+// thread.  Returns MANIP_IO_ERROR if it ran out of retries or time while off target, or
+// if a failed move left the drive not answering where it is (it may still be moving, so the
+// move isn't sent again).
+MANIP_API int manipMoveVerified(int manip, int drive, int x, int y, int z, manipVerifiedMove *result);
+// Move by (dx,dy,dz) from the drive's last known position (last 'C' reply or completed
+// move), reading it first only if an error or reconnect lost it.  The target is clamped to
+// 0..400e3 and result->clamped says on which axes.
+MANIP_API int manipMoveRelative(int manip, int drive, int dx, int dy, int dz, manipRelativeMove *result);
+// Move at move->speed, or with move->speed 0 at the fastest speed the planner allows for the
+// distance.  The velocity command is only sent when the drive was last given another speed.
+// Later plain moves keep the speed.
+MANIP_API int manipMoveAtSpeed(int manip, int drive, int x, int y, int z, manipSpeedMove *move);
+// Make (x,y,z) the drive's newest setpoint and return at once.  The I/O thread sends the
+// newest one whenever the previous move is done; targets overwritten before then are dropped.
+// While other calls keep the manipulator busy, a waiting target is sent after at most 4 of them.
+MANIP_API int manipSetTarget(int manip, int drive, int x, int y, int z);
+MANIP_API int manipTargetCounts(int manip, manipTargetCounters *counters);
+MANIP_API int manipIsMoving(int manip);
+// 1 if the manipulator's moves finished within timeoutMs, 0 if not; lastStatus (may be NULL)
+// gets the status of the last move
+MANIP_API int manipWaitMove(int manip, int timeoutMs, int *lastStatus);
+
+MANIP_API int manipStartStream(int manip, int drive, double rateHz);
+MANIP_API int manipStopStream(int manip);
+MANIP_API unsigned manipStreamAvailable(int manip);
+MANIP_API unsigned manipReadStream(int manip, manipSample *samples, unsigned maxSamples);
+MANIP_API int manipStreamCounts(int manip, unsigned *dropped, unsigned *missed, unsigned *failed);
+
+// waypoints is numPoints x,y,z triples, one after the other
+MANIP_API int manipExecutePath(int manip, int drive, const int *waypoints, int numPoints, int dwellMs);
+MANIP_API int manipAbortPath(int manip);
+MANIP_API int manipPathStatus(int manip, manipPathProgress *progress);
+// Time (s since the path started) each reached waypoint was reached; returns how many
+MANIP_API int manipPathTimes(int manip, double *times, int maxTimes);
+
+MANIP_API int manipGetLink(int manip, manipLinkConfig *config);
+// Apply and save new link settings.  MANIP_INVALID_PARAMETER unless baudRate >= 300,
+// latencyTimer is 1-255, usbTransferSize 64-65536 and both timeouts >= 10 ms.
+MANIP_API int manipConfigureLink(int manip, const manipLinkConfig *config);
+// results gets manipAutotuneRows() rows of [latency transfer median_ms p99_ms], column major
+MANIP_API int manipAutotune(int manip, int drive, int samplesPerSetting, double *results);
+MANIP_API int manipAutotuneRows(void);
+
+// Fills up to maxOps summaries and returns how many there are
+MANIP_API int manipGetStats(int manip, manipOpSummary *summaries, int maxOps);
+MANIP_API int manipResetStats(int manip);						// -1: every manipulator
+
+// How the link to one manipulator is doing.  Replies are checked for their framing; a late
+// or bad one is retried after flushing the receive queue, a few times at most.  The counts
+// are reset with the stats.
+typedef struct {
+	unsigned timeouts;							// replies that didn't arrive in time
+	unsigned badFrames;							// replies of the right length, framed wrong
+	unsigned resyncs;							// times the framing was recovered (queue flushed or reply realigned)
+	unsigned retries;							// commands sent again
+	unsigned gaveUp;							// commands that failed after every retry
+	double roundTripMs;							// smoothed 'C'/'I' round trip
+	double replyTimeoutMs;						// what 'C' and 'I' replies are waited for now
+} manipLinkHealth;
+
+MANIP_API int manipGetLinkHealth(int manip, manipLinkHealth *health);
+
+// What the I/O thread's scheduler did on one manipulator.  Where, move, moveVerified and
+// moveRelative calls waiting together (from moveMany, moveAsync or several threads) are run
+// those for the selected drive first, to save drive changes; each drive's calls keep their
+// order, and a call is overtaken at most 4 times.  The counts are reset with the stats.
+typedef struct {
+	unsigned requests;							// drive calls scheduled
+	unsigned reordered;							// run ahead of an older call for the other drive
+	unsigned forced;							// times the overtaking limit made the other drive go next
+	unsigned switches;							// drive changes between calls, in the order they ran
+	unsigned switchesAvoided;					// fewer than in the order they were queued
+	double meanWaitMs, p99WaitMs;				// time calls waited in the queue
+} manipSchedulerStats;
+
+MANIP_API int manipGetSchedulerStats(int manip, manipSchedulerStats *scheduler);
+
+// manipDaemon (see manipDaemon.h) keeps the manipulators open between programs.  While
+// connected to it, manipCount, manipFind, manipDeviceNumber, manipWhere, manipMove,
+// manipMoveAsync, manipMoveMany, manipWhereAll, manipSetTarget, manipTargetCounts,
+// manipMoveVerified, manipMoveRelative, manipMoveAtSpeed, manipIsMoving and manipWaitMove go
+// to the daemon's manipulators.  The rest (streams, paths, link settings, autotune, stats and
+// link health) only work on manipulators initialized here, and return MANIP_INVALID_HANDLE
+// (or nothing) while connected.  Not on Windows.
+typedef struct {
+	unsigned requests;							// since connecting
+	double meanRoundTripMs;
+	double meanOverheadMs;						// round trip less the time the daemon spent on the call
+	double maxOverheadMs;
+} manipDaemonTimes;
+
+MANIP_API int manipConnect(const char *socketPath);			// NULL: $MANIPCONTROL_SOCKET or /tmp/manipControl.sock
+MANIP_API void manipDisconnect(void);
+MANIP_API int manipConnected(void);
+MANIP_API int manipGetDaemonTimes(manipDaemonTimes *times);
+
+// Publish every drive's latest position (from each good position reply and completed move)
+// in POSIX shared memory under name (NULL: $MANIPCONTROL_SHM or /manipControl.positions),
+// where other local programs can read it without a lock; see manipPositions.h for the
+// layout and the reader.  MANIP_DEVICE_NOT_OPENED if another running process is publishing
+// under that name.  Not on Windows.
+MANIP_API int manipStartPublishing(const char *name);
+MANIP_API void manipStopPublishing(void);
+
+// Record every open, write, read, purge and close on every device into a ring of records
+// (0: 65536) in a memory-mapped file; see manipTrace.h for the layout and manipTraceDecode
+// to turn it into CSV.  Can be started and stopped at any time.
+MANIP_API int manipStartTrace(const char *path, unsigned records);
+MANIP_API unsigned long long manipStopTrace(void);				// returns the records written
+MANIP_API unsigned long long manipTraceCount(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#include "manipDaemon.h"
+
+//manipDaemon: opens the manipulators once and serves them to manipControl (and any other
+//client of the library) over a Unix-domain socket.  See manipDaemon.h.
+//
+//Build and run, e.g.:
+//  g++ -std=c++11 -O2 manipDaemon.cpp manipClient.cpp manipCore.cpp manipTransport.cpp manipEmulator.cpp manipTrace.cpp manipPositions.cpp -lftd2xx -lpthread -lrt -o manipDaemon
+//  manipDaemon [-s socket] [-t transport[,options]] [-p shm name] [serial ...]
+//With no serials every manipulator found is opened.  Then manipControl('connect') in MATLAB.
+//With -p the positions are also published in shared memory (see manipPositions.h).
+//The daemon runs until it gets SIGINT or SIGTERM.
+
+#define maxClients 32					//Connections served at once
+
+static volatile sig_atomic_t stopping = 0;
+static std::mutex clientsLock;
+static std::condition_variable clientsGone;
+static int clientFds[maxClients];
+static int numClients = 0;
+
+// Payload buffer of one connection, aligned for the rows that travel in it
+typedef union {
+	char bytes[daemonMaxPayload];
+	manipMoveRequest moves[daemonMaxPayload / sizeof(manipMoveRequest)];
+	manipPosition positions[daemonMaxPayload / sizeof(manipPosition)];
+} daemonPayload;
+static daemonPayload buffers[maxClients];		//Indexed like clientFds
+
+static void onSignal(int)
+{
+	stopping = 1;
+}
+
+// Send or receive exactly length bytes
+static int transfer(int fd, int sending, void *buffer, size_t length)
+{
+	char *bytes = (char*)buffer;
+	while (length > 0) {
+		ssize_t done = sending ? send(fd, bytes, length, MSG_NOSIGNAL) : recv(fd, bytes, length, 0);
+		if (done < 0 && errno == EINTR)
+			continue;
+		if (done <= 0)
+			return 0;
+		bytes += done;
+		length -= (size_t)done;
+	}
+	return 1;
+}
+
+// Run one request.  payload holds what followed the request, and is where the reply's
+// payload goes (the reply's payloadLength says how much of it).
+static void serve(const daemonRequest *request, daemonPayload *payload, daemonReply *reply)
+{
+	const int32_t *arg = request->arg;
+	int32_t *value = reply->value;
+	switch (request->op) {
+	case daemonHello:
+		value[0] = DAEMON_PROTOCOL;
+		value[1] = manipCount();
+		if (arg[0] != DAEMON_PROTOCOL)
+			reply->status = MANIP_INVALID_PARAMETER;
+		break;
+	case daemonCount:
+		value[0] = manipCount();
+		break;
+	case daemonFind:
+		payload->bytes[request->payloadLength > 0 ? request->payloadLength-1 : 0] = 0;
+		value[0] = manipFind(payload->bytes);
+		break;
+	case daemonDeviceNumber:
+		value[0] = manipDeviceNumber(request->manip);
+		break;
+	case daemonWhere:
+		reply->status = manipWhere(request->manip, arg[0], &value[0], &value[1], &value[2]);
+		break;
+	case daemonMove:
+		reply->status = manipMove(request->manip, arg[0], arg[1], arg[2], arg[3]);
+		break;
+	case daemonMoveAsync:
+		reply->status = manipMoveAsync(request->manip, arg[0], arg[1], arg[2], arg[3]);
+		break;
+	case daemonSetTarget:
+		reply->status = manipSetTarget(request->manip, arg[0], arg[1], arg[2], arg[3]);
+		break;
+	case daemonMoveMany:
+		manipMoveMany(payload->moves, (int)(request->payloadLength / sizeof(manipMoveRequest)));
+		reply->payloadLength = request->payloadLength;
+		break;
+	case daemonWhereAll: {
+		int maxRows = arg[0];
+		if (maxRows < 0 || (size_t)maxRows * sizeof(manipPosition) > daemonMaxPayload)
+			maxRows = daemonMaxPayload / sizeof(manipPosition);
+		int rows = manipWhereAll(payload->positions, maxRows);
+		reply->payloadLength = (uint32_t)(rows * sizeof(manipPosition));
+		break;
+	}
+	case daemonTargetCounts: {
+		manipTargetCounters counters;
+		memset(&counters, 0, sizeof(counters));
+		reply->status = manipTargetCounts(request->manip, &counters);
+		value[0] = (int32_t)counters.received;
+		value[1] = (int32_t)counters.sent;
+		value[2] = (int32_t)counters.coalesced;
+		value[3] = (int32_t)counters.failed;
+		break;
+	}
+	case daemonMoveVerified: {
+		manipVerifiedMove result;
+		memset(&result, 0, sizeof(result));
+		result.tolerance = arg[4];
+		result.maxRetries = arg[5];
+		result.timeoutMs = arg[6];
+		reply->status = manipMoveVerified(request->manip, arg[0], arg[1], arg[2], arg[3], &result);
+		value[0] = result.x;
+		value[1] = result.y;
+		value[2] = result.z;
+		value[3] = result.attempts;
+		value[4] = (int32_t)(result.elapsedMs * 1000);
+		break;
+	}
+	case daemonMoveRelative: {
+		manipRelativeMove result;
+		memset(&result, 0, sizeof(result));
+		reply->status = manipMoveRelative(request->manip, arg[0], arg[1], arg[2], arg[3], &result);
+		value[0] = result.x;
+		value[1] = result.y;
+		value[2] = result.z;
+		value[3] = result.clamped;
+		value[4] = result.queried;
+		break;
+	}
+	case daemonMoveAtSpeed: {
+		manipSpeedMove move;
+		memset(&move, 0, sizeof(move));
+		move.speed = arg[4];
+		move.fine = arg[5];
+		reply->status = manipMoveAtSpeed(request->manip, arg[0], arg[1], arg[2], arg[3], &move);
+		value[0] = move.speedUsed;
+		value[1] = move.fineUsed;
+		value[2] = move.velocitySent;
+		value[3] = move.queried;
+		value[4] = (int32_t)(move.predictedMs * 1000);
+		value[5] = (int32_t)(move.measuredMs * 1000);
+		break;
+	}
+	case daemonIsMoving:
+		value[0] = manipIsMoving(request->manip);
+		break;
+	case daemonWaitMove:
+		value[0] = manipWaitMove(request->manip, arg[0], &value[1]);
+		break;
+	default:
+		reply->status = MANIP_INVALID_PARAMETER;
+	}
+}
+
+// One connection, until the client goes away; slot is its entry in clientFds and buffers
+static void clientMain(int fd, int slot)
+{
+	daemonPayload *payload = &buffers[slot];
+	unsigned requests = 0;
+	unsigned long long serviceNs = 0;
+	daemonRequest request;
+	while (transfer(fd, 0, &request, sizeof(request))) {
+		if (request.payloadLength > daemonMaxPayload ||
+		    (request.payloadLength > 0 && !transfer(fd, 0, payload->bytes, request.payloadLength)))
+			break;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		daemonReply reply;
+		memset(&reply, 0, sizeof(reply));
+		serve(&request, payload, &reply);
+		unsigned long long ns = (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		reply.serviceNs = ns > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)ns;
+		requests++;
+		serviceNs += ns;
+		if (!transfer(fd, 1, &reply, sizeof(reply)) ||
+		    (reply.payloadLength > 0 && !transfer(fd, 1, payload->bytes, reply.payloadLength)))
+			break;
+	}
+	fprintf(stderr, "Client %d left after %u requests (mean %.3f ms in the daemon each)\n", fd, requests,
+	        requests > 0 ? serviceNs / 1e6 / requests : 0.0);
+	//Free the slot before the fd number can be handed out again by accept()
+	std::lock_guard<std::mutex> guard(clientsLock);
+	clientFds[slot] = -1;
+	close(fd);
+	numClients--;
+	clientsGone.notify_all();
+}
+
+int main(int argc, char *argv[])
+{
+	const char *socketPath = getenv("MANIPCONTROL_SOCKET");
+	const char *transport = NULL;
+	const char *publishName = NULL;
+	char transportName[16] = "";
+	const char *serials[MANIP_MAX_MANIPS];
+	int numSerials = 0;
+
+	if (socketPath == NULL || socketPath[0] == 0)
+		socketPath = DAEMON_SOCKET;
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+			socketPath = argv[++i];
+		else if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+			transport = argv[++i];
+		else if (strcmp(argv[i], "-p") == 0 && i+1 < argc)
+			publishName = argv[++i];
+		else if (argv[i][0] == '-') {
+			fprintf(stderr, "Usage: %s [-s socket] [-t transport[,options]] [-p shm name] [serial ...]\n", argv[0]);
+			return 2;
+		}
+		else if (numSerials < MANIP_MAX_MANIPS)
+			serials[numSerials++] = argv[i];
+	}
+	if (transport != NULL) {
+		const char *options = strchr(transport, ',');
+		size_t length = options != NULL ? (size_t)(options - transport) : strlen(transport);
+		snprintf(transportName, sizeof(transportName), "%.*s", (int)length, transport);
+		if (manipSetTransport(transportName, options != NULL ? options+1 : NULL) != MANIP_OK) {
+			fprintf(stderr, "Error. Transport '%s' isn't available in this build\n", transport);
+			return 1;
+		}
+	}
+
+	manipOpenResult results[MANIP_MAX_MANIPS];
+	int numTried = 0;
+	manipInitialize(numSerials > 0 ? serials : NULL, numSerials, results, &numTried);
+	if (manipCount() <= 0) {
+		fprintf(stderr, "Error. No manipulators could be opened\n");
+		manipUninitialize();
+		return 1;
+	}
+	int publishStatus = publishName != NULL ? manipStartPublishing(publishName) : MANIP_OK;
+	if (publishStatus != MANIP_OK) {
+		fprintf(stderr, "Error. Can't publish positions as %s%s\n", publishName,
+		        publishStatus == MANIP_DEVICE_NOT_OPENED ? ": another running process is publishing under that name" : "");
+		manipUninitialize();
+		return 1;
+	}
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "Error. Socket path '%s' is too long\n", socketPath);
+		manipUninitialize();
+		return 1;
+	}
+	strcpy(address.sun_path, socketPath);
+	int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	unlink(socketPath);
+	//Owner and group only: whoever can connect can move the manipulators
+	mode_t oldMask = umask(007);
+	if (listenFd < 0 || bind(listenFd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 8) != 0) {
+		umask(oldMask);
+		fprintf(stderr, "Error. Can't listen on %s: %s\n", socketPath, strerror(errno));
+		manipUninitialize();
+		return 1;
+	}
+	umask(oldMask);
+
+	//No SA_RESTART, so accept() returns when we're told to stop
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = onSignal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	for (int i=0; i<maxClients; i++)
+		clientFds[i] = -1;
+
+	fprintf(stderr, "Serving %d manipulators on %s\n", manipCount(), socketPath);
+	while (!stopping) {
+		int fd = accept(listenFd, NULL, NULL);
+		if (fd < 0)
+			continue;
+		std::lock_guard<std::mutex> guard(clientsLock);
+		int slot = -1;
+		for (int i=0; i<maxClients && slot < 0; i++) {
+			if (clientFds[i] < 0)
+				slot = i;
+		}
+		if (slot < 0) {
+			fprintf(stderr, "Error. Already serving %d clients\n", maxClients);
+			close(fd);
+			continue;
+		}
+		clientFds[slot] = fd;
+		numClients++;
+		std::thread(clientMain, fd, slot).detach();
+	}
+
+	//Hang up on everyone and wait for their threads before closing the devices
+	close(listenFd);
+	unlink(socketPath);
+	{
+		std::unique_lock<std::mutex> lock(clientsLock);
+		for (int i=0; i<maxClients; i++) {
+			if (clientFds[i] >= 0)
+				shutdown(clientFds[i], SHUT_RDWR);
+		}
+		clientsGone.wait(lock, []{ return numClients == 0; });
+	}
+	manipUninitialize();
+	manipStopPublishing();
+	return 0;
+}
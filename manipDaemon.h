@@ -0,0 +1,58 @@
+#ifndef MANIP_DAEMON_H
+#define MANIP_DAEMON_H
+
+//manipDaemon: keeps the manipulators open in a process of its own and serves the library
+//calls to clients over a Unix-domain socket, so a 'clear mex', a MATLAB crash or a second
+//MATLAB doesn't pay for enumerating, opening and configuring the controllers again, and
+//several programs can share them (calls on one manipulator still run one at a time, on its
+//I/O thread in the daemon).
+//
+//The protocol is one request and one reply at a time per connection, both fixed size
+//headers followed by payloadLength bytes.  Client and daemon are always built from the same
+//sources for the same machine, so structs go over the wire as they are.
+
+#include <stdint.h>
+#include "manipCore.h"
+
+#define DAEMON_PROTOCOL 2
+#define DAEMON_SOCKET "/tmp/manipControl.sock"	//Default socket ($MANIPCONTROL_SOCKET overrides it)
+#define daemonMaxPayload 65536					//Most bytes that may follow a request or reply header
+
+// Requests.  Each one runs the library call of the same name in the daemon.
+enum { daemonHello, daemonCount, daemonFind, daemonDeviceNumber, daemonWhere, daemonMove,
+       daemonMoveAsync, daemonMoveMany, daemonWhereAll, daemonSetTarget, daemonTargetCounts,
+       daemonMoveVerified, daemonMoveRelative, daemonIsMoving, daemonWaitMove, daemonMoveAtSpeed,
+       numDaemonOps };
+
+typedef struct {
+	uint32_t op;								// daemonHello, daemonCount, ...
+	uint32_t payloadLength;						// bytes following (find: serial, moveMany: manipMoveRequests)
+	int32_t manip;
+	int32_t arg[7];								// drive, x, y, z, ... in the order the call takes them
+} daemonRequest;
+
+typedef struct {
+	int32_t status;								// what the call returned
+	uint32_t payloadLength;						// bytes following (moveMany: the requests, whereAll: manipPositions)
+	uint32_t serviceNs;							// time the daemon spent on the request
+	int32_t value[7];							// outputs (x, y, z, ...)
+} daemonReply;
+
+//Client side (manipClient.cpp).  While connected, the calls below are sent to the daemon
+//instead of being run here; everything else works on local devices only.
+int clientConnected();
+int clientCount();
+int clientFind(const char *serial);
+int clientDeviceNumber(int manip);
+int clientWhere(int manip, int drive, int *x, int *y, int *z);
+int clientMove(int op, int manip, int drive, int x, int y, int z);
+void clientMoveMany(manipMoveRequest *moves, int numMoves);
+int clientWhereAll(manipPosition *positions, int maxRows);
+int clientTargetCounts(int manip, manipTargetCounters *counters);
+int clientMoveVerified(int manip, int drive, int x, int y, int z, manipVerifiedMove *result);
+int clientMoveRelative(int manip, int drive, int dx, int dy, int dz, manipRelativeMove *result);
+int clientMoveAtSpeed(int manip, int drive, int x, int y, int z, manipSpeedMove *move);
+int clientIsMoving(int manip);
+int clientWaitMove(int manip, int timeoutMs, int *lastStatus);
+
+#endif
@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "manipTransport.h"
+#include "manipProtocol.h"
+
+//Software stand-in for MPC-200/ROE-200 controllers, used as the 'emulator' transport.
+//
+//It answers the commands manipControl sends the way the controllers do:
+//  0xEE         wake up (no reply)
+//  'I' drive    select drive 1 or 2, reply CR
+//  'C'          reply drive byte, x, y, z (4 bytes each, least significant first), CR
+//  'M' x y z    move the selected drive there, reply CR once it arrives
+//  'V' speed CR set the selected drive's speed (um/s), reply CR
+//  'U'          reply number of drives, a status byte for each of four, CR
+//(frames as in manipProtocol.h).  A drive moves at 16 steps/s per um/s of the last speed
+//set for it, or at stepsPerSecond until one is; the resolution bit is taken and ignored.
+//Commands are handled one at a time; anything sent during a move waits for it to finish.
+//
+//Options, given as 'name=value;...' in place of the device paths of setTransport:
+//  devices          number of controllers (default 2, at most maxEmulated)
+//  latencyUs        USB round trip added to every reply (default 250)
+//  latencyTimer     1 to hold short replies for the link's latency timer like an FTDI chip
+//                   does (default 1)
+//  stepsPerSecond   move speed before a velocity command (default 40000, about 2.5 mm/s)
+//  dropEvery        every Nth reply loses its last byte (default 0, never)
+//  corruptEvery     every Nth reply has its final CR replaced (default 0)
+//  silentEvery      every Nth command gets no reply at all (default 0)
+//  strayEvery       every Nth reply has a stray carriage return in front of it (default 0)
+
+#define EMULATOR_DESCRIPTION "Sutter Instrument ROE-200"
+#define maxEmulated 16				//Most controllers the emulator can stand in for
+#define emulatedDrives 2
+#define emulatorQueueSize 256		//Bytes of reply an emulated controller can have waiting
+#define emulatorStepsPerUm 16		//Steps per um of travel (62.5 nm steps)
+
+typedef std::chrono::steady_clock emulatorClock;
+
+typedef struct {
+	int devices;
+	int latencyUs;
+	int latencyTimer;
+	double stepsPerSecond;
+	int dropEvery;
+	int corruptEvery;
+	int silentEvery;
+	int strayEvery;
+} emulatorOptions;
+
+// One emulated controller
+struct emulatedController {
+	char serial[16];
+	int open;
+	std::mutex lock;
+	std::condition_variable replied;
+	//Link settings as the host configured them
+	ULONG readTimeout;
+	ULONG writeTimeout;
+	UCHAR latencyTimer;
+	//Controller state
+	int drive;									// selected drive
+	int position[emulatedDrives+1][3];			// where each drive is (or will be, once busyUntil passes)
+	int speed[emulatedDrives+1];				// um/s from the last velocity command, 0 = none yet
+	emulatorClock::time_point busyUntil;		// end of the move in progress
+	unsigned commandCount;						// for fault injection
+	unsigned replyCount;
+	//Bytes the host sent that don't make a whole command yet
+	unsigned char input[16];
+	int inputLength;
+	//Reply bytes and when each becomes readable
+	unsigned char output[emulatorQueueSize];
+	emulatorClock::time_point outputReady[emulatorQueueSize];
+	int outputHead;
+	int outputLength;
+};
+
+extern const manipTransportOps emulatorOps;
+
+static emulatorOptions options = { 2, 250, 1, 40000, 0, 0, 0, 0 };
+static emulatedController controllers[maxEmulated];
+
+//##############################################################################
+//##################OPTIONS#####################################################
+//##############################################################################
+
+FT_STATUS emulatorSetOptions(const char *text)
+{
+	emulatorOptions parsed = { 2, 250, 1, 40000, 0, 0, 0, 0 };
+	char copy[1024];
+	snprintf(copy, sizeof(copy), "%s", text != NULL ? text : "");
+	for (char *item = strtok(copy, ";"); item != NULL; item = strtok(NULL, ";")) {
+		char *equals = strchr(item, '=');
+		if (equals == NULL)
+			return FT_INVALID_PARAMETER;
+		*equals = 0;
+		double value = atof(equals + 1);
+		if (strcmp(item, "devices") == 0 && value >= 0 && value <= maxEmulated)
+			parsed.devices = (int)value;
+		else if (strcmp(item, "latencyUs") == 0 && value >= 0)
+			parsed.latencyUs = (int)value;
+		else if (strcmp(item, "latencyTimer") == 0)
+			parsed.latencyTimer = (value != 0);
+		else if (strcmp(item, "stepsPerSecond") == 0 && value > 0)
+			parsed.stepsPerSecond = value;
+		else if (strcmp(item, "dropEvery") == 0 && value >= 0)
+			parsed.dropEvery = (int)value;
+		else if (strcmp(item, "corruptEvery") == 0 && value >= 0)
+			parsed.corruptEvery = (int)value;
+		else if (strcmp(item, "silentEvery") == 0 && value >= 0)
+			parsed.silentEvery = (int)value;
+		else if (strcmp(item, "strayEvery") == 0 && value >= 0)
+			parsed.strayEvery = (int)value;
+		else
+			return FT_INVALID_PARAMETER;
+	}
+	options = parsed;
+	return FT_OK;
+}
+
+//##############################################################################
+//##################THE CONTROLLER##############################################
+//##############################################################################
+
+// Queue a reply, applying whatever faults are due (lock held)
+static void emulatorReply(emulatedController *controller, const unsigned char *reply, int length, emulatorClock::time_point sent)
+{
+	controller->replyCount++;
+	unsigned char bytes[17];
+	memcpy(bytes, reply, length);
+	if (options.dropEvery > 0 && controller->replyCount % options.dropEvery == 0)
+		length--;
+	else if (options.corruptEvery > 0 && controller->replyCount % options.corruptEvery == 0)
+		bytes[length-1] = 0x00;
+	else if (options.strayEvery > 0 && controller->replyCount % options.strayEvery == 0) {
+		memmove(bytes + 1, bytes, length);
+		bytes[0] = 0x0D;
+		length++;
+	}
+
+	//The FTDI chip sends a short packet once its latency timer runs out
+	emulatorClock::time_point ready = sent + std::chrono::microseconds(options.latencyUs);
+	if (options.latencyTimer)
+		ready += std::chrono::milliseconds(controller->latencyTimer);
+	for (int i=0; i<length && controller->outputLength < emulatorQueueSize; i++) {
+		int slot = (controller->outputHead + controller->outputLength) % emulatorQueueSize;
+		controller->output[slot] = bytes[i];
+		controller->outputReady[slot] = ready;
+		controller->outputLength++;
+	}
+	controller->replied.notify_all();
+}
+
+// Carry out every whole command in the input buffer (lock held)
+static void emulatorRun(emulatedController *controller)
+{
+	for (;;) {
+		if (controller->inputLength == 0)
+			return;
+		int needed = (int)commandSize(controller->input[0]);
+		if (controller->inputLength < needed)
+			return;
+
+		//A command starts once the previous move is over
+		emulatorClock::time_point start = emulatorClock::now();
+		if (controller->busyUntil > start)
+			start = controller->busyUntil;
+		int silent = (controller->input[0] != protoWake && options.silentEvery > 0 &&
+		              ++controller->commandCount % options.silentEvery == 0);
+
+		if (controller->input[0] == protoDrive) {
+			driveCommand command;
+			memcpy(command.bytes, controller->input, driveCommand::size);
+			int drive = decodeDriveChange(command);
+			if (drive >= 1 && drive <= emulatedDrives)
+				controller->drive = drive;
+			driveReply reply = encodeAck<driveReply>();
+			if (!silent)
+				emulatorReply(controller, reply.bytes, driveReply::size, start);
+		}
+		else if (controller->input[0] == protoPosition) {
+			const int *position = controller->position[controller->drive];
+			positionReply reply = encodePosition(controller->drive, position[0], position[1], position[2]);
+			if (!silent)
+				emulatorReply(controller, reply.bytes, positionReply::size, start);
+		}
+		else if (controller->input[0] == protoMove) {
+			moveCommand command;
+			memcpy(command.bytes, controller->input, moveCommand::size);
+			int *position = controller->position[controller->drive];
+			int target[3];
+			decodeMove(command, &target[0], &target[1], &target[2]);
+			int longest = 0;
+			for (int axis=0; axis<3; axis++) {
+				int distance = abs(target[axis] - position[axis]);
+				if (distance > longest)
+					longest = distance;
+				position[axis] = target[axis];
+			}
+			//All three axes move at once, so the longest one sets the time
+			int speed = controller->speed[controller->drive];
+			double stepsPerSecond = speed > 0 ? (double)speed * emulatorStepsPerUm : options.stepsPerSecond;
+			controller->busyUntil = start + std::chrono::microseconds((long long)(longest / stepsPerSecond * 1e6));
+			moveReply reply = encodeAck<moveReply>();
+			if (!silent)
+				emulatorReply(controller, reply.bytes, moveReply::size, controller->busyUntil);
+		}
+		else if (controller->input[0] == protoVelocity) {
+			velocityCommand command;
+			memcpy(command.bytes, controller->input, velocityCommand::size);
+			int speed, fine;
+			//A frame without its CR is dropped unanswered, as a garbled command would be
+			if (decodeVelocity(command, &speed, &fine)) {
+				if (speed > 0)
+					controller->speed[controller->drive] = speed;
+				velocityReply reply = encodeAck<velocityReply>();
+				if (!silent)
+					emulatorReply(controller, reply.bytes, velocityReply::size, start);
+			}
+		}
+		else if (controller->input[0] == protoStatus) {
+			unsigned char status[protocolStatusDrives] = {0};
+			for (int drive=1; drive<=emulatedDrives && drive<=protocolStatusDrives; drive++)
+				status[drive-1] = 1;
+			statusReply reply = encodeStatus(emulatedDrives, status);
+			if (!silent)
+				emulatorReply(controller, reply.bytes, statusReply::size, start);
+		}
+		//0xEE and anything unknown: nothing to say
+
+		controller->inputLength -= needed;
+		memmove(controller->input, controller->input + needed, controller->inputLength);
+	}
+}
+
+//##############################################################################
+//##################TRANSPORT BACKEND###########################################
+//##############################################################################
+
+static emulatedController* emulatorController(manipTransport *link)
+{
+	return (emulatedController*)link->handle;
+}
+
+static FT_STATUS emulatorScan(manipDeviceInfo *list, DWORD maxDevices, DWORD *numDevs)
+{
+	for (int i=0; i<options.devices && (DWORD)i<maxDevices; i++) {
+		snprintf(list[i].description, sizeof(list[i].description), "%s", EMULATOR_DESCRIPTION);
+		snprintf(list[i].serial, sizeof(list[i].serial), "EMU%04d", i+1);
+		list[i].locationId = i+1;
+		list[i].isOpen = controllers[i].open;
+	}
+	*numDevs = options.devices;
+	return FT_OK;
+}
+
+static FT_STATUS emulatorOpen(manipTransport *link, const char *serial)
+{
+	for (int i=0; i<options.devices; i++) {
+		emulatedController *controller = &controllers[i];
+		char name[16];
+		snprintf(name, sizeof(name), "EMU%04d", i+1);
+		if (strcmp(name, serial) != 0)
+			continue;
+		std::lock_guard<std::mutex> guard(controller->lock);
+		if (controller->open)
+			return FT_DEVICE_NOT_OPENED;
+		//A freshly powered controller: both drives at the origin, drive 1 selected
+		strcpy(controller->serial, name);
+		controller->open = 1;
+		controller->readTimeout = 500;
+		controller->writeTimeout = 500;
+		controller->latencyTimer = 16;
+		controller->drive = 1;
+		memset(controller->position, 0, sizeof(controller->position));
+		memset(controller->speed, 0, sizeof(controller->speed));
+		controller->busyUntil = emulatorClock::now();
+		controller->commandCount = 0;
+		controller->replyCount = 0;
+		controller->inputLength = 0;
+		controller->outputHead = 0;
+		controller->outputLength = 0;
+		link->handle = (FT_HANDLE)controller;
+		return FT_OK;
+	}
+	return FT_DEVICE_NOT_FOUND;
+}
+
+static FT_STATUS emulatorConfigure(manipTransport *link, const manipLinkSettings *settings)
+{
+	emulatedController *controller = emulatorController(link);
+	std::lock_guard<std::mutex> guard(controller->lock);
+	controller->readTimeout = settings->readTimeout;
+	controller->writeTimeout = settings->writeTimeout;
+	controller->latencyTimer = settings->latencyTimer;
+	link->readTimeout = settings->readTimeout;
+	link->writeTimeout = settings->writeTimeout;
+	return FT_OK;
+}
+
+static FT_STATUS emulatorSetReadTimeout(manipTransport *link, ULONG timeout)
+{
+	emulatedController *controller = emulatorController(link);
+	std::lock_guard<std::mutex> guard(controller->lock);
+	controller->readTimeout = timeout;
+	return FT_OK;
+}
+
+static FT_STATUS emulatorWrite(manipTransport *link, const void *buffer, DWORD length, DWORD *written)
+{
+	emulatedController *controller = emulatorController(link);
+	const unsigned char *bytes = (const unsigned char*)buffer;
+	std::lock_guard<std::mutex> guard(controller->lock);
+	for (DWORD i=0; i<length; i++) {
+		if (controller->inputLength == (int)sizeof(controller->input))
+			break;
+		controller->input[controller->inputLength++] = bytes[i];
+		(*written)++;
+		emulatorRun(controller);
+	}
+	return FT_OK;
+}
+
+// Like FT_Read: wait up to the read timeout for length bytes, return what arrived
+static FT_STATUS emulatorRead(manipTransport *link, void *buffer, DWORD length, DWORD *received)
+{
+	emulatedController *controller = emulatorController(link);
+	unsigned char *bytes = (unsigned char*)buffer;
+	std::unique_lock<std::mutex> guard(controller->lock);
+	emulatorClock::time_point deadline = emulatorClock::now() + std::chrono::milliseconds(controller->readTimeout);
+	while (*received < length) {
+		emulatorClock::time_point now = emulatorClock::now();
+		if (controller->outputLength > 0 && controller->outputReady[controller->outputHead] <= now) {
+			bytes[(*received)++] = controller->output[controller->outputHead];
+			controller->outputHead = (controller->outputHead + 1) % emulatorQueueSize;
+			controller->outputLength--;
+			continue;
+		}
+		if (now >= deadline)
+			break;
+		emulatorClock::time_point wake = deadline;
+		if (controller->outputLength > 0 && controller->outputReady[controller->outputHead] < wake)
+			wake = controller->outputReady[controller->outputHead];
+		controller->replied.wait_until(guard, wake);
+	}
+	return FT_OK;
+}
+
+static FT_STATUS emulatorPurge(manipTransport *link, ULONG mask)
+{
+	emulatedController *controller = emulatorController(link);
+	std::lock_guard<std::mutex> guard(controller->lock);
+	if (mask & FT_PURGE_RX) {
+		controller->outputHead = 0;
+		controller->outputLength = 0;
+	}
+	if (mask & FT_PURGE_TX)
+		controller->inputLength = 0;
+	return FT_OK;
+}
+
+static FT_STATUS emulatorQueueStatus(manipTransport *link, DWORD *queued)
+{
+	emulatedController *controller = emulatorController(link);
+	std::lock_guard<std::mutex> guard(controller->lock);
+	emulatorClock::time_point now = emulatorClock::now();
+	*queued = 0;
+	for (int i=0; i<controller->outputLength; i++) {
+		if (controller->outputReady[(controller->outputHead + i) % emulatorQueueSize] <= now)
+			(*queued)++;
+	}
+	return FT_OK;
+}
+
+static void emulatorClose(manipTransport *link)
+{
+	emulatedController *controller = emulatorController(link);
+	std::lock_guard<std::mutex> guard(controller->lock);
+	controller->open = 0;
+	link->handle = NULL;
+}
+
+const manipTransportOps emulatorOps = {
+	"emulator",
+	emulatorScan,
+	emulatorOpen, emulatorConfigure, emulatorWrite, emulatorRead, emulatorPurge, emulatorQueueStatus, emulatorClose,
+	emulatorSetReadTimeout
+};
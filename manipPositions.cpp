@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include "manipPositions.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#endif
+
+//Shared memory position publisher.  See manipPositions.h.
+
+std::atomic<int> positionsEnabled(0);			// checked by positionsRecord on every update
+static std::atomic<int> positionsWriters(0);	// I/O threads in positionsWrite right now
+static std::mutex positionsLock;				// serializes start, stop and positionsSetManips
+static manipPositionsFile *positionsFile = NULL;
+static char positionsName[256];
+
+//##############################################################################
+//##################STARTING AND STOPPING#######################################
+//##############################################################################
+
+static void positionsFinish();
+
+#ifndef _WIN32
+// Whether the segment open on fd is being published by another process that is still
+// running.  One left live by a process that died (or by an older version) can be taken over.
+static int positionsOwned(int fd)
+{
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(manipPositionsFile))
+		return 0;
+	void *view = mmap(NULL, sizeof(manipPositionsFile), PROT_READ, MAP_SHARED, fd, 0);
+	if (view == MAP_FAILED)
+		return 0;
+	const manipPositionsFile *file = (const manipPositionsFile*)view;
+	pid_t pid = (pid_t)file->pid;
+	int owned = memcmp(file->magic, POSITIONS_MAGIC, sizeof(file->magic)) == 0 && file->live.load() &&
+	            pid > 0 && pid != getpid() && (kill(pid, 0) == 0 || errno == EPERM);
+	munmap(view, sizeof(manipPositionsFile));
+	return owned;
+}
+#endif
+
+FT_STATUS positionsStart(const char *name)
+{
+#ifdef _WIN32
+	return FT_DEVICE_NOT_OPENED;
+#else
+	if (name == NULL || name[0] != '/' || strlen(name) >= sizeof(positionsName))
+		return FT_INVALID_PARAMETER;
+	std::lock_guard<std::mutex> guard(positionsLock);
+	positionsFinish();
+	//Readable by every local user, so acquisition programs needn't run as us
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return FT_IO_ERROR;
+	if (positionsOwned(fd)) {
+		close(fd);
+		return FT_DEVICE_NOT_OPENED;
+	}
+	fchmod(fd, 0644);
+	void *view = MAP_FAILED;
+	if (ftruncate(fd, sizeof(manipPositionsFile)) == 0)
+		view = mmap(NULL, sizeof(manipPositionsFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED) {
+		shm_unlink(name);
+		return FT_IO_ERROR;
+	}
+	//A segment left by an earlier run may still be mapped by readers: zeroing every seq
+	//tells them its positions are gone, and touches every page before the I/O threads write
+	memset(view, 0, sizeof(manipPositionsFile));
+	positionsFile = (manipPositionsFile*)view;
+	memcpy(positionsFile->magic, POSITIONS_MAGIC, sizeof(positionsFile->magic));
+	positionsFile->version = POSITIONS_VERSION;
+	positionsFile->slotSize = sizeof(manipPositionSlot);
+	positionsFile->maxManips = positionsMaxManips;
+	positionsFile->maxDrives = positionsMaxDrives;
+	positionsFile->numManips.store(-1);
+	positionsFile->pid = (uint32_t)getpid();
+	positionsFile->live.store(1);
+	snprintf(positionsName, sizeof(positionsName), "%s", name);
+	positionsEnabled.store(1);
+	return FT_OK;
+#endif
+}
+
+void positionsStop()
+{
+	std::lock_guard<std::mutex> guard(positionsLock);
+	positionsFinish();
+}
+
+// Stop publishing, if we are (under positionsLock).  Readers that still have the segment
+// mapped keep the last positions, with live cleared.
+static void positionsFinish()
+{
+#ifndef _WIN32
+	if (positionsFile == NULL)
+		return;
+	//Nobody starts an update once positionsEnabled is clear; wait out the ones already going
+	positionsEnabled.store(0);
+	while (positionsWriters.load() != 0)
+		std::this_thread::yield();
+	positionsFile->live.store(0);
+	munmap(positionsFile, sizeof(manipPositionsFile));
+	shm_unlink(positionsName);
+	positionsFile = NULL;
+#endif
+}
+
+void positionsSetManips(int numManips, const char *const *serials)
+{
+	std::lock_guard<std::mutex> guard(positionsLock);
+	if (positionsFile == NULL)
+		return;
+	for (int manip=0; manip<positionsMaxManips; manip++) {
+		manipPositionsManip *entry = &positionsFile->manips[manip];
+		if (manip < numManips)
+			snprintf(entry->serial, sizeof(entry->serial), "%s", serials[manip]);
+		else
+			memset(entry->serial, 0, sizeof(entry->serial));
+	}
+	positionsFile->numManips.store(numManips);
+}
+
+//##############################################################################
+//##################PUBLISHING##################################################
+//##############################################################################
+
+// Called by a manipulator's I/O thread (through positionsRecord) while publishing is on
+void positionsWrite(int manip, int drive, const int *position)
+{
+	if (manip < 0 || manip >= positionsMaxManips || drive < 1 || drive > positionsMaxDrives)
+		return;
+	positionsWriters.fetch_add(1);
+	if (!positionsEnabled.load()) {
+		positionsWriters.fetch_sub(1);
+		return;
+	}
+	uint64_t monotonicNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+	uint64_t unixNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	manipPositionSlot *slot = &positionsFile->manips[manip].drives[drive-1];
+	uint32_t seq = slot->seq.load(std::memory_order_relaxed);
+	slot->seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot->x.store(position[0], std::memory_order_relaxed);
+	slot->y.store(position[1], std::memory_order_relaxed);
+	slot->z.store(position[2], std::memory_order_relaxed);
+	slot->monotonicNs.store(monotonicNs, std::memory_order_relaxed);
+	slot->unixNs.store(unixNs, std::memory_order_relaxed);
+	slot->seq.store(seq + 2, std::memory_order_release);
+	positionsWriters.fetch_sub(1);
+}
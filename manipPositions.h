@@ -0,0 +1,180 @@
+#ifndef MANIP_POSITIONS_H
+#define MANIP_POSITIONS_H
+
+//Live positions for other programs: the latest x, y, z of every drive of every manipulator,
+//published in a POSIX shared memory segment that any number of local processes (camera
+//acquisition, electrophysiology, ...) can map read-only and poll without going near MATLAB
+//or the USB bus.
+//
+//Each drive has a 64 byte slot, written only by its manipulator's I/O thread on every good
+//'C' reply and every completed move, under a sequence lock: seq is odd while the slot is
+//being written and goes up by two with each update.  Readers take no lock and never hold up
+//the writer; positionsRead() copies a slot and tries again only if it caught a write in
+//progress, which at a few hundred updates a second almost never happens.
+//
+//A reader needs nothing but this header, from C (gcc or clang) or from C++ with
+//MANIP_POSITIONS_READER defined:
+//  int fd = shm_open(POSITIONS_DEFAULT_NAME, O_RDONLY, 0);
+//  const manipPositionsFile *file = (const manipPositionsFile*)mmap(NULL, sizeof(manipPositionsFile), PROT_READ, MAP_SHARED, fd, 0);
+//  manipLivePosition p;
+//  if (positionsRead(&file->manips[0].drives[0], &p))		//manipulator 0, drive 1
+//      ... p.x, p.y, p.z (steps), p.monotonicNs ...
+//positionsLive() and positionsCount() read the segment's live flag and manipulator count.
+//
+//The segment belongs to one publisher at a time: positionsStart() refuses a name whose
+//segment is live and whose pid is still running, and takes over one left by a process that
+//has gone.
+
+#include <stdint.h>
+#ifdef __cplusplus
+#include <atomic>
+#define positionsAtomic(type) std::atomic<type>
+#else
+//C sees the same layout as plain fields, read with the compiler's atomic builtins
+#define positionsAtomic(type) type
+#endif
+
+#define POSITIONS_MAGIC "MANPPOS1"
+#define POSITIONS_VERSION 1
+#define POSITIONS_DEFAULT_NAME "/manipControl.positions"
+#define positionsMaxManips 16			//Manipulators the segment has room for (MANIP_MAX_MANIPS)
+#define positionsMaxDrives 2			//Drives per manipulator (MANIP_MAX_DRIVES)
+#define positionsReadTries 1000			//Copies positionsRead attempts before giving up on a slot
+
+// One drive's latest position
+typedef struct {
+	positionsAtomic(uint32_t) seq;				// odd while being written, 0 if never written
+	positionsAtomic(int32_t) x, y, z;			// steps
+	positionsAtomic(uint64_t) monotonicNs;		// when it was read or reached, CLOCK_MONOTONIC
+	positionsAtomic(uint64_t) unixNs;			// and the same on the wall clock
+	uint8_t pad[32];
+} manipPositionSlot;
+
+typedef struct {
+	char serial[64];							// empty if no manipulator has this number
+	manipPositionSlot drives[positionsMaxDrives];	// drive 1 first
+} manipPositionsManip;
+
+// The whole segment
+typedef struct {
+	char magic[8];								// POSITIONS_MAGIC
+	uint32_t version;
+	uint32_t slotSize;							// sizeof(manipPositionSlot)
+	uint32_t maxManips;
+	uint32_t maxDrives;
+	positionsAtomic(int32_t) numManips;			// manipulators open, -1 while not initialized
+	positionsAtomic(int32_t) live;				// 0 once the publisher has stopped: nothing will change any more
+	uint32_t pid;								// process publishing
+	uint8_t pad[28];
+	manipPositionsManip manips[positionsMaxManips];
+} manipPositionsFile;
+
+#ifdef __cplusplus
+static_assert(sizeof(manipPositionSlot) == 64, "a slot is one cache line");
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) && sizeof(std::atomic<int32_t>) == sizeof(int32_t),
+              "C readers see the atomics as plain fields");
+#endif
+
+// What positionsRead copies out of a slot
+typedef struct {
+	int x, y, z;
+	uint64_t monotonicNs;
+	uint64_t unixNs;
+	uint32_t updates;							// times the slot has been written
+} manipLivePosition;
+
+// Copy a slot consistently.  0 if it has never been written, or if it stays mid-write (as it
+// would if the publisher died while writing it).
+#ifdef __cplusplus
+static inline int positionsRead(const manipPositionSlot *slot, manipLivePosition *out)
+{
+	for (int attempt=0; attempt<positionsReadTries; attempt++) {
+		uint32_t before = slot->seq.load(std::memory_order_acquire);
+		if (before == 0)
+			return 0;
+		if (before & 1)
+			continue;
+		out->x = slot->x.load(std::memory_order_relaxed);
+		out->y = slot->y.load(std::memory_order_relaxed);
+		out->z = slot->z.load(std::memory_order_relaxed);
+		out->monotonicNs = slot->monotonicNs.load(std::memory_order_relaxed);
+		out->unixNs = slot->unixNs.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot->seq.load(std::memory_order_relaxed) == before) {
+			out->updates = before / 2;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// 1 while the publisher is running
+static inline int positionsLive(const manipPositionsFile *file)
+{
+	return file->live.load(std::memory_order_acquire);
+}
+
+// Manipulators open, -1 while not initialized
+static inline int positionsCount(const manipPositionsFile *file)
+{
+	return file->numManips.load(std::memory_order_acquire);
+}
+#else
+static inline int positionsRead(const manipPositionSlot *slot, manipLivePosition *out)
+{
+	int attempt;
+	for (attempt=0; attempt<positionsReadTries; attempt++) {
+		uint32_t before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (before == 0)
+			return 0;
+		if (before & 1)
+			continue;
+		out->x = __atomic_load_n(&slot->x, __ATOMIC_RELAXED);
+		out->y = __atomic_load_n(&slot->y, __ATOMIC_RELAXED);
+		out->z = __atomic_load_n(&slot->z, __ATOMIC_RELAXED);
+		out->monotonicNs = __atomic_load_n(&slot->monotonicNs, __ATOMIC_RELAXED);
+		out->unixNs = __atomic_load_n(&slot->unixNs, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == before) {
+			out->updates = before / 2;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static inline int positionsLive(const manipPositionsFile *file)
+{
+	return __atomic_load_n(&file->live, __ATOMIC_ACQUIRE);
+}
+
+static inline int positionsCount(const manipPositionsFile *file)
+{
+	return __atomic_load_n(&file->numManips, __ATOMIC_ACQUIRE);
+}
+#endif
+
+#if defined(__cplusplus) && !defined(MANIP_POSITIONS_READER)
+#include "manipTransport.h"
+
+// Create (or take over) the segment called name and start publishing into it.
+// FT_DEVICE_NOT_OPENED if another running process is publishing under that name.
+FT_STATUS positionsStart(const char *name);
+// Mark the segment as no longer live, unmap it and remove the name
+void positionsStop();
+// Fill in which manipulators there are (numManips -1: not initialized)
+void positionsSetManips(int numManips, const char *const *serials);
+
+extern std::atomic<int> positionsEnabled;
+void positionsWrite(int manip, int drive, const int *position);
+
+// Publish a drive's position if publishing is on (one relaxed load if not).  Only ever
+// called from the manipulator's own I/O thread, so each slot has a single writer.
+inline void positionsRecord(int manip, int drive, const int *position)
+{
+	if (positionsEnabled.load(std::memory_order_relaxed))
+		positionsWrite(manip, drive, position);
+}
+#endif
+
+#endif
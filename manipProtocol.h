@@ -0,0 +1,263 @@
+#ifndef MANIP_PROTOCOL_H
+#define MANIP_PROTOCOL_H
+
+//Wire format of the controller commands and replies.
+//
+//Every frame is a struct holding a byte array of exactly its length, so a command is encoded
+//straight into a stack buffer and a reply read straight into one, and the length given to the
+//transport is the frame's own.  Fields are written and read through templates that take their
+//offset as a parameter, so a field that doesn't fit its frame fails to compile instead of
+//overrunning it.  Everything is inline (the lookups constexpr): encoding a move is thirteen
+//byte stores.
+//
+//  command        sent                                   reply
+//  wake           0xEE                                   none
+//  drive change   'I' drive                              CR
+//  position       'C'                                    drive x y z CR
+//  move           'M' x y z                              CR, once the move is over
+//  velocity       'V' speed CR                           CR
+//  drive status   'U'                                    drives s1 s2 s3 s4 CR
+//
+//x, y and z are 32 bit step counts and speed a 16 bit value, all least significant byte
+//first.  The velocity frame is the MP-285 one: bits 0-14 are the speed and bit 15 selects
+//the fine resolution.  The drive status reply gives the number of drives connected and one
+//status byte per drive (0 = none).
+
+#include <stdint.h>
+
+#define protocolCR 0x0D				//Ends every reply (and the velocity command)
+#define protocolMaxSpeed 0x7FFF		//Largest speed a velocity command can carry
+#define protocolFineBit 0x8000		//Velocity command bit selecting the fine resolution
+#define protocolStatusDrives 4		//Drive status bytes in a 'U' reply
+
+// First byte of each command
+enum { protoWake = 0xEE, protoDrive = 'I', protoPosition = 'C', protoMove = 'M', protoVelocity = 'V', protoStatus = 'U' };
+
+// A command frame: Op is its first byte, N its length
+template<unsigned char Op, unsigned N>
+struct commandFrame {
+	enum { opcode = Op, size = N };
+	unsigned char bytes[N];
+};
+
+// A reply frame; Op is the command it answers
+template<unsigned char Op, unsigned N>
+struct replyFrame {
+	enum { opcode = Op, size = N };
+	unsigned char bytes[N];
+};
+
+typedef commandFrame<protoWake, 1> wakeCommand;
+typedef commandFrame<protoDrive, 2> driveCommand;
+typedef commandFrame<protoPosition, 1> positionCommand;
+typedef commandFrame<protoMove, 13> moveCommand;
+typedef commandFrame<protoVelocity, 4> velocityCommand;
+typedef commandFrame<protoStatus, 1> statusCommand;
+
+typedef replyFrame<protoDrive, 1> driveReply;
+typedef replyFrame<protoPosition, 14> positionReply;
+typedef replyFrame<protoMove, 1> moveReply;
+typedef replyFrame<protoVelocity, 1> velocityReply;
+typedef replyFrame<protoStatus, 2 + protocolStatusDrives> statusReply;
+
+static_assert(sizeof(moveCommand) == moveCommand::size && sizeof(positionReply) == positionReply::size,
+              "frames must be exactly their bytes");
+static_assert(positionReply::size == 14 && moveCommand::size == 13, "'C' replies and 'M' commands are fixed by the controller");
+
+// Length of the command starting with op (1 for anything unknown), for whoever has to split a
+// byte stream into commands
+constexpr unsigned commandSize(unsigned char op)
+{
+	return op == protoDrive ? driveCommand::size :
+	       op == protoMove ? moveCommand::size :
+	       op == protoVelocity ? velocityCommand::size : 1;
+}
+
+//##############################################################################
+//#####################FIELDS####################################################
+//##############################################################################
+
+template<unsigned Offset, class Frame>
+inline void putByte(Frame &frame, unsigned value)
+{
+	static_assert(Offset < Frame::size, "field runs past the end of the frame");
+	frame.bytes[Offset] = (unsigned char)value;
+}
+
+template<unsigned Offset, class Frame>
+inline void putShort(Frame &frame, unsigned value)
+{
+	static_assert(Offset + 2 <= Frame::size, "field runs past the end of the frame");
+	frame.bytes[Offset] = (unsigned char)value;
+	frame.bytes[Offset+1] = (unsigned char)(value >> 8);
+}
+
+template<unsigned Offset, class Frame>
+inline void putLong(Frame &frame, int value)
+{
+	static_assert(Offset + 4 <= Frame::size, "field runs past the end of the frame");
+	uint32_t bits = (uint32_t)value;
+	frame.bytes[Offset] = (unsigned char)bits;
+	frame.bytes[Offset+1] = (unsigned char)(bits >> 8);
+	frame.bytes[Offset+2] = (unsigned char)(bits >> 16);
+	frame.bytes[Offset+3] = (unsigned char)(bits >> 24);
+}
+
+template<unsigned Offset, class Frame>
+constexpr unsigned getShort(const Frame &frame)
+{
+	static_assert(Offset + 2 <= Frame::size, "field runs past the end of the frame");
+	return (unsigned)frame.bytes[Offset] | ((unsigned)frame.bytes[Offset+1] << 8);
+}
+
+template<unsigned Offset, class Frame>
+constexpr int getLong(const Frame &frame)
+{
+	static_assert(Offset + 4 <= Frame::size, "field runs past the end of the frame");
+	return (int)((uint32_t)frame.bytes[Offset] | ((uint32_t)frame.bytes[Offset+1] << 8) |
+	             ((uint32_t)frame.bytes[Offset+2] << 16) | ((uint32_t)frame.bytes[Offset+3] << 24));
+}
+
+// Whether a reply ends in its carriage return
+template<class Reply>
+constexpr bool replyTerminated(const Reply &reply)
+{
+	return reply.bytes[Reply::size-1] == protocolCR;
+}
+
+//##############################################################################
+//#####################COMMANDS##################################################
+//##############################################################################
+
+inline wakeCommand encodeWake()
+{
+	wakeCommand frame;
+	putByte<0>(frame, protoWake);
+	return frame;
+}
+
+inline driveCommand encodeDriveChange(int drive)
+{
+	driveCommand frame;
+	putByte<0>(frame, protoDrive);
+	putByte<1>(frame, (unsigned)drive);
+	return frame;
+}
+
+inline positionCommand encodePositionQuery()
+{
+	positionCommand frame;
+	putByte<0>(frame, protoPosition);
+	return frame;
+}
+
+inline moveCommand encodeMove(int x, int y, int z)
+{
+	moveCommand frame;
+	putByte<0>(frame, protoMove);
+	putLong<1>(frame, x);
+	putLong<5>(frame, y);
+	putLong<9>(frame, z);
+	return frame;
+}
+
+// speed is clamped to 0..protocolMaxSpeed
+inline velocityCommand encodeVelocity(int speed, int fine)
+{
+	velocityCommand frame;
+	unsigned value = speed < 0 ? 0 : (speed > protocolMaxSpeed ? protocolMaxSpeed : (unsigned)speed);
+	putByte<0>(frame, protoVelocity);
+	putShort<1>(frame, value | (fine ? protocolFineBit : 0));
+	putByte<3>(frame, protocolCR);
+	return frame;
+}
+
+inline statusCommand encodeStatusQuery()
+{
+	statusCommand frame;
+	putByte<0>(frame, protoStatus);
+	return frame;
+}
+
+inline int decodeDriveChange(const driveCommand &frame)
+{
+	return frame.bytes[1];
+}
+
+inline void decodeMove(const moveCommand &frame, int *x, int *y, int *z)
+{
+	*x = getLong<1>(frame);
+	*y = getLong<5>(frame);
+	*z = getLong<9>(frame);
+}
+
+// false if the frame doesn't end in its carriage return
+inline bool decodeVelocity(const velocityCommand &frame, int *speed, int *fine)
+{
+	unsigned value = getShort<1>(frame);
+	*speed = (int)(value & protocolMaxSpeed);
+	*fine = (value & protocolFineBit) != 0;
+	return frame.bytes[3] == protocolCR;
+}
+
+//##############################################################################
+//#####################REPLIES###################################################
+//##############################################################################
+
+// The one byte replies ('I', 'M' and 'V')
+template<class Reply>
+inline Reply encodeAck()
+{
+	static_assert(Reply::size == 1, "only single byte replies are a bare carriage return");
+	Reply frame;
+	putByte<0>(frame, protocolCR);
+	return frame;
+}
+
+// Each drive moves in 62.5 nm steps, so positions are in steps...NOT MICRONS! OR NANOMETERS!
+// (0 to 400e3 steps corresponds to 0 to 25 mm)
+inline positionReply encodePosition(int drive, int x, int y, int z)
+{
+	positionReply frame;
+	putByte<0>(frame, (unsigned)drive);
+	putLong<1>(frame, x);
+	putLong<5>(frame, y);
+	putLong<9>(frame, z);
+	putByte<13>(frame, protocolCR);
+	return frame;
+}
+
+// Whether a 'C' reply is framed as coming from drive: the drive number (the "new line
+// garbage" byte of old) first and the carriage return last
+constexpr bool positionFramed(const positionReply &frame, int drive)
+{
+	return frame.bytes[0] == (unsigned char)drive && replyTerminated(frame);
+}
+
+inline void decodePosition(const positionReply &frame, int *x, int *y, int *z)
+{
+	*x = getLong<1>(frame);
+	*y = getLong<5>(frame);
+	*z = getLong<9>(frame);
+}
+
+// status has protocolStatusDrives entries, 0 for a drive that isn't there
+inline statusReply encodeStatus(int drives, const unsigned char *status)
+{
+	statusReply frame;
+	putByte<0>(frame, (unsigned)drives);
+	for (int i=0; i<protocolStatusDrives; i++)
+		frame.bytes[1+i] = status[i];
+	putByte<1 + protocolStatusDrives>(frame, protocolCR);
+	return frame;
+}
+
+// Returns the number of drives connected, or -1 if the reply isn't terminated
+inline int decodeStatus(const statusReply &frame, unsigned char *status)
+{
+	for (int i=0; i<protocolStatusDrives; i++)
+		status[i] = frame.bytes[1+i];
+	return replyTerminated(frame) ? frame.bytes[0] : -1;
+}
+
+#endif
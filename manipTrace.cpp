@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include "manipTrace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//Transaction trace recorder.  See manipTrace.h.
+
+std::atomic<int> traceEnabled(0);				// checked by traceRecord on every transaction
+static std::atomic<int> traceWriters(0);		// I/O threads in traceAppend right now
+static std::atomic<unsigned long long> traceNext(0);
+static std::mutex traceLock;					// serializes traceStart/traceStop
+static manipTraceHeader *traceHeader = NULL;	// start of the mapping
+static manipTraceRecord *traceRecords = NULL;
+static unsigned traceCapacity = 0;
+static size_t traceSize = 0;					// bytes mapped
+static std::chrono::steady_clock::time_point traceStartTime;
+#ifdef _WIN32
+static HANDLE traceFile = INVALID_HANDLE_VALUE;
+static HANDLE traceMapping = NULL;
+#else
+static int traceFd = -1;
+#endif
+
+//##############################################################################
+//##################MAPPING THE FILE############################################
+//##############################################################################
+
+static void* traceMap(const char *path, size_t size)
+{
+#ifdef _WIN32
+	traceFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (traceFile == INVALID_HANDLE_VALUE)
+		return NULL;
+	traceMapping = CreateFileMappingA(traceFile, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)(size & 0xFFFFFFFF), NULL);
+	void *view = (traceMapping != NULL) ? MapViewOfFile(traceMapping, FILE_MAP_WRITE, 0, 0, size) : NULL;
+	if (view == NULL) {
+		if (traceMapping != NULL)
+			CloseHandle(traceMapping);
+		CloseHandle(traceFile);
+		traceMapping = NULL;
+		traceFile = INVALID_HANDLE_VALUE;
+	}
+	return view;
+#else
+	traceFd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (traceFd < 0)
+		return NULL;
+	void *view = MAP_FAILED;
+	if (ftruncate(traceFd, (off_t)size) == 0)
+		view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, traceFd, 0);
+	if (view == MAP_FAILED) {
+		close(traceFd);
+		traceFd = -1;
+		return NULL;
+	}
+	return view;
+#endif
+}
+
+static void traceUnmap(void *view, size_t size)
+{
+#ifdef _WIN32
+	FlushViewOfFile(view, 0);
+	UnmapViewOfFile(view);
+	CloseHandle(traceMapping);
+	CloseHandle(traceFile);
+	traceMapping = NULL;
+	traceFile = INVALID_HANDLE_VALUE;
+#else
+	munmap(view, size);
+	close(traceFd);
+	traceFd = -1;
+#endif
+}
+
+//##############################################################################
+//##################STARTING AND STOPPING#######################################
+//##############################################################################
+
+static unsigned long long traceFinish();
+
+FT_STATUS traceStart(const char *path, unsigned capacity)
+{
+	if (capacity == 0)
+		return FT_INVALID_PARAMETER;
+	std::lock_guard<std::mutex> guard(traceLock);
+	traceFinish();
+	size_t size = sizeof(manipTraceHeader) + (size_t)capacity * sizeof(manipTraceRecord);
+	void *view = traceMap(path, size);
+	if (view == NULL)
+		return FT_IO_ERROR;
+	//Touch every page now, so the I/O threads never take a page fault on a fresh one
+	memset(view, 0, size);
+	traceHeader = (manipTraceHeader*)view;
+	traceRecords = (manipTraceRecord*)(traceHeader + 1);
+	traceCapacity = capacity;
+	traceSize = size;
+	memcpy(traceHeader->magic, TRACE_MAGIC, sizeof(traceHeader->magic));
+	traceHeader->version = TRACE_VERSION;
+	traceHeader->recordSize = sizeof(manipTraceRecord);
+	traceHeader->capacity = capacity;
+	traceHeader->startUnixNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	traceNext = 0;
+	traceStartTime = std::chrono::steady_clock::now();
+	traceEnabled.store(1);
+	return FT_OK;
+}
+
+unsigned long long traceStop()
+{
+	std::lock_guard<std::mutex> guard(traceLock);
+	return traceFinish();
+}
+
+// Stop the trace that is running, if any (under traceLock)
+static unsigned long long traceFinish()
+{
+	if (traceHeader == NULL)
+		return 0;
+	//Nobody starts a record once traceEnabled is clear; wait out the ones already going
+	traceEnabled.store(0);
+	while (traceWriters.load() != 0)
+		std::this_thread::yield();
+	unsigned long long written = traceNext.load();
+	traceHeader->written = written;
+	traceUnmap(traceHeader, traceSize);
+	traceHeader = NULL;
+	traceRecords = NULL;
+	return written;
+}
+
+unsigned long long traceCount()
+{
+	return traceNext.load(std::memory_order_relaxed);
+}
+
+//##############################################################################
+//##################RECORDING###################################################
+//##############################################################################
+
+// Called by the I/O threads (through traceRecord) while a trace is running.  Each record gets
+// its own slot from traceNext, so threads never write the same one (unless one lapses the
+// whole ring while another is mid-record, which would take a very small ring).
+void traceAppend(int device, int op, DWORD requested, DWORD transferred, FT_STATUS status,
+                 const void *payload, DWORD payloadLength, std::chrono::steady_clock::time_point start)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	traceWriters.fetch_add(1);
+	if (!traceEnabled.load()) {
+		traceWriters.fetch_sub(1);
+		return;
+	}
+	unsigned long long n = traceNext.fetch_add(1, std::memory_order_relaxed);
+	manipTraceRecord *record = &traceRecords[n % traceCapacity];
+	record->seq = 0;
+	std::atomic_thread_fence(std::memory_order_release);
+	long long startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(start - traceStartTime).count();
+	long long durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+	record->timeNs = startNs > 0 ? (uint64_t)startNs : 0;
+	record->durationNs = durationNs < 0 ? 0 : (durationNs > 0xFFFFFFFFLL ? 0xFFFFFFFFu : (uint32_t)durationNs);
+	record->status = (uint32_t)status;
+	record->requested = (uint32_t)requested;
+	record->transferred = (uint32_t)transferred;
+	record->device = (uint16_t)device;
+	record->op = (uint8_t)op;
+	if (payload == NULL)
+		payloadLength = 0;
+	if (payloadLength > traceMaxPayload)
+		payloadLength = traceMaxPayload;
+	record->payloadLength = (uint8_t)payloadLength;
+	if (payloadLength > 0)
+		memcpy(record->payload, payload, payloadLength);
+	std::atomic_thread_fence(std::memory_order_release);
+	record->seq = n + 1;
+	traceWriters.fetch_sub(1);
+}
@@ -0,0 +1,80 @@
+#ifndef MANIP_TRACE_H
+#define MANIP_TRACE_H
+
+//Transaction trace: an opt-in record of every write, read and purge sent to the controllers
+//(and every open and close), for finding out what really happened when a rig shows the odd
+//slow move.
+//
+//Records go into a fixed size ring in a memory-mapped file, so tracing costs a memcpy into
+//the page cache per transaction and nothing is allocated on the I/O threads.  When the ring
+//is full the oldest records are overwritten.  The file stays readable if the program dies;
+//manipTraceDecode turns it into CSV.
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+#define TRACE_MAGIC "MANPTRC1"
+#define TRACE_VERSION 1
+#define traceMaxPayload 28			//Bytes of each transfer kept (a 'C' reply is 14, an 'M' 13)
+
+// What a record is of
+enum { traceOpen = 1, traceWrite, traceRead, tracePurge, traceClose };
+
+// File header, followed by capacity records
+typedef struct {
+	char magic[8];								// TRACE_MAGIC
+	uint32_t version;
+	uint32_t recordSize;						// sizeof(manipTraceRecord)
+	uint32_t capacity;							// records in the ring
+	uint32_t reserved;
+	uint64_t startUnixNs;						// wall clock time the trace started
+	uint64_t written;							// records written, set when the trace stops (0 if it never did)
+	uint8_t pad[24];
+} manipTraceHeader;
+
+// One transaction (64 bytes).  Record n goes in slot n % capacity; seq is n+1 and is written
+// last, so a slot with seq 0 is empty or was being written when the program stopped.
+typedef struct {
+	uint64_t seq;
+	uint64_t timeNs;							// start, since the trace started
+	uint32_t durationNs;						// saturates at about 4.3 s
+	uint32_t status;							// FT_STATUS
+	uint32_t requested;							// bytes asked for (purge: the FT_PURGE mask)
+	uint32_t transferred;						// bytes actually written or read
+	uint16_t device;							// device number
+	uint8_t op;									// traceOpen, traceWrite, ...
+	uint8_t payloadLength;						// bytes of payload kept
+	uint8_t payload[traceMaxPayload];			// data written or read (open: the serial number)
+} manipTraceRecord;
+
+static inline const char* traceOpName(int op)
+{
+	static const char *names[] = { "unknown", "open", "write", "read", "purge", "close" };
+	return (op >= traceOpen && op <= traceClose) ? names[op] : names[0];
+}
+
+#ifndef MANIP_TRACE_DECODER
+#include "manipTransport.h"
+
+// Start tracing into path, with room for capacity records (the file is created or
+// truncated).  Stops any trace already running.
+FT_STATUS traceStart(const char *path, unsigned capacity);
+// Stop tracing and close the file; returns the number of records written
+unsigned long long traceStop();
+unsigned long long traceCount();
+
+extern std::atomic<int> traceEnabled;
+void traceAppend(int device, int op, DWORD requested, DWORD transferred, FT_STATUS status,
+                 const void *payload, DWORD payloadLength, std::chrono::steady_clock::time_point start);
+
+// Record one transaction if a trace is running (one relaxed load if not)
+inline void traceRecord(int device, int op, DWORD requested, DWORD transferred, FT_STATUS status,
+                        const void *payload, DWORD payloadLength, std::chrono::steady_clock::time_point start)
+{
+	if (traceEnabled.load(std::memory_order_relaxed))
+		traceAppend(device, op, requested, transferred, status, payload, payloadLength, start);
+}
+#endif
+
+#endif
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define MANIP_TRACE_DECODER
+#include "manipTrace.h"
+
+//Turns a trace file written by manipControl('trace',...) into CSV, one row per transaction in the
+//order they finished:
+//  seq,time_ms,duration_ms,device,op,requested,transferred,status,payload
+//time_ms is from the start of the trace and payload is the bytes in hex.  Build with e.g.
+//  g++ -O2 manipTraceDecode.cpp -o manipTraceDecode
+//and run as
+//  manipTraceDecode trace.bin > trace.csv
+
+static int compareSeq(const void *a, const void *b)
+{
+	uint64_t sa = ((const manipTraceRecord*)a)->seq;
+	uint64_t sb = ((const manipTraceRecord*)b)->seq;
+	return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s traceFile > trace.csv\n", argv[0]);
+		return 2;
+	}
+	FILE *file = fopen(argv[1], "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Error. Can't open %s\n", argv[1]);
+		return 1;
+	}
+	manipTraceHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+		fprintf(stderr, "Error. %s isn't a manipControl trace\n", argv[1]);
+		fclose(file);
+		return 1;
+	}
+	if (header.version != TRACE_VERSION || header.recordSize != sizeof(manipTraceRecord)) {
+		fprintf(stderr, "Error. %s is trace version %u (record size %u); this decoder reads version %u\n",
+		        argv[1], header.version, header.recordSize, TRACE_VERSION);
+		fclose(file);
+		return 1;
+	}
+
+	//Read the whole ring and keep the filled slots, in the order they were written
+	manipTraceRecord *records = (manipTraceRecord*)malloc((size_t)header.capacity * sizeof(manipTraceRecord));
+	if (records == NULL) {
+		fprintf(stderr, "Error. Out of memory for %u records\n", header.capacity);
+		fclose(file);
+		return 1;
+	}
+	size_t numRead = fread(records, sizeof(manipTraceRecord), header.capacity, file);
+	fclose(file);
+	size_t numRecords = 0;
+	for (size_t i=0; i<numRead; i++) {
+		if (records[i].seq != 0)
+			records[numRecords++] = records[i];
+	}
+	qsort(records, numRecords, sizeof(manipTraceRecord), compareSeq);
+
+	printf("seq,time_ms,duration_ms,device,op,requested,transferred,status,payload\n");
+	for (size_t i=0; i<numRecords; i++) {
+		const manipTraceRecord *record = &records[i];
+		char payload[2*traceMaxPayload+1];
+		unsigned length = record->payloadLength <= traceMaxPayload ? record->payloadLength : traceMaxPayload;
+		for (unsigned k=0; k<length; k++)
+			sprintf(&payload[2*k], "%02X", record->payload[k]);
+		payload[2*length] = 0;
+		printf("%llu,%.6f,%.6f,%u,%s,%u,%u,%u,%s\n", (unsigned long long)record->seq,
+		       record->timeNs / 1e6, record->durationNs / 1e6, (unsigned)record->device,
+		       traceOpName(record->op), record->requested, record->transferred, record->status, payload);
+	}
+	//The ring overwrites the oldest records once it is full.  If the program died before
+	//stopping the trace, the newest record's seq says how many were written.
+	unsigned long long written = header.written;
+	if (numRecords > 0 && records[numRecords-1].seq > written)
+		written = records[numRecords-1].seq;
+	unsigned long long lost = written > numRecords ? written - numRecords : 0;
+	fprintf(stderr, "%zu records decoded", numRecords);
+	if (lost > 0)
+		fprintf(stderr, ", %llu older ones overwritten", lost);
+	fprintf(stderr, "\n");
+	free(records);
+	return 0;
+}
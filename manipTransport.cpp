@@ -0,0 +1,677 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include "manipTransport.h"
+#include "manipTrace.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <asm/termbits.h>						//termios2, for baud rates like 128000 that have no Bxxx constant
+#include <linux/serial.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#endif
+
+//Transport backends for manipControl.  See manipTransport.h.
+
+#define MANIP_DESCRIPTION "Sutter Instrument ROE-200"	//What isManip() looks for
+
+#ifndef MANIP_NO_D2XX
+extern const manipTransportOps d2xxOps;
+#endif
+#ifdef __linux__
+extern const manipTransportOps termiosOps;
+#endif
+extern const manipTransportOps emulatorOps;
+
+#ifndef MANIP_NO_D2XX
+static int selectedTransport = transportD2XX;
+#else
+static int selectedTransport = transportTermios;
+#endif
+
+static const manipTransportOps* transportOps(int backend)
+{
+#ifndef MANIP_NO_D2XX
+	if (backend == transportD2XX)
+		return &d2xxOps;
+#endif
+#ifdef __linux__
+	if (backend == transportTermios)
+		return &termiosOps;
+#endif
+	if (backend == transportEmulator)
+		return &emulatorOps;
+	return NULL;
+}
+
+//##############################################################################
+//##################SELECTING A BACKEND#########################################
+//##############################################################################
+
+#ifdef __linux__
+static FT_STATUS termiosSetPaths(const char*);
+#endif
+
+FT_STATUS transportSelect(int backend, const char *paths)
+{
+	if (transportOps(backend) == NULL)
+		return FT_INVALID_PARAMETER;
+#ifdef __linux__
+	if (backend == transportTermios)
+		termiosSetPaths(paths);
+#endif
+	if (backend == transportEmulator && emulatorSetOptions(paths) != FT_OK)
+		return FT_INVALID_PARAMETER;
+	selectedTransport = backend;
+	return FT_OK;
+}
+
+int transportSelected()
+{
+	return selectedTransport;
+}
+
+const char* transportName(int backend)
+{
+	if (backend == transportD2XX)
+		return "d2xx";
+	if (backend == transportTermios)
+		return "termios";
+	if (backend == transportEmulator)
+		return "emulator";
+	return "unknown";
+}
+
+FT_STATUS transportScan(manipDeviceInfo *list, DWORD maxDevices, DWORD *numDevs)
+{
+	FT_STATUS ftStatus = transportOps(selectedTransport)->scan(list, maxDevices, numDevs);
+	if (ftStatus != FT_OK)
+		*numDevs = 0;
+	return ftStatus;
+}
+
+//##############################################################################
+//##################ONE CONNECTION##############################################
+//##############################################################################
+
+FT_STATUS transportOpen(manipTransport *link, const char *serial, const manipLinkSettings *settings, double *phaseMs)
+{
+	FT_STATUS ftStatus;
+	std::chrono::steady_clock::time_point times[4];
+
+	memset(link, 0, sizeof(manipTransport));
+	link->fd = -1;
+	link->ops = transportOps(selectedTransport);
+	times[0] = std::chrono::steady_clock::now();
+	ftStatus = link->ops->open(link, serial);
+	times[1] = std::chrono::steady_clock::now();
+	if (ftStatus != FT_OK) {
+		link->ops = NULL;
+		times[2] = times[3] = times[1];
+	}
+	else {
+		ftStatus = link->ops->configure(link, settings);
+		times[2] = std::chrono::steady_clock::now();
+		//Start from empty queues
+		link->ops->purge(link, FT_PURGE_RX | FT_PURGE_TX);
+		times[3] = std::chrono::steady_clock::now();
+	}
+	if (phaseMs != NULL) {
+		for (int i=0; i<3; i++)
+			phaseMs[i] = std::chrono::duration<double, std::milli>(times[i+1] - times[i]).count();
+	}
+	return ftStatus;
+}
+
+FT_STATUS transportConfigure(manipTransport *link, const manipLinkSettings *settings)
+{
+	if (link->ops == NULL)
+		return FT_INVALID_HANDLE;
+	return link->ops->configure(link, settings);
+}
+
+FT_STATUS transportWrite(manipTransport *link, const void *buffer, DWORD length, DWORD *written)
+{
+	*written = 0;
+	if (link->ops == NULL)
+		return FT_INVALID_HANDLE;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	FT_STATUS ftStatus = link->ops->write(link, buffer, length, written);
+	if (link->stats != NULL)
+		statsRecord(link->stats, statWrite, start, ftStatus);
+	traceRecord(link->traceDevice, traceWrite, length, *written, ftStatus, buffer, length, start);
+	return ftStatus;
+}
+
+FT_STATUS transportRead(manipTransport *link, void *buffer, DWORD length, DWORD *received)
+{
+	*received = 0;
+	if (link->ops == NULL)
+		return FT_INVALID_HANDLE;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	FT_STATUS ftStatus = link->ops->read(link, buffer, length, received);
+	if (link->stats != NULL)
+		statsRecord(link->stats, statRead, start, ftStatus);
+	traceRecord(link->traceDevice, traceRead, length, *received, ftStatus, buffer, *received, start);
+	return ftStatus;
+}
+
+FT_STATUS transportPurge(manipTransport *link, ULONG mask)
+{
+	if (link->ops == NULL)
+		return FT_INVALID_HANDLE;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	FT_STATUS ftStatus = link->ops->purge(link, mask);
+	if (link->stats != NULL)
+		statsRecord(link->stats, statPurge, start, ftStatus);
+	traceRecord(link->traceDevice, tracePurge, mask, 0, ftStatus, NULL, 0, start);
+	return ftStatus;
+}
+
+FT_STATUS transportQueueStatus(manipTransport *link, DWORD *queued)
+{
+	*queued = 0;
+	if (link->ops == NULL)
+		return FT_INVALID_HANDLE;
+	return link->ops->queueStatus(link, queued);
+}
+
+FT_STATUS transportSetReadTimeout(manipTransport *link, ULONG timeout)
+{
+	if (link->ops == NULL)
+		return FT_INVALID_HANDLE;
+	if (timeout == link->readTimeout)
+		return FT_OK;
+	FT_STATUS ftStatus = link->ops->setReadTimeout(link, timeout);
+	if (ftStatus == FT_OK)
+		link->readTimeout = timeout;
+	return ftStatus;
+}
+
+void transportClose(manipTransport *link)
+{
+	if (link->ops != NULL) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		link->ops->close(link);
+		traceRecord(link->traceDevice, traceClose, 0, 0, FT_OK, NULL, 0, start);
+	}
+	link->ops = NULL;
+}
+
+//##############################################################################
+//##################LATENCY STATS###############################################
+//##############################################################################
+
+const char* statsName(int op)
+{
+	static const char *names[numStats] = { "write", "read", "purge", "driveChange", "where", "move", "queueWait" };
+	return (op >= 0 && op < numStats) ? names[op] : "unknown";
+}
+
+const char* errorName(int error)
+{
+	static const char *names[numLinkErrors] = { "timeouts", "badFrames", "resyncs", "retries", "gaveUp" };
+	return (error >= 0 && error < numLinkErrors) ? names[error] : "unknown";
+}
+
+// Bucket 0 is under 1 us; after that each doubling of the time gets four buckets
+static int statsBucket(unsigned long long ns)
+{
+	unsigned long long us = ns / 1000;
+	if (us == 0)
+		return 0;
+	int octave = 0;
+	while ((us >> octave) > 1)
+		octave++;
+	int quarter = (octave >= 2) ? (int)((us >> (octave - 2)) & 3) : (int)((us << (2 - octave)) & 3);
+	int bucket = 1 + octave*4 + quarter;
+	return bucket < statBuckets ? bucket : statBuckets - 1;
+}
+
+// Upper edge of a bucket in ms
+static double statsBucketLimit(int bucket)
+{
+	if (bucket == 0)
+		return 0.001;
+	int octave = (bucket - 1) / 4;
+	int quarter = (bucket - 1) % 4;
+	return ldexp(1.0 + (quarter + 1) / 4.0, octave) / 1000.0;
+}
+
+void statsRecord(manipStats *stats, int op, std::chrono::steady_clock::time_point start, FT_STATUS status)
+{
+	manipOpStats *opStats = &stats->op[op];
+	unsigned long long ns = (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	opStats->count.fetch_add(1, std::memory_order_relaxed);
+	if (status != FT_OK)
+		opStats->failures.fetch_add(1, std::memory_order_relaxed);
+	opStats->totalNs.fetch_add(ns, std::memory_order_relaxed);
+	if (ns > opStats->maxNs.load(std::memory_order_relaxed))
+		opStats->maxNs.store(ns, std::memory_order_relaxed);		//only the I/O thread writes
+	opStats->buckets[statsBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void statsReset(manipStats *stats)
+{
+	for (int op=0; op<numStats; op++) {
+		manipOpStats *opStats = &stats->op[op];
+		opStats->count.store(0, std::memory_order_relaxed);
+		opStats->failures.store(0, std::memory_order_relaxed);
+		opStats->totalNs.store(0, std::memory_order_relaxed);
+		opStats->maxNs.store(0, std::memory_order_relaxed);
+		for (int i=0; i<statBuckets; i++)
+			opStats->buckets[i].store(0, std::memory_order_relaxed);
+	}
+	for (int error=0; error<numLinkErrors; error++)
+		stats->errors[error].store(0, std::memory_order_relaxed);
+	for (int count=0; count<numSchedCounts; count++)
+		stats->sched[count].store(0, std::memory_order_relaxed);
+}
+
+double statsPercentile(const manipOpStats *opStats, double fraction)
+{
+	unsigned long long total = 0, seen = 0;
+	for (int i=0; i<statBuckets; i++)
+		total += opStats->buckets[i].load(std::memory_order_relaxed);
+	if (total == 0)
+		return 0;
+	unsigned long long wanted = (unsigned long long)ceil(fraction * total);
+	double maxMs = opStats->maxNs.load(std::memory_order_relaxed) / 1e6;
+	int bucket = 0;
+	while (bucket < statBuckets-1) {
+		seen += opStats->buckets[bucket].load(std::memory_order_relaxed);
+		if (seen >= wanted && seen > 0)
+			break;
+		bucket++;
+	}
+	//A bucket's upper edge can be above the slowest call actually seen
+	double limit = statsBucketLimit(bucket);
+	return limit < maxMs ? limit : maxMs;
+}
+
+//##############################################################################
+//##################D2XX BACKEND################################################
+//##############################################################################
+
+#ifndef MANIP_NO_D2XX
+
+// One FT_CreateDeviceInfoList/FT_GetDeviceInfoList pair instead of an FT_ListDevices per
+// device and per string
+static FT_STATUS d2xxScan(manipDeviceInfo *list, DWORD maxDevices, DWORD *numDevs)
+{
+	FT_STATUS ftStatus = FT_CreateDeviceInfoList(numDevs);
+	if (ftStatus != FT_OK || *numDevs == 0)
+		return ftStatus;
+	FT_DEVICE_LIST_INFO_NODE *nodes = new FT_DEVICE_LIST_INFO_NODE[*numDevs];
+	ftStatus = FT_GetDeviceInfoList(nodes, numDevs);
+	if (ftStatus == FT_OK) {
+		for (DWORD i=0; i<*numDevs && i<maxDevices; i++) {
+			snprintf(list[i].description, sizeof(list[i].description), "%s", nodes[i].Description);
+			snprintf(list[i].serial, sizeof(list[i].serial), "%s", nodes[i].SerialNumber);
+			list[i].locationId = nodes[i].LocId;
+			list[i].isOpen = (nodes[i].Flags & FT_FLAGS_OPENED) != 0;
+		}
+	}
+	delete[] nodes;
+	return ftStatus;
+}
+
+static FT_STATUS d2xxOpen(manipTransport *link, const char *serial)
+{
+	FT_STATUS ftStatus = FT_OpenEx((PVOID)serial, FT_OPEN_BY_SERIAL_NUMBER, &link->handle);
+	if (ftStatus != FT_OK)
+		link->handle = NULL;
+	return ftStatus;
+}
+
+static FT_STATUS d2xxConfigure(manipTransport *link, const manipLinkSettings *settings)
+{
+	FT_HANDLE handle = link->handle;
+	FT_STATUS ftStatus;
+
+	//Set up the channel properly
+	ftStatus = FT_SetDataCharacteristics(handle, FT_BITS_8, FT_STOP_BITS_1, FT_PARITY_NONE);
+	if (ftStatus == FT_OK)
+		ftStatus = FT_SetFlowControl(handle, FT_FLOW_NONE, 0, 0);
+	if (ftStatus == FT_OK)
+		ftStatus = FT_SetTimeouts(handle, settings->readTimeout, settings->writeTimeout);
+	if (ftStatus == FT_OK)
+		ftStatus = FT_SetLatencyTimer(handle, settings->latencyTimer);
+	if (ftStatus == FT_OK)
+		ftStatus = FT_SetBaudRate(handle, settings->baudRate);
+	if (ftStatus == FT_OK)
+		ftStatus = FT_SetUSBParameters(handle, settings->usbTransferSize, 0);
+	link->readTimeout = settings->readTimeout;
+	link->writeTimeout = settings->writeTimeout;
+	return ftStatus;
+}
+
+static FT_STATUS d2xxWrite(manipTransport *link, const void *buffer, DWORD length, DWORD *written)
+{
+	return FT_Write(link->handle, (LPVOID)buffer, length, written);
+}
+
+static FT_STATUS d2xxRead(manipTransport *link, void *buffer, DWORD length, DWORD *received)
+{
+	return FT_Read(link->handle, buffer, length, received);
+}
+
+static FT_STATUS d2xxPurge(manipTransport *link, ULONG mask)
+{
+	return FT_Purge(link->handle, mask);
+}
+
+static FT_STATUS d2xxQueueStatus(manipTransport *link, DWORD *queued)
+{
+	return FT_GetQueueStatus(link->handle, queued);
+}
+
+static FT_STATUS d2xxSetReadTimeout(manipTransport *link, ULONG timeout)
+{
+	return FT_SetTimeouts(link->handle, timeout, link->writeTimeout);
+}
+
+static void d2xxClose(manipTransport *link)
+{
+	if (link->handle != NULL)
+		FT_Close(link->handle);
+	link->handle = NULL;
+}
+
+const manipTransportOps d2xxOps = {
+	"d2xx",
+	d2xxScan,
+	d2xxOpen, d2xxConfigure, d2xxWrite, d2xxRead, d2xxPurge, d2xxQueueStatus, d2xxClose,
+	d2xxSetReadTimeout
+};
+
+#endif // MANIP_NO_D2XX
+
+//##############################################################################
+//##################TERMIOS BACKEND (LINUX)#####################################
+//##############################################################################
+
+#ifdef __linux__
+
+#define maxTtys 32
+
+// What the last scan found.  Entry i is device number i.
+typedef struct {
+	char path[64];
+	char description[64];
+	char serial[64];
+	DWORD locationId;							// USB bus number << 16 | device address
+} ttyEntry;
+
+static ttyEntry ttys[maxTtys];
+static int numTtys = 0;
+static char explicitPaths[1024] = "";			// set by transportSelect(transportTermios, paths)
+
+// Read the first line of one of the USB device's sysfs files (product, serial, ...) for a tty.
+// The tty's device is the USB interface; the strings live on the USB device two levels up.
+static int readTtyAttribute(const char *tty, const char *attribute, char *out, size_t outLength)
+{
+	char path[sizeof("/sys/class/tty//device/../../") + NAME_MAX + 16];
+	int length = snprintf(path, sizeof(path), "/sys/class/tty/%s/device/../../%s", tty, attribute);
+	if (length < 0 || (size_t)length >= sizeof(path))
+		return 0;
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+		return 0;
+	if (fgets(out, (int)outLength, file) == NULL)
+		out[0] = 0;
+	fclose(file);
+	out[strcspn(out, "\r\n")] = 0;
+	return 1;
+}
+
+static int compareTtys(const void *a, const void *b)
+{
+	const ttyEntry *ta = (const ttyEntry*)a;
+	const ttyEntry *tb = (const ttyEntry*)b;
+	//ttyUSB2 before ttyUSB10
+	size_t la = strlen(ta->path), lb = strlen(tb->path);
+	if (la != lb)
+		return la < lb ? -1 : 1;
+	return strcmp(ta->path, tb->path);
+}
+
+static FT_STATUS termiosSetPaths(const char *paths)
+{
+	if (paths == NULL)
+		paths = "";
+	strncpy(explicitPaths, paths, sizeof(explicitPaths)-1);
+	explicitPaths[sizeof(explicitPaths)-1] = 0;
+	return FT_OK;
+}
+
+// Find the serial devices: either the explicitly listed paths, or every /dev/ttyUSB* with
+// the USB product string (which is what D2XX calls the description) and serial from sysfs
+static void termiosScan()
+{
+	numTtys = 0;
+	if (explicitPaths[0] != 0) {
+		char paths[sizeof(explicitPaths)];
+		strcpy(paths, explicitPaths);
+		for (char *path = strtok(paths, ";"); path != NULL && numTtys < maxTtys; path = strtok(NULL, ";")) {
+			ttyEntry *entry = &ttys[numTtys++];
+			snprintf(entry->path, sizeof(entry->path), "%s", path);
+			snprintf(entry->description, sizeof(entry->description), "%s", MANIP_DESCRIPTION);
+			snprintf(entry->serial, sizeof(entry->serial), "%s", path);
+			entry->locationId = 0;
+		}
+		return;
+	}
+
+	DIR *dir = opendir("/sys/class/tty");
+	if (dir == NULL)
+		return;
+	struct dirent *item;
+	while ((item = readdir(dir)) != NULL && numTtys < maxTtys) {
+		if (strncmp(item->d_name, "ttyUSB", 6) != 0)
+			continue;
+		ttyEntry *entry = &ttys[numTtys];
+		//A name too long for the path can't be opened by it, so leave it out
+		int length = snprintf(entry->path, sizeof(entry->path), "/dev/%s", item->d_name);
+		if (length < 0 || (size_t)length >= sizeof(entry->path))
+			continue;
+		if (!readTtyAttribute(item->d_name, "product", entry->description, sizeof(entry->description)))
+			entry->description[0] = 0;
+		if (!readTtyAttribute(item->d_name, "serial", entry->serial, sizeof(entry->serial)))
+			strcpy(entry->serial, entry->path);
+		char busnum[16], devnum[16];
+		entry->locationId = 0;
+		if (readTtyAttribute(item->d_name, "busnum", busnum, sizeof(busnum)) &&
+		    readTtyAttribute(item->d_name, "devnum", devnum, sizeof(devnum)))
+			entry->locationId = (DWORD)(atoi(busnum) << 16 | atoi(devnum));
+		numTtys++;
+	}
+	closedir(dir);
+	qsort(ttys, numTtys, sizeof(ttyEntry), compareTtys);
+}
+
+static FT_STATUS termiosScanList(manipDeviceInfo *list, DWORD maxDevices, DWORD *numDevs)
+{
+	termiosScan();
+	for (int i=0; i<numTtys && (DWORD)i<maxDevices; i++) {
+		strcpy(list[i].description, ttys[i].description);
+		strcpy(list[i].serial, ttys[i].serial);
+		list[i].locationId = ttys[i].locationId;
+		list[i].isOpen = 0;
+	}
+	*numDevs = numTtys;
+	return FT_OK;
+}
+
+// Open by serial number (as reported by the last scan) or by path
+static FT_STATUS termiosOpen(manipTransport *link, const char *serial)
+{
+	const char *path = NULL;
+	if (numTtys == 0)
+		termiosScan();
+	for (int i=0; i<numTtys; i++) {
+		if (strcmp(ttys[i].serial, serial) == 0)
+			path = ttys[i].path;
+	}
+	if (path == NULL && serial[0] == '/')
+		path = serial;
+	if (path == NULL)
+		return FT_DEVICE_NOT_FOUND;
+
+	link->fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (link->fd < 0)
+		return FT_DEVICE_NOT_OPENED;
+	return FT_OK;
+}
+
+static FT_STATUS termiosConfigure(manipTransport *link, const manipLinkSettings *settings)
+{
+	struct termios2 tio;
+	if (ioctl(link->fd, TCGETS2, &tio) != 0)
+		return FT_IO_ERROR;
+	//Raw 8N1, no flow control, any baud rate
+	tio.c_iflag = 0;
+	tio.c_oflag = 0;
+	tio.c_lflag = 0;
+	tio.c_cflag = CS8 | CREAD | CLOCAL | BOTHER;
+	tio.c_ispeed = settings->baudRate;
+	tio.c_ospeed = settings->baudRate;
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+	if (ioctl(link->fd, TCSETS2, &tio) != 0)
+		return FT_INVALID_BAUD_RATE;
+
+	//ftdi_sio turns its latency timer down to 1 ms when the port is marked low latency.
+	//Not every tty supports this (a pty doesn't), so failure here isn't an error.
+	struct serial_struct serialInfo;
+	if (ioctl(link->fd, TIOCGSERIAL, &serialInfo) == 0) {
+		if (settings->latencyTimer < 16)
+			serialInfo.flags |= ASYNC_LOW_LATENCY;
+		else
+			serialInfo.flags &= ~ASYNC_LOW_LATENCY;
+		ioctl(link->fd, TIOCSSERIAL, &serialInfo);
+	}
+	link->readTimeout = settings->readTimeout;
+	link->writeTimeout = settings->writeTimeout;
+	return FT_OK;
+}
+
+static long long termiosNowMs()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Wait (up to the deadline) for fd to be ready.  Returns 0 on timeout, -1 on error.
+static int termiosWait(int fd, short events, long long deadline)
+{
+	for (;;) {
+		long long remaining = deadline - termiosNowMs();
+		if (remaining < 0)
+			remaining = 0;
+		struct pollfd ready = { fd, events, 0 };
+		int result = poll(&ready, 1, (int)remaining);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result > 0 && (ready.revents & (POLLERR | POLLNVAL)))
+			return -1;
+		return result;
+	}
+}
+
+static FT_STATUS termiosWrite(manipTransport *link, const void *buffer, DWORD length, DWORD *written)
+{
+	const char *bytes = (const char*)buffer;
+	long long deadline = termiosNowMs() + link->writeTimeout;
+	while (*written < length) {
+		ssize_t count = write(link->fd, bytes + *written, length - *written);
+		if (count > 0) {
+			*written += (DWORD)count;
+			continue;
+		}
+		if (count < 0 && errno != EAGAIN && errno != EINTR)
+			return FT_IO_ERROR;
+		int ready = termiosWait(link->fd, POLLOUT, deadline);
+		if (ready < 0)
+			return FT_IO_ERROR;
+		if (ready == 0)
+			break;
+	}
+	return FT_OK;
+}
+
+// Same contract as FT_Read: wait until length bytes have arrived or the read timeout expires
+static FT_STATUS termiosRead(manipTransport *link, void *buffer, DWORD length, DWORD *received)
+{
+	char *bytes = (char*)buffer;
+	long long deadline = termiosNowMs() + link->readTimeout;
+	while (*received < length) {
+		ssize_t count = read(link->fd, bytes + *received, length - *received);
+		if (count > 0) {
+			*received += (DWORD)count;
+			continue;
+		}
+		if (count < 0 && errno != EAGAIN && errno != EINTR)
+			return FT_IO_ERROR;
+		int ready = termiosWait(link->fd, POLLIN, deadline);
+		if (ready < 0)
+			return FT_IO_ERROR;
+		if (ready == 0)
+			break;
+	}
+	return FT_OK;
+}
+
+static FT_STATUS termiosPurge(manipTransport *link, ULONG mask)
+{
+	int queue;
+	if ((mask & FT_PURGE_RX) && (mask & FT_PURGE_TX))
+		queue = TCIOFLUSH;
+	else if (mask & FT_PURGE_RX)
+		queue = TCIFLUSH;
+	else if (mask & FT_PURGE_TX)
+		queue = TCOFLUSH;
+	else
+		return FT_OK;
+	return ioctl(link->fd, TCFLSH, queue) == 0 ? FT_OK : FT_IO_ERROR;
+}
+
+static FT_STATUS termiosQueueStatus(manipTransport *link, DWORD *queued)
+{
+	int count = 0;
+	if (ioctl(link->fd, FIONREAD, &count) != 0)
+		return FT_IO_ERROR;
+	*queued = (DWORD)count;
+	return FT_OK;
+}
+
+// termiosRead keeps its own deadline, so there is nothing to tell the driver
+static FT_STATUS termiosSetReadTimeout(manipTransport *, ULONG)
+{
+	return FT_OK;
+}
+
+static void termiosClose(manipTransport *link)
+{
+	if (link->fd >= 0)
+		close(link->fd);
+	link->fd = -1;
+}
+
+const manipTransportOps termiosOps = {
+	"termios",
+	termiosScanList,
+	termiosOpen, termiosConfigure, termiosWrite, termiosRead, termiosPurge, termiosQueueStatus, termiosClose,
+	termiosSetReadTimeout
+};
+
+#endif // __linux__
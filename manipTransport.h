@@ -0,0 +1,174 @@
+#ifndef MANIP_TRANSPORT_H
+#define MANIP_TRANSPORT_H
+
+//Byte transport underneath where(), move() and driveChange().
+//
+//Three backends:
+//  D2XX     FTDI's own driver (ftd2xx.lib on Windows, libftd2xx on Linux).  The default.
+//  termios  The Linux ftdi_sio kernel driver through /dev/ttyUSB*, with ASYNC_LOW_LATENCY
+//           set so replies aren't held back by the 16 ms latency timer.  Also opens any
+//           other serial device by path (a pty, for instance).
+//  emulator Controllers simulated in software (manipEmulator.cpp), for trying things out and
+//           benchmarking without hardware.
+//
+//Build with MANIP_NO_D2XX defined to leave the FTDI library out altogether (Linux only);
+//the termios backend is then the only one.
+
+#include <atomic>
+#include <chrono>
+
+#ifdef MANIP_NO_D2XX
+//Just enough of ftd2xx.h for the rest of the code
+typedef unsigned int DWORD;
+typedef unsigned int ULONG;
+typedef unsigned short USHORT;
+typedef unsigned char UCHAR;
+typedef void* FT_HANDLE;
+typedef ULONG FT_STATUS;
+enum { FT_OK, FT_INVALID_HANDLE, FT_DEVICE_NOT_FOUND, FT_DEVICE_NOT_OPENED, FT_IO_ERROR,
+       FT_INSUFFICIENT_RESOURCES, FT_INVALID_PARAMETER, FT_INVALID_BAUD_RATE };
+#define FT_PURGE_RX 1
+#define FT_PURGE_TX 2
+#else
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "ftd2xx.h"
+#endif
+
+// Backends
+enum { transportD2XX, transportTermios, transportEmulator, numTransports };
+
+// Serial line settings applied when a device is opened
+typedef struct {
+	ULONG baudRate;
+	UCHAR latencyTimer;							// ms (termios: anything below 16 asks for ASYNC_LOW_LATENCY)
+	ULONG usbTransferSize;						// bytes (D2XX only)
+	ULONG readTimeout;							// ms
+	ULONG writeTimeout;							// ms
+} manipLinkSettings;
+
+// One entry of a device list snapshot (see transportScan())
+typedef struct {
+	char description[64];
+	char serial[64];
+	DWORD locationId;							// where on the USB tree the device is plugged in (0 if unknown)
+	int isOpen;									// already opened, by us or another program (D2XX only)
+} manipDeviceInfo;
+
+// Latency statistics.  Every timed operation lands in a log-scale histogram (four buckets per
+// doubling, from 1 us to about a minute), so recording is a clock read and a few relaxed
+// atomic increments, cheap enough to leave on.  Written by a device's I/O thread, read and
+// reset from the MATLAB thread.
+enum { statWrite, statRead, statPurge, statDriveChange, statWhere, statMove, statQueueWait, numStats };
+#define statBuckets 112
+
+typedef struct {
+	std::atomic<unsigned> count;
+	std::atomic<unsigned> failures;				// calls that returned something other than FT_OK
+	std::atomic<unsigned long long> totalNs;
+	std::atomic<unsigned long long> maxNs;
+	std::atomic<unsigned> buckets[statBuckets];
+} manipOpStats;
+
+// Link errors, counted by the reply checking in where(), move() and driveChange()
+enum { errTimeout, errBadFrame, errResync, errRetry, errGaveUp, numLinkErrors };
+
+// What the I/O thread's drive-aware scheduler did (see nextCommand() in manipCore.cpp)
+enum { schedRequests, schedReordered, schedForced, schedSwitches, schedArrivalSwitches, numSchedCounts };
+
+typedef struct {
+	manipOpStats op[numStats];
+	std::atomic<unsigned> errors[numLinkErrors];
+	std::atomic<unsigned> sched[numSchedCounts];
+	//Adaptive reply timeout in use, and the round trip it is based on (us; not reset)
+	std::atomic<unsigned> replyTimeoutUs;
+	std::atomic<unsigned> roundTripUs;
+} manipStats;
+
+const char* statsName(int op);
+const char* errorName(int error);
+void statsRecord(manipStats*, int op, std::chrono::steady_clock::time_point start, FT_STATUS status);
+void statsReset(manipStats*);
+inline void statsError(manipStats *stats, int error)
+{
+	if (stats != NULL)
+		stats->errors[error].fetch_add(1, std::memory_order_relaxed);
+}
+inline void statsSchedule(manipStats *stats, int count)
+{
+	stats->sched[count].fetch_add(1, std::memory_order_relaxed);
+}
+// Latency (ms) below which the given fraction of the op's calls fell (bucket upper bound)
+double statsPercentile(const manipOpStats*, double fraction);
+
+// Times a whole command: records from construction until it goes out of scope, with
+// whatever *status holds by then
+struct manipStatsTimer {
+	manipStats *stats;
+	int op;
+	const FT_STATUS *status;
+	std::chrono::steady_clock::time_point start;
+	manipStatsTimer(manipStats *stats, int op, const FT_STATUS *status)
+		: stats(stats), op(op), status(status), start(std::chrono::steady_clock::now()) {}
+	~manipStatsTimer() { if (stats != NULL) statsRecord(stats, op, start, *status); }
+};
+
+typedef struct manipTransportOps manipTransportOps;
+
+// One open connection to a controller
+typedef struct {
+	const manipTransportOps *ops;				// backend the connection was opened with (NULL if closed)
+	manipStats *stats;							// where write/read/purge times go (NULL: not recorded)
+	int traceDevice;							// device number the transaction trace shows (see manipTrace.h)
+	FT_HANDLE handle;							// D2XX handle
+	int fd;										// termios file descriptor
+	ULONG readTimeout;							// termios: how long a read waits for the bytes asked for
+	ULONG writeTimeout;
+} manipTransport;
+
+struct manipTransportOps {
+	const char *name;
+	//Device enumeration
+	FT_STATUS (*scan)(manipDeviceInfo*, DWORD, DWORD*);
+	//Connection
+	FT_STATUS (*open)(manipTransport*, const char*);
+	FT_STATUS (*configure)(manipTransport*, const manipLinkSettings*);
+	FT_STATUS (*write)(manipTransport*, const void*, DWORD, DWORD*);
+	FT_STATUS (*read)(manipTransport*, void*, DWORD, DWORD*);
+	FT_STATUS (*purge)(manipTransport*, ULONG);
+	FT_STATUS (*queueStatus)(manipTransport*, DWORD*);
+	void (*close)(manipTransport*);
+	FT_STATUS (*setReadTimeout)(manipTransport*, ULONG);
+};
+
+// Pick the backend used by enumeration and by the next transportOpen().  For termios, paths
+// is an optional ';' separated list of serial devices to use instead of scanning for
+// /dev/ttyUSB*; devices listed explicitly are all taken to be manipulators.  For the emulator
+// it holds the emulator's options (see manipEmulator.cpp).
+FT_STATUS transportSelect(int backend, const char *paths);
+int transportSelected();
+const char* transportName(int backend);
+
+// Enumerate the bus once and fill in up to maxDevices entries of list; numDevs gets the
+// number of devices found (which may be more than maxDevices).  Entry i is device number i.
+FT_STATUS transportScan(manipDeviceInfo *list, DWORD maxDevices, DWORD *numDevs);
+
+// Open the device with the given serial number (or, for termios, path) and apply settings.
+// If phaseMs isn't NULL it gets the time (ms) spent opening, configuring and purging.
+// Read and write behave like FT_Read/FT_Write: a read that times out returns FT_OK with
+// fewer bytes than asked for.
+FT_STATUS transportOpen(manipTransport*, const char *serial, const manipLinkSettings*, double *phaseMs);
+FT_STATUS transportConfigure(manipTransport*, const manipLinkSettings*);
+FT_STATUS transportWrite(manipTransport*, const void*, DWORD, DWORD*);
+FT_STATUS transportRead(manipTransport*, void*, DWORD, DWORD*);
+FT_STATUS transportPurge(manipTransport*, ULONG);
+FT_STATUS transportQueueStatus(manipTransport*, DWORD*);
+// Change the read timeout alone (ms); does nothing if it is already that
+FT_STATUS transportSetReadTimeout(manipTransport*, ULONG);
+void transportClose(manipTransport*);
+
+// Emulator options, 'name=value;...'
+FT_STATUS emulatorSetOptions(const char *options);
+
+#endif
@@ -0,0 +1,39 @@
+function benchDispatch(calls)
+%benchDispatch  Per-call cost of manipControl's command dispatch, from MATLAB.
+%   benchDispatch(calls) times calls (default 100000) calls of cheap commands against the
+%   emulator, looking the command up by name and by the number 'commandId' gives, and
+%   addressing the manipulator by number and by serial.  The difference from an empty MEX
+%   round trip (numManips) is what the name lookup and argument decoding cost.  Build
+%   manipControl first (see README.md); needs no hardware.
+
+if nargin < 1
+    calls = 100000;
+end
+manipControl('setTransport', 'emulator', 'devices=1;latencyUs=250');
+manipControl('initialize');
+cleanup = onCleanup(@() manipControl('uninitialize'));
+
+isMovingId = manipControl('commandId', 'isMoving');
+numManipsId = manipControl('commandId', 'numManips');
+serial = 'EMU0001';
+
+report('numManips by name', @() manipControl('numManips'), calls);
+report('numManips by id', @() manipControl(numManipsId), calls);
+report('isMoving by name', @() manipControl('isMoving', 0), calls);
+report('isMoving by id', @() manipControl(isMovingId, 0), calls);
+report('isMoving by name, serial', @() manipControl('isMoving', serial), calls);
+report('getPosition by name', @() manipControl('getPosition', 0, 1), calls / 100);
+end
+
+function report(label, call, calls)
+call();
+times = zeros(calls, 1);
+for i = 1:calls
+    start = tic;
+    call();
+    times(i) = toc(start);
+end
+times = sort(times) * 1e6;
+fprintf('%-28s mean %7.2f  p50 %7.2f  p99 %7.2f us\n', label, mean(times), ...
+    times(ceil(end/2)), times(ceil(end*0.99)));
+end
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include "manipTest.h"
+
+//End-to-end benchmark against the emulator, with no MATLAB: getPosition and changePosition
+//latency on one device, then the throughput of moveMany and getPositionAll as the number of
+//devices grows (each device has its own I/O thread, so they should scale until the CPU
+//runs out).
+//  benchEmulator [latencyUs [maxDevices]]
+
+int main(int argc, char *argv[])
+{
+	int latencyUs = argc > 1 ? atoi(argv[1]) : 250;
+	int maxDevices = argc > 2 ? atoi(argv[2]) : 8;
+	char options[128];
+
+	//One device: a short move is one 'M' and its reply once the stage arrives (at 400000
+	//steps/s, 100 steps take 0.25 ms)
+	snprintf(options, sizeof(options), "devices=1;latencyUs=%d;latencyTimer=0;stepsPerSecond=400000", latencyUs);
+	if (openEmulator(options) < 1) {
+		printf("Error. Couldn't open the emulator\n");
+		return 1;
+	}
+	std::vector<double> where, move;
+	int x, y, z;
+	for (int i=0; i<1000; i++) {
+		double start = testNowMs();
+		manipWhere(0, 1, &x, &y, &z);
+		where.push_back(testNowMs() - start);
+		start = testNowMs();
+		manipMove(0, 1, 1000 + 100*(i & 1), 2000, 3000);
+		move.push_back(testNowMs() - start);
+	}
+	printLatencies("getPosition", where);
+	printLatencies("changePosition (100 steps)", move);
+	manipUninitialize();
+
+	//Many devices: every drive of every device moved (moveMany) and read (whereAll) at once
+	printf("%8s %16s %16s\n", "devices", "moves/s", "positions/s");
+	for (int devices=1; devices<=maxDevices; devices*=2) {
+		snprintf(options, sizeof(options), "devices=%d;latencyUs=%d;latencyTimer=0;stepsPerSecond=400000", devices, latencyUs);
+		int count = openEmulator(options);
+		if (count != devices) {
+			printf("Error. Opened %d of %d emulated devices\n", count, devices);
+			manipUninitialize();
+			break;
+		}
+		const int rounds = 200;
+		std::vector<manipMoveRequest> moves(count * MANIP_MAX_DRIVES);
+		double start = testNowMs();
+		for (int round=0; round<rounds; round++) {
+			for (int i=0; i<(int)moves.size(); i++) {
+				manipMoveRequest request = { i / MANIP_MAX_DRIVES, 1 + i % MANIP_MAX_DRIVES, 1000 + 100*(round & 1), 2000, 3000, 0, 0 };
+				moves[i] = request;
+			}
+			manipMoveMany(moves.data(), (int)moves.size());
+		}
+		double moveMs = testNowMs() - start;
+		std::vector<manipPosition> positions(count * MANIP_MAX_DRIVES);
+		start = testNowMs();
+		for (int round=0; round<rounds; round++)
+			manipWhereAll(positions.data(), (int)positions.size());
+		double whereMs = testNowMs() - start;
+		printf("%8d %16.0f %16.0f\n", devices, rounds * moves.size() / (moveMs / 1000), rounds * positions.size() / (whereMs / 1000));
+		manipUninitialize();
+	}
+	return 0;
+}
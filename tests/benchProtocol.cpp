@@ -0,0 +1,64 @@
+#include "manipTest.h"
+#include "manipProtocol.h"
+
+//Cost of encoding and decoding the frames of manipProtocol.h, in ns per frame.  The
+//results are folded into a volatile so the compiler can't drop the work.
+//  benchProtocol [frames]
+
+static volatile unsigned sink;
+
+static void report(const char *label, double startMs, int frames)
+{
+	printf("%-28s %8.2f ns\n", label, (testNowMs() - startMs) * 1e6 / frames);
+}
+
+int main(int argc, char *argv[])
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 20000000;
+	if (frames <= 0)
+		frames = 20000000;
+	unsigned sum = 0;
+	double start;
+
+	start = testNowMs();
+	for (int i=0; i<frames; i++) {
+		moveCommand command = encodeMove(i, i+1, i+2);
+		sum += command.bytes[i % moveCommand::size];
+	}
+	report("encode 'M'", start, frames);
+
+	start = testNowMs();
+	for (int i=0; i<frames; i++) {
+		positionReply reply = encodePosition(1 + (i & 1), i, i ^ 0x5555, i + 7);
+		int x, y, z;
+		decodePosition(reply, &x, &y, &z);
+		sum += (unsigned)(x + y + z) + positionFramed(reply, 1);
+	}
+	report("encode and decode 'C'", start, frames);
+
+	positionReply reply = encodePosition(1, 123456, 234567, 345678);
+	start = testNowMs();
+	for (int i=0; i<frames; i++) {
+		int x, y, z;
+		reply.bytes[1] = (unsigned char)i;
+		decodePosition(reply, &x, &y, &z);
+		sum += (unsigned)(x + y + z) + positionFramed(reply, 1);
+	}
+	report("decode 'C'", start, frames);
+
+	start = testNowMs();
+	for (int i=0; i<frames; i++) {
+		velocityCommand command = encodeVelocity(i & 0xFFFF, i & 1);
+		int speed, fine;
+		sum += decodeVelocity(command, &speed, &fine) + (unsigned)speed + (unsigned)fine;
+	}
+	report("encode and decode 'V'", start, frames);
+
+	start = testNowMs();
+	for (int i=0; i<frames; i++)
+		sum += encodeDriveChange(1 + (i & 1)).bytes[1] + commandSize((unsigned char)i);
+	report("encode 'I' and commandSize", start, frames);
+
+	sink = sum;
+	return 0;
+}
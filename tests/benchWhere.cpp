@@ -0,0 +1,42 @@
+#include <string.h>
+#include "manipTest.h"
+
+//Position read latency.  Times manipWhere against the emulator, whose replies take a USB
+//round trip (latencyUs) and, with latencyTimer=1, are held for the link's latency timer as an
+//FTDI chip holds short packets.  It also counts the reads and purges each position costs
+//(from manipGetStats): the 'C' reply is read as one framed transfer, with no purge while the
+//receive queue is empty.
+//  benchWhere [reads]
+
+static void benchmark(const char *label, const char *options, int reads)
+{
+	if (openEmulator(options) < 1) {
+		printf("Error. Couldn't open the emulator (%s)\n", options);
+		return;
+	}
+	int x, y, z;
+	manipWhere(0, 1, &x, &y, &z);				//select the drive outside the timing
+	manipResetStats(0);
+	std::vector<double> ms;
+	for (int i=0; i<reads; i++) {
+		double start = testNowMs();
+		manipWhere(0, 1, &x, &y, &z);
+		ms.push_back(testNowMs() - start);
+	}
+	printLatencies(label, ms);
+	manipOpSummary summaries[16];
+	int numOps = manipGetStats(0, summaries, 16);
+	for (int op=0; op<numOps; op++)
+		if (strcmp(summaries[op].name, "read") == 0 || strcmp(summaries[op].name, "purge") == 0)
+			printf("%-28s %.2f %ss per position\n", "", (double)summaries[op].count / reads, summaries[op].name);
+	manipUninitialize();
+}
+
+int main(int argc, char *argv[])
+{
+	int reads = argc > 1 ? atoi(argv[1]) : 2000;
+	benchmark("where, 250 us USB", "devices=1;latencyUs=250;latencyTimer=0", reads);
+	benchmark("where, 1 ms USB", "devices=1;latencyUs=1000;latencyTimer=0", reads);
+	benchmark("where, + latency timer", "devices=1;latencyUs=250;latencyTimer=1", reads / 10);
+	return 0;
+}
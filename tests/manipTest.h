@@ -0,0 +1,75 @@
+#ifndef MANIP_TEST_H
+#define MANIP_TEST_H
+
+//Helpers shared by the tests and benchmarks in this directory.  They drive the library
+//through manipCore.h against the emulator (or a pty), so they need no MATLAB and no
+//hardware; runTests.sh builds and runs them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "manipCore.h"
+
+static int testChecks = 0;
+static int testFailures = 0;
+
+#define CHECK(condition) testCheck((condition) ? 1 : 0, #condition, __FILE__, __LINE__)
+#define CHECK_EQ(actual, expected) testCheckEqual((long long)(actual), (long long)(expected), #actual, __FILE__, __LINE__)
+
+static inline void testCheck(int ok, const char *what, const char *file, int line)
+{
+	testChecks++;
+	if (!ok) {
+		testFailures++;
+		printf("FAILED %s:%d: %s\n", file, line, what);
+	}
+}
+
+static inline void testCheckEqual(long long actual, long long expected, const char *what, const char *file, int line)
+{
+	testChecks++;
+	if (actual != expected) {
+		testFailures++;
+		printf("FAILED %s:%d: %s is %lld, expected %lld\n", file, line, what, actual, expected);
+	}
+}
+
+// Print the tally and return the exit status
+static inline int testResult(const char *name)
+{
+	printf("%s: %d checks, %d failed\n", name, testChecks, testFailures);
+	return testFailures != 0;
+}
+
+static inline double testNowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Print count, mean, p50, p99 and max of a set of times (ms)
+static inline void printLatencies(const char *label, std::vector<double> ms)
+{
+	if (ms.empty())
+		return;
+	std::sort(ms.begin(), ms.end());
+	double sum = 0;
+	for (size_t i=0; i<ms.size(); i++)
+		sum += ms[i];
+	printf("%-28s n %6u  mean %8.3f  p50 %8.3f  p99 %8.3f  max %8.3f ms\n", label, (unsigned)ms.size(),
+	       sum / ms.size(), ms[ms.size()/2], ms[(ms.size()*99)/100], ms.back());
+}
+
+// Open every emulated controller with the given options; returns how many are open
+static inline int openEmulator(const char *options)
+{
+	manipOpenResult results[MANIP_MAX_MANIPS];
+	int tried = 0;
+	if (manipSetTransport("emulator", options) != MANIP_OK)
+		return 0;
+	manipInitialize(NULL, 0, results, &tried);
+	return manipCount();
+}
+
+#endif
@@ -0,0 +1,35 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "manipPositions.h"
+
+/* A position reader written in C, as an acquisition program would be: maps the segment
+   and prints "live count x y z updates" for one drive.  testPositions runs it.
+     readPositions name manip drive */
+
+int main(int argc, char *argv[])
+{
+	if (argc != 4)
+		return 2;
+	int manip = atoi(argv[2]), drive = atoi(argv[3]);
+	if (manip < 0 || manip >= positionsMaxManips || drive < 1 || drive > positionsMaxDrives)
+		return 2;
+	int fd = shm_open(argv[1], O_RDONLY, 0);
+	if (fd < 0)
+		return 1;
+	void *view = mmap(NULL, sizeof(manipPositionsFile), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return 1;
+	const manipPositionsFile *file = (const manipPositionsFile*)view;
+	manipLivePosition position;
+	if (!positionsRead(&file->manips[manip].drives[drive-1], &position))
+		return 1;
+	printf("%d %d %d %d %d %u\n", positionsLive(file), positionsCount(file), position.x, position.y, position.z,
+	       (unsigned)position.updates);
+	munmap(view, sizeof(manipPositionsFile));
+	return 0;
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Build and run the tests, and with "bench" the benchmarks too:
+#   tests/runTests.sh [bench]
+# Everything is built with MANIP_NO_D2XX and runs against the emulator or a pty, so neither
+# MATLAB nor the FTDI driver is needed (Linux).  Exits non-zero if any test fails.
+cd "$(dirname "$0")" || exit 2
+CXX=${CXX:-g++}
+CC=${CC:-gcc}
+FLAGS="-std=c++11 -O2 -Wall -Wextra -DMANIP_NO_D2XX -I.."
+LIBS="-lpthread -lrt -lutil"
+out=$(mktemp -d) || exit 2
+trap 'rm -rf "$out"' EXIT
+export MANIPCONTROL_LINKFILE="$out/links"
+
+objects=""
+for source in manipCore manipTransport manipEmulator manipTrace manipPositions manipClient; do
+	$CXX $FLAGS -c ../$source.cpp -o "$out/$source.o" || exit 2
+	objects="$objects $out/$source.o"
+done
+
+#The daemon runs as its own process in testDaemon and testPositions
+$CXX $FLAGS ../manipDaemon.cpp $objects $LIBS -o "$out/manipDaemon" || exit 2
+export MANIPCONTROL_DAEMON="$out/manipDaemon"
+#So does a position reader written in C, in testPositions
+$CC -std=c99 -O2 -Wall -Wextra -I.. readPositions.c -lrt -o "$out/readPositions" || exit 2
+export MANIPCONTROL_READER="$out/readPositions"
+
+build() {
+	$CXX $FLAGS "$1.cpp" $objects $LIBS -o "$out/$1" || exit 2
+}
+
+status=0
+for test in test*.cpp; do
+	[ -e "$test" ] || continue
+	name=${test%.cpp}
+	build "$name"
+	echo "== $name"
+	"$out/$name" || status=1
+done
+if [ "$1" = bench ]; then
+	for bench in bench*.cpp; do
+		[ -e "$bench" ] || continue
+		name=${bench%.cpp}
+		build "$name"
+		echo "== $name"
+		"$out/$name" || status=1
+	done
+fi
+exit $status
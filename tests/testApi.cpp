@@ -0,0 +1,85 @@
+#include <string.h>
+#include "manipTest.h"
+
+//Argument checking of the C API: nothing out of range reaches the wire.
+
+int main()
+{
+	CHECK_EQ(manipCount(), -1);
+	CHECK_EQ(manipMove(0, 1, 0, 0, 0), MANIP_INVALID_HANDLE);
+	//Saved link settings that can't work (a 0 baud rate and timeouts) are ignored
+	const char *linkFile = getenv("MANIPCONTROL_LINKFILE");
+	FILE *links = linkFile != NULL ? fopen(linkFile, "a") : NULL;
+	CHECK(links != NULL);
+	if (links != NULL) {
+		fprintf(links, "EMU0001 0 16 64 0 0\n");
+		fclose(links);
+	}
+	CHECK_EQ(openEmulator("devices=1;latencyUs=100;latencyTimer=0;stepsPerSecond=4000000"), 1);
+
+	int x, y, z;
+	CHECK_EQ(manipMove(0, 1, 100, 200, 300), MANIP_OK);
+	CHECK_EQ(manipMove(0, 1, -1, 0, 0), MANIP_INVALID_PARAMETER);
+	CHECK_EQ(manipMove(0, 1, 0, 400001, 0), MANIP_INVALID_PARAMETER);
+	CHECK_EQ(manipMove(0, 3, 0, 0, 0), MANIP_INVALID_PARAMETER);
+	CHECK_EQ(manipMove(0, 0, 0, 0, 0), MANIP_INVALID_PARAMETER);
+	CHECK_EQ(manipMoveAsync(0, 1, 0, 0, 400001), MANIP_INVALID_PARAMETER);
+	CHECK_EQ(manipMoveAsync(0, 2, 0, 0, 0), MANIP_OK);
+	CHECK_EQ(manipWaitMove(0, 1000, NULL), 1);
+	CHECK_EQ(manipMove(1, 1, 0, 0, 0), MANIP_INVALID_HANDLE);
+	CHECK_EQ(manipWhere(0, 1, &x, &y, &z), MANIP_OK);
+	CHECK_EQ(x, 100);								//the rejected moves went nowhere
+	CHECK_EQ(y, 200);
+	CHECK_EQ(z, 300);
+	CHECK_EQ(manipMove(0, 1, 400000, 400000, 400000), MANIP_OK);
+	CHECK_EQ(manipSetTarget(0, 1, 0, 0, -5), MANIP_INVALID_PARAMETER);
+	manipVerifiedMove verified;
+	memset(&verified, 0, sizeof(verified));
+	verified.tolerance = 2;
+	verified.maxRetries = 1;
+	verified.timeoutMs = 1000;
+	CHECK_EQ(manipMoveVerified(0, 1, -1, 0, 0, &verified), MANIP_INVALID_PARAMETER);
+	CHECK_EQ(manipMoveVerified(0, 1, 0, 400001, 0, &verified), MANIP_INVALID_PARAMETER);
+	CHECK_EQ(manipMoveVerified(0, 1, 0, 0, -2147483647 - 1, &verified), MANIP_INVALID_PARAMETER);
+	CHECK_EQ(manipMoveVerified(0, 1, 400000, 400000, 400000, &verified), MANIP_OK);
+	CHECK_EQ(verified.x, 400000);
+
+	manipLinkConfig link;
+	CHECK_EQ(manipGetLink(0, &link), MANIP_OK);
+	CHECK_EQ(link.baudRate, 128000);
+	CHECK_EQ(link.readTimeout, 500);
+	CHECK_EQ(link.writeTimeout, 500);
+	manipLinkConfig bad = link;
+	bad.readTimeout = 0;
+	CHECK_EQ(manipConfigureLink(0, &bad), MANIP_INVALID_PARAMETER);
+	bad = link;
+	bad.writeTimeout = 5;
+	CHECK_EQ(manipConfigureLink(0, &bad), MANIP_INVALID_PARAMETER);
+	bad = link;
+	bad.baudRate = 0;
+	CHECK_EQ(manipConfigureLink(0, &bad), MANIP_INVALID_PARAMETER);
+	CHECK_EQ(manipGetLink(0, &bad), MANIP_OK);
+	CHECK_EQ(bad.readTimeout, 500);
+	CHECK_EQ(bad.baudRate, 128000);
+
+	//Path times can be read while paths of different lengths replace each other
+	int waypoints[3*64];
+	for (int i=0; i<64; i++) {
+		waypoints[3*i] = 1000*i;
+		waypoints[3*i+1] = waypoints[3*i+2] = 0;
+	}
+	double times[64];
+	for (int round=0; round<20; round++) {
+		CHECK_EQ(manipExecutePath(0, 1, waypoints, 8 + (round*7) % 57, 0), MANIP_OK);
+		while (manipIsMoving(0))
+			manipPathTimes(0, times, 64);
+	}
+	manipPathProgress progress;
+	CHECK_EQ(manipPathStatus(0, &progress), MANIP_OK);
+	CHECK_EQ(progress.status, MANIP_OK);
+	CHECK_EQ(progress.reached, progress.total);
+
+	manipUninitialize();
+	CHECK_EQ(manipCount(), -1);
+	return testResult("testApi");
+}
@@ -0,0 +1,112 @@
+#include "manipTest.h"
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+//manipDaemon with clients coming and going: each connection's moveMany payload must come
+//back as it was sent, even when a new connection is given the fd number of one just
+//closed.  manipMoveAtSpeed goes to the daemon as well.  runTests.sh builds the daemon and
+//passes its path in $MANIPCONTROL_DAEMON.
+
+#define numChildren 8
+#define connectionsEach 40
+
+// One client process: connect, move, check the echo, disconnect, again; returns failures
+static int clientLoop(const char *socketPath, int child)
+{
+	for (int c=0; c<connectionsEach; c++) {
+		if (manipConnect(socketPath) != MANIP_OK) {
+			CHECK(!"manipConnect");
+			continue;
+		}
+		manipMoveRequest moves[4];
+		for (int i=0; i<4; i++) {
+			moves[i].manip = i & 1;
+			moves[i].drive = 1 + (i >> 1);
+			moves[i].x = child*10000 + c*100 + i;
+			moves[i].y = child;
+			moves[i].z = c;
+			moves[i].status = -1;
+		}
+		manipMoveMany(moves, 4);
+		for (int i=0; i<4; i++) {
+			CHECK_EQ(moves[i].status, MANIP_OK);
+			CHECK_EQ(moves[i].manip, i & 1);
+			CHECK_EQ(moves[i].x, child*10000 + c*100 + i);
+			CHECK_EQ(moves[i].y, child);
+			CHECK_EQ(moves[i].z, c);
+		}
+		manipDisconnect();
+	}
+	return testFailures;
+}
+
+int main()
+{
+	const char *daemon = getenv("MANIPCONTROL_DAEMON");
+	if (daemon == NULL) {
+		printf("testDaemon: MANIPCONTROL_DAEMON isn't set\n");
+		return 1;
+	}
+	char socketPath[64];
+	snprintf(socketPath, sizeof(socketPath), "/tmp/manipTest%d.sock", (int)getpid());
+
+	pid_t server = fork();
+	if (server == 0) {
+		execl(daemon, daemon, "-s", socketPath, "-t", "emulator,devices=2;latencyUs=50;stepsPerSecond=10000000", (char*)NULL);
+		_exit(127);
+	}
+	struct stat info;
+	for (int i=0; i<500 && stat(socketPath, &info) != 0; i++)
+		usleep(10000);
+	CHECK_EQ(manipConnect(socketPath), MANIP_OK);
+	CHECK_EQ(manipCount(), 2);
+	manipDisconnect();
+
+	fflush(stdout);
+	pid_t children[numChildren];
+	for (int child=0; child<numChildren; child++) {
+		children[child] = fork();
+		if (children[child] == 0)
+			_exit(clientLoop(socketPath, child) != 0);
+	}
+	for (int child=0; child<numChildren; child++) {
+		int status = 0;
+		waitpid(children[child], &status, 0);
+		CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+
+	CHECK_EQ(manipConnect(socketPath), MANIP_OK);
+	//Moves at a set or planned speed run in the daemon too (after the churn, as the speed
+	//stays set); streams don't
+	manipSpeedMove move;
+	memset(&move, 0, sizeof(move));
+	CHECK_EQ(manipMove(0, 1, 10000, 0, 0), MANIP_OK);
+	CHECK_EQ(manipMoveAtSpeed(0, 1, 12000, 0, 0, &move), MANIP_OK);
+	CHECK_EQ(move.speedUsed, 1500);
+	CHECK_EQ(move.fineUsed, 0);
+	CHECK_EQ(move.velocitySent, 1);
+	CHECK(move.predictedMs > 83 && move.measuredMs > 80);
+	CHECK_EQ(manipMoveAtSpeed(0, 1, 14000, 0, 0, &move), MANIP_OK);
+	CHECK_EQ(move.velocitySent, 0);
+	int x, y, z;
+	CHECK_EQ(manipWhere(0, 1, &x, &y, &z), MANIP_OK);
+	CHECK_EQ(x, 14000);
+	move.speed = 100;
+	CHECK_EQ(manipMoveAtSpeed(0, 1, 400001, 0, 0, &move), MANIP_INVALID_PARAMETER);
+	CHECK_EQ(manipStartStream(0, 1, 100), MANIP_INVALID_HANDLE);
+	manipVerifiedMove verified;
+	memset(&verified, 0, sizeof(verified));
+	verified.timeoutMs = 1000;
+	CHECK_EQ(manipMoveVerified(0, 1, -1, 0, 0, &verified), MANIP_INVALID_PARAMETER);
+	manipDisconnect();
+
+	kill(server, SIGTERM);
+	int status = 0;
+	waitpid(server, &status, 0);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	unlink(socketPath);
+	return testResult("testDaemon");
+}
@@ -0,0 +1,170 @@
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "manipTest.h"
+#define MANIP_TRACE_DECODER
+#include "manipTrace.h"
+
+//Faults the emulator injects on the link: late, short, misframed and missing replies, and
+//stray carriage returns.  Every call must still succeed with the right answer, the link
+//health counts must say how, and the reply timeout must come down to the round trip.  A
+//move is never sent twice: a lost 'M' reply is settled by reading where the drive is.
+
+// Moves and reads back on both drives, checking every position; returns the largest
+// where() time (ms)
+static double exercise(int rounds)
+{
+	double slowest = 0;
+	for (int i=0; i<rounds; i++) {
+		int drive = 1 + (i & 1);
+		int target = 1000 + 37*i;
+		CHECK_EQ(manipMove(0, drive, target, target+1, target+2), MANIP_OK);
+		int x = -1, y = -1, z = -1;
+		double start = testNowMs();
+		CHECK_EQ(manipWhere(0, drive, &x, &y, &z), MANIP_OK);
+		double ms = testNowMs() - start;
+		if (ms > slowest)
+			slowest = ms;
+		CHECK_EQ(x, target);
+		CHECK_EQ(y, target+1);
+		CHECK_EQ(z, target+2);
+	}
+	return slowest;
+}
+
+// Read both drives and make one long move, so that the move speed is learned and a lost
+// 'M' reply is waited for about as long as the move takes rather than 30 s.  The first
+// few commands after opening are clean with every fault setting used here.
+static void warmUp()
+{
+	int x, y, z;
+	CHECK_EQ(manipWhere(0, 2, &x, &y, &z), MANIP_OK);
+	CHECK_EQ(manipWhere(0, 1, &x, &y, &z), MANIP_OK);
+	CHECK_EQ(manipMove(0, 1, 20000, 0, 0), MANIP_OK);
+}
+
+// The number of 'M' commands written in a trace file
+static int movesWritten(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	manipTraceHeader header;
+	int moves = 0;
+	CHECK(file != NULL);
+	if (file == NULL)
+		return -1;
+	CHECK_EQ(fread(&header, sizeof(header), 1, file), 1);
+	std::vector<manipTraceRecord> records(header.capacity);
+	CHECK_EQ(fread(records.data(), sizeof(manipTraceRecord), header.capacity, file), header.capacity);
+	fclose(file);
+	CHECK(header.written <= header.capacity);
+	for (size_t i=0; i<records.size(); i++)
+		if (records[i].seq != 0 && records[i].op == traceWrite && records[i].payloadLength > 0 &&
+		    records[i].payload[0] == 'M')
+			moves++;
+	return moves;
+}
+
+static manipLinkHealth health()
+{
+	manipLinkHealth link;
+	memset(&link, 0, sizeof(link));
+	CHECK_EQ(manipGetLinkHealth(0, &link), MANIP_OK);
+	return link;
+}
+
+int main()
+{
+	const char *common = "devices=1;latencyUs=200;latencyTimer=0;stepsPerSecond=4000000";
+	char options[256];
+	manipLinkHealth link;
+
+	//No faults: nothing to count, and the reply timeout converges on the round trip
+	CHECK_EQ(openEmulator(common), 1);
+	warmUp();
+	exercise(40);
+	link = health();
+	CHECK_EQ(link.timeouts + link.badFrames + link.resyncs + link.retries + link.gaveUp, 0);
+	CHECK(link.roundTripMs > 0.1 && link.roundTripMs < 5);
+	CHECK(link.replyTimeoutMs < 20);
+	manipUninitialize();
+
+	//A reply short of its last byte is a timeout, and the command is sent again (a move is
+	//checked with 'C' instead)
+	snprintf(options, sizeof(options), "%s;dropEvery=7", common);
+	CHECK_EQ(openEmulator(options), 1);
+	warmUp();
+	exercise(60);
+	link = health();
+	CHECK(link.timeouts > 0);
+	CHECK(link.retries > 0);
+	CHECK_EQ(link.gaveUp, 0);
+	manipUninitialize();
+
+	//A reply whose CR is wrong is a bad frame, also sent again (or checked)
+	snprintf(options, sizeof(options), "%s;corruptEvery=6", common);
+	CHECK_EQ(openEmulator(options), 1);
+	warmUp();
+	exercise(60);
+	link = health();
+	CHECK(link.badFrames > 0);
+	CHECK(link.retries > 0);
+	CHECK_EQ(link.gaveUp, 0);
+	manipUninitialize();
+
+	//A command that gets no reply is only waited for as long as the adapted timeout, not
+	//the 500 ms read timeout
+	snprintf(options, sizeof(options), "%s;silentEvery=9", common);
+	CHECK_EQ(openEmulator(options), 1);
+	warmUp();
+	exercise(20);
+	manipResetStats(0);
+	double slowest = exercise(60);
+	link = health();
+	CHECK(link.timeouts > 0);
+	CHECK(link.retries > 0);
+	CHECK_EQ(link.gaveUp, 0);
+	CHECK(link.replyTimeoutMs < 100);
+	CHECK(slowest < 250);
+	manipUninitialize();
+
+	//Every 5th command unanswered, which lands on every third 'M' here: each move is still
+	//written exactly once, and the 'C' after it reads the right position
+	snprintf(options, sizeof(options), "%s;silentEvery=5", common);
+	CHECK_EQ(openEmulator(options), 1);
+	warmUp();
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/manipFaults%d.trace", (int)getpid());
+	CHECK_EQ(manipStartTrace(path, 4096), MANIP_OK);
+	exercise(60);
+	manipStopTrace();
+	CHECK_EQ(movesWritten(path), 60);
+	unlink(path);
+	link = health();
+	CHECK(link.timeouts > 0);
+	CHECK_EQ(link.gaveUp, 0);
+	manipUninitialize();
+
+	//A stray CR in front of a 'C' reply is realigned without sending the command again
+	snprintf(options, sizeof(options), "%s;strayEvery=5", common);
+	CHECK_EQ(openEmulator(options), 1);
+	warmUp();
+	exercise(60);
+	link = health();
+	CHECK(link.resyncs > 0);
+	CHECK_EQ(link.retries, 0);
+	CHECK_EQ(link.gaveUp, 0);
+	manipUninitialize();
+
+	//Every reply lost: the command is tried 1 + 2 times and then reported as failed
+	snprintf(options, sizeof(options), "%s;silentEvery=1", common);
+	int opened = openEmulator(options);
+	if (opened == 1) {
+		int x, y, z;
+		CHECK(manipWhere(0, 1, &x, &y, &z) != MANIP_OK);
+		link = health();
+		CHECK(link.gaveUp > 0);
+		CHECK_EQ(link.retries, 2*link.gaveUp);
+	}
+	manipUninitialize();
+	return testResult("testFaults");
+}
@@ -0,0 +1,89 @@
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "manipTest.h"
+#include "manipPositions.h"
+
+//Position publishing: a reader written in C sees what the I/O thread published, a second
+//publisher under the same name is refused while the first is running, and a segment left
+//live by a process that has gone is taken over.  runTests.sh builds the C reader
+//(readPositions.c) and the daemon and passes their paths in $MANIPCONTROL_READER and
+//$MANIPCONTROL_DAEMON.
+
+// Run the C reader on manipulator 0, drive 1; 1 if it printed a position
+static int readWithC(const char *name, int *live, int *count, int *x, int *y, int *z, unsigned *updates)
+{
+	char command[512];
+	snprintf(command, sizeof(command), "%s %s 0 1", getenv("MANIPCONTROL_READER"), name);
+	FILE *output = popen(command, "r");
+	if (output == NULL)
+		return 0;
+	int fields = fscanf(output, "%d %d %d %d %d %u", live, count, x, y, z, updates);
+	return pclose(output) == 0 && fields == 6;
+}
+
+int main()
+{
+	if (getenv("MANIPCONTROL_READER") == NULL || getenv("MANIPCONTROL_DAEMON") == NULL) {
+		printf("testPositions: MANIPCONTROL_READER or MANIPCONTROL_DAEMON isn't set\n");
+		return 1;
+	}
+	char name[64];
+	snprintf(name, sizeof(name), "/manipTest%d.positions", (int)getpid());
+	CHECK_EQ(openEmulator("devices=1;latencyUs=100;latencyTimer=0;stepsPerSecond=4000000"), 1);
+	CHECK_EQ(manipStartPublishing(name), MANIP_OK);
+	CHECK_EQ(manipMove(0, 1, 1234, 2345, 3456), MANIP_OK);
+
+	int live = 0, count = 0, x = 0, y = 0, z = 0;
+	unsigned updates = 0;
+	CHECK(readWithC(name, &live, &count, &x, &y, &z, &updates));
+	CHECK_EQ(live, 1);
+	CHECK_EQ(count, 1);
+	CHECK_EQ(x, 1234);
+	CHECK_EQ(y, 2345);
+	CHECK_EQ(z, 3456);
+	CHECK(updates >= 1);
+
+	//A daemon told to publish under the same name refuses to start, and leaves ours alone
+	char command[512];
+	snprintf(command, sizeof(command), "%s -s /tmp/manipTest%d.sock -t emulator -p %s 2>/dev/null",
+	         getenv("MANIPCONTROL_DAEMON"), (int)getpid(), name);
+	int status = system(command);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+	unsigned before = updates;
+	CHECK(readWithC(name, &live, &count, &x, &y, &z, &updates));
+	CHECK_EQ(live, 1);
+	CHECK_EQ(x, 1234);
+	CHECK_EQ(updates, before);
+	CHECK_EQ(manipMove(0, 1, 4321, 0, 0), MANIP_OK);
+	CHECK(readWithC(name, &live, &count, &x, &y, &z, &updates));
+	CHECK_EQ(x, 4321);
+	manipStopPublishing();
+
+	//A segment still marked live by a process that has exited is taken over
+	pid_t gone = fork();
+	if (gone == 0)
+		_exit(0);
+	waitpid(gone, NULL, 0);
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+	CHECK(fd >= 0 && ftruncate(fd, sizeof(manipPositionsFile)) == 0);
+	manipPositionsFile *file = (manipPositionsFile*)mmap(NULL, sizeof(manipPositionsFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	CHECK(file != MAP_FAILED);
+	if (file != MAP_FAILED) {
+		memcpy(file->magic, POSITIONS_MAGIC, sizeof(file->magic));
+		file->pid = (uint32_t)gone;
+		file->live.store(1);
+		file->numManips.store(7);
+		CHECK_EQ(manipStartPublishing(name), MANIP_OK);
+		CHECK_EQ(file->numManips.load(), 1);
+		CHECK_EQ(file->pid, (uint32_t)getpid());
+		munmap(file, sizeof(manipPositionsFile));
+	}
+	manipStopPublishing();
+
+	manipUninitialize();
+	return testResult("testPositions");
+}
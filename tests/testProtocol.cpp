@@ -0,0 +1,125 @@
+#include <limits.h>
+#include <string.h>
+#include "manipTest.h"
+#include "manipProtocol.h"
+
+//manipProtocol.h: every frame encodes to the controller's byte layout and decodes back,
+//at the ends of the coordinate and speed ranges.
+
+static const int coordinates[] = { 0, 1, 255, 256, 65535, 65536, 399999, 400000, -1, -400000, INT_MAX, INT_MIN };
+static const int numCoordinates = sizeof(coordinates) / sizeof(coordinates[0]);
+
+// Whether bytes at offset hold value least significant byte first
+static int littleEndianAt(const unsigned char *bytes, int offset, int value)
+{
+	uint32_t bits = (uint32_t)value;
+	return bytes[offset] == (bits & 0xFF) && bytes[offset+1] == ((bits >> 8) & 0xFF) &&
+	       bytes[offset+2] == ((bits >> 16) & 0xFF) && bytes[offset+3] == (bits >> 24);
+}
+
+int main()
+{
+	//Frame lengths, and how a byte stream splits into commands
+	CHECK_EQ(sizeof(wakeCommand), 1);
+	CHECK_EQ(sizeof(driveCommand), 2);
+	CHECK_EQ(sizeof(moveCommand), 13);
+	CHECK_EQ(sizeof(velocityCommand), 4);
+	CHECK_EQ(sizeof(positionReply), 14);
+	CHECK_EQ(sizeof(statusReply), 6);
+	CHECK_EQ(commandSize(protoWake), 1);
+	CHECK_EQ(commandSize(protoDrive), 2);
+	CHECK_EQ(commandSize(protoPosition), 1);
+	CHECK_EQ(commandSize(protoMove), 13);
+	CHECK_EQ(commandSize(protoVelocity), 4);
+	CHECK_EQ(commandSize(protoStatus), 1);
+	CHECK_EQ(commandSize('Z'), 1);
+
+	//One byte commands
+	CHECK_EQ(encodeWake().bytes[0], 0xEE);
+	CHECK_EQ(encodePositionQuery().bytes[0], 'C');
+	CHECK_EQ(encodeStatusQuery().bytes[0], 'U');
+
+	//'I'
+	for (int drive=0; drive<=255; drive++) {
+		driveCommand command = encodeDriveChange(drive);
+		CHECK_EQ(command.bytes[0], 'I');
+		CHECK_EQ(decodeDriveChange(command), drive);
+	}
+
+	//'M' and 'C', every combination of the boundary coordinates on each axis
+	for (int i=0; i<numCoordinates; i++) {
+		for (int j=0; j<numCoordinates; j++) {
+			int x = coordinates[i], y = coordinates[j], z = coordinates[numCoordinates-1-i];
+			moveCommand move = encodeMove(x, y, z);
+			CHECK_EQ(move.bytes[0], 'M');
+			CHECK(littleEndianAt(move.bytes, 1, x) && littleEndianAt(move.bytes, 5, y) && littleEndianAt(move.bytes, 9, z));
+			int dx, dy, dz;
+			decodeMove(move, &dx, &dy, &dz);
+			CHECK(dx == x && dy == y && dz == z);
+
+			positionReply position = encodePosition(1 + (i & 1), x, y, z);
+			CHECK_EQ(position.bytes[0], 1 + (i & 1));
+			CHECK_EQ(position.bytes[13], protocolCR);
+			CHECK(littleEndianAt(position.bytes, 1, x) && littleEndianAt(position.bytes, 5, y) && littleEndianAt(position.bytes, 9, z));
+			CHECK(positionFramed(position, 1 + (i & 1)));
+			CHECK(!positionFramed(position, 2 - (i & 1)));
+			decodePosition(position, &dx, &dy, &dz);
+			CHECK(dx == x && dy == y && dz == z);
+		}
+	}
+	positionReply position = encodePosition(1, 0, 0, 0);
+	position.bytes[13] = 0;
+	CHECK(!replyTerminated(position));
+	CHECK(!positionFramed(position, 1));
+
+	//'V': bits 0-14 the speed, bit 15 the fine resolution, then CR
+	static const int speeds[] = { 0, 1, 100, 3000, 0x7FFE, 0x7FFF };
+	for (unsigned i=0; i<sizeof(speeds)/sizeof(speeds[0]); i++) {
+		for (int fine=0; fine<=1; fine++) {
+			velocityCommand velocity = encodeVelocity(speeds[i], fine);
+			CHECK_EQ(velocity.bytes[0], 'V');
+			CHECK_EQ(velocity.bytes[1], speeds[i] & 0xFF);
+			CHECK_EQ(velocity.bytes[2], (speeds[i] >> 8) | (fine ? 0x80 : 0));
+			CHECK_EQ(velocity.bytes[3], protocolCR);
+			int speed = -1, decodedFine = -1;
+			CHECK(decodeVelocity(velocity, &speed, &decodedFine));
+			CHECK_EQ(speed, speeds[i]);
+			CHECK_EQ(decodedFine, fine);
+		}
+	}
+	//Out of range speeds are clamped rather than spilling into the fine bit
+	int speed, fine;
+	decodeVelocity(encodeVelocity(0x8000, 0), &speed, &fine);
+	CHECK_EQ(speed, protocolMaxSpeed);
+	CHECK_EQ(fine, 0);
+	decodeVelocity(encodeVelocity(INT_MAX, 1), &speed, &fine);
+	CHECK_EQ(speed, protocolMaxSpeed);
+	CHECK_EQ(fine, 1);
+	decodeVelocity(encodeVelocity(-5, 0), &speed, &fine);
+	CHECK_EQ(speed, 0);
+	velocityCommand velocity = encodeVelocity(100, 1);
+	velocity.bytes[3] = 0;
+	CHECK(!decodeVelocity(velocity, &speed, &fine));
+
+	//'U'
+	const unsigned char status[protocolStatusDrives] = { 1, 0, 255, 7 };
+	statusReply reply = encodeStatus(3, status);
+	CHECK_EQ(reply.bytes[0], 3);
+	CHECK(memcmp(reply.bytes + 1, status, protocolStatusDrives) == 0);
+	CHECK_EQ(reply.bytes[5], protocolCR);
+	unsigned char decoded[protocolStatusDrives];
+	CHECK_EQ(decodeStatus(reply, decoded), 3);
+	CHECK(memcmp(decoded, status, protocolStatusDrives) == 0);
+	reply.bytes[5] = 'x';
+	CHECK_EQ(decodeStatus(reply, decoded), -1);
+
+	//The bare CR replies to 'I', 'M' and 'V'
+	CHECK_EQ(encodeAck<driveReply>().bytes[0], protocolCR);
+	CHECK_EQ(encodeAck<moveReply>().bytes[0], protocolCR);
+	CHECK_EQ(encodeAck<velocityReply>().bytes[0], protocolCR);
+	CHECK(replyTerminated(encodeAck<moveReply>()));
+	moveReply ack = { { 0 } };
+	CHECK(!replyTerminated(ack));
+
+	return testResult("testProtocol");
+}
@@ -0,0 +1,127 @@
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+#include "manipTest.h"
+#define MANIP_TRACE_DECODER
+#include "manipTrace.h"
+#include "manipProtocol.h"
+
+//Moves at a set or planned speed.  The planner's speed and resolution at either side of
+//each distance band, the velocity commands that go on the wire for them (read back from a
+//trace), and the travel time at 16 steps per um.  A slow move longer than the 30 s a move
+//without an estimate is waited for still ends with its one reply, with no timeout and
+//nothing sent again.
+
+// One planned move: distance (steps) and what the planner should choose for it
+typedef struct {
+	int steps;
+	int speed, fine;
+} plannedCase;
+
+static const plannedCase plannedCases[] = {
+	{ 159, 100, 1 }, { 160, 100, 1 }, { 161, 400, 1 },
+	{ 1599, 400, 1 }, { 1600, 400, 0 }, { 1601, 1500, 0 },
+	{ 15999, 1500, 0 }, { 16000, 1500, 0 }, { 16001, 2500, 0 },
+	{ 79999, 2500, 0 }, { 80000, 2500, 0 }, { 80001, 3000, 0 },
+};
+static const int numPlannedCases = sizeof(plannedCases) / sizeof(plannedCases[0]);
+
+// The 'V' frames written in a trace file, in the order they were sent
+static std::vector<velocityCommand> tracedVelocities(const char *path)
+{
+	std::vector<velocityCommand> frames;
+	FILE *file = fopen(path, "rb");
+	manipTraceHeader header;
+	if (file == NULL || fread(&header, sizeof(header), 1, file) != 1) {
+		if (file != NULL)
+			fclose(file);
+		return frames;
+	}
+	std::vector<manipTraceRecord> records(header.capacity);
+	size_t count = fread(records.data(), sizeof(manipTraceRecord), records.size(), file);
+	fclose(file);
+	records.resize(count);
+	std::sort(records.begin(), records.end(), [](const manipTraceRecord &a, const manipTraceRecord &b) { return a.seq < b.seq; });
+	for (size_t i=0; i<records.size(); i++) {
+		const manipTraceRecord &record = records[i];
+		if (record.seq != 0 && record.op == traceWrite && record.payloadLength == velocityCommand::size &&
+		    record.payload[0] == protoVelocity) {
+			velocityCommand frame;
+			memcpy(frame.bytes, record.payload, velocityCommand::size);
+			frames.push_back(frame);
+		}
+	}
+	return frames;
+}
+
+int main()
+{
+	CHECK_EQ(openEmulator("devices=1;latencyUs=200;latencyTimer=0"), 1);
+	int x, y, z;
+	CHECK_EQ(manipMove(0, 1, 200000, 0, 0), MANIP_OK);
+
+	//Back and forth around 200000 by each distance, letting the planner choose
+	char tracePath[64];
+	snprintf(tracePath, sizeof(tracePath), "/tmp/manipTest%d.trace", (int)getpid());
+	CHECK_EQ(manipStartTrace(tracePath, 4096), MANIP_OK);
+	std::vector<plannedCase> expectedSent;
+	int position = 200000, lastSpeed = 0, lastFine = -1;
+	for (int i=0; i<numPlannedCases; i++) {
+		const plannedCase *expected = &plannedCases[i];
+		position += (i & 1) ? -expected->steps : expected->steps;
+		manipSpeedMove move;
+		memset(&move, 0, sizeof(move));
+		CHECK_EQ(manipMoveAtSpeed(0, 1, position, 0, 0, &move), MANIP_OK);
+		CHECK_EQ(move.speedUsed, expected->speed);
+		CHECK_EQ(move.fineUsed, expected->fine);
+		int changed = expected->speed != lastSpeed || expected->fine != lastFine;
+		CHECK_EQ(move.velocitySent, changed);
+		if (changed)
+			expectedSent.push_back(*expected);
+		lastSpeed = expected->speed;
+		lastFine = expected->fine;
+		//16 steps per um: the travel part of the prediction, then the move itself
+		double travelMs = 1000.0 * expected->steps / (expected->speed * 16.0);
+		CHECK(move.predictedMs >= travelMs && move.predictedMs < travelMs + 5);
+		CHECK(move.measuredMs > 0.95 * travelMs && move.measuredMs < 1.05 * travelMs + 20);
+	}
+	CHECK_EQ(manipWhere(0, 1, &x, &y, &z), MANIP_OK);
+	CHECK_EQ(x, position);
+	manipStopTrace();
+
+	//The velocity commands sent, in the MP-285 layout: speed in bits 0-14, fine in bit 15, CR
+	std::vector<velocityCommand> sent = tracedVelocities(tracePath);
+	unlink(tracePath);
+	CHECK_EQ(sent.size(), expectedSent.size());
+	for (size_t i=0; i<sent.size() && i<expectedSent.size(); i++) {
+		unsigned value = expectedSent[i].speed | (expectedSent[i].fine ? 0x8000 : 0);
+		CHECK_EQ(sent[i].bytes[0], 'V');
+		CHECK_EQ(sent[i].bytes[1], value & 0xFF);
+		CHECK_EQ(sent[i].bytes[2], value >> 8);
+		CHECK_EQ(sent[i].bytes[3], 0x0D);
+	}
+
+	//500 steps at 1 um/s (16 steps/s): 31 s
+	CHECK_EQ(manipWhere(0, 1, &x, &y, &z), MANIP_OK);
+	manipResetStats(0);
+	manipSpeedMove move;
+	memset(&move, 0, sizeof(move));
+	move.speed = 1;
+	CHECK_EQ(manipMoveAtSpeed(0, 1, x + 500, y, z, &move), MANIP_OK);
+	CHECK_EQ(move.speedUsed, 1);
+	CHECK_EQ(move.velocitySent, 1);
+	CHECK(move.predictedMs > 31250 && move.predictedMs < 31300);
+	CHECK(move.measuredMs > 31000 && move.measuredMs < 32500);
+	manipLinkHealth health;
+	CHECK_EQ(manipGetLinkHealth(0, &health), MANIP_OK);
+	CHECK_EQ(health.timeouts, 0);
+	CHECK_EQ(health.retries, 0);
+	CHECK_EQ(health.gaveUp, 0);
+	int after;
+	CHECK_EQ(manipWhere(0, 1, &after, &y, &z), MANIP_OK);
+	CHECK_EQ(after, x + 500);
+
+	manipUninitialize();
+	return testResult("testSpeed");
+}
@@ -0,0 +1,41 @@
+#include "manipTest.h"
+
+//setTarget under load: a target set while other calls keep the queue full is still sent
+//after a few of them, not once the queue drains.
+
+int main()
+{
+	CHECK_EQ(openEmulator("devices=1;latencyUs=200;latencyTimer=0;stepsPerSecond=40000"), 1);
+
+	//30 queued moves of 100 steps take about 100 ms
+	for (int i=0; i<30; i++)
+		CHECK_EQ(manipMoveAsync(0, 1, 1000 + 100*(i & 1), 0, 0), MANIP_OK);
+	CHECK_EQ(manipSetTarget(0, 2, 5000, 6000, 7000), MANIP_OK);
+	manipTargetCounters counters = { 0, 0, 0, 0 };
+	double start = testNowMs();
+	while (counters.sent == 0 && testNowMs() - start < 5000)
+		manipTargetCounts(0, &counters);
+	CHECK_EQ(counters.sent, 1);
+	CHECK_EQ(manipIsMoving(0), 1);					//most of the queued moves are still to run
+	CHECK_EQ(manipWaitMove(0, 5000, NULL), 1);
+
+	int x, y, z;
+	CHECK_EQ(manipWhere(0, 2, &x, &y, &z), MANIP_OK);
+	CHECK_EQ(x, 5000);
+	CHECK_EQ(y, 6000);
+	CHECK_EQ(z, 7000);
+
+	//With nothing else queued a target goes straight away, and a burst is coalesced
+	for (int i=0; i<50; i++)
+		manipSetTarget(0, 1, 2000 + i, 0, 0);
+	CHECK_EQ(manipWaitMove(0, 5000, NULL), 1);
+	CHECK_EQ(manipWhere(0, 1, &x, &y, &z), MANIP_OK);
+	CHECK_EQ(x, 2049);
+	manipTargetCounts(0, &counters);
+	CHECK_EQ(counters.received, 51);
+	CHECK_EQ(counters.sent + counters.coalesced, 51);
+	CHECK_EQ(counters.failed, 0);
+
+	manipUninitialize();
+	return testResult("testTargets");
+}
@@ -0,0 +1,165 @@
+#include <string.h>
+#include <pty.h>
+#include <poll.h>
+#include <unistd.h>
+#include <thread>
+#include <atomic>
+#include "manipTest.h"
+#include "manipProtocol.h"
+
+//The termios backend over a pty loopback.  openpty() gives a master/slave pair; the library
+//opens the slave as if it were /dev/ttyUSB0 (setTransport('termios',path)) and a thread on the
+//master side answers like an ROE-200, using the frames in manipProtocol.h.  This runs the
+//real termios open, TCSETS2 configuration (128000 baud needs BOTHER), non-blocking
+//reads and writes with their poll() deadlines, FIONREAD and TCFLSH.  A pty has no
+//TIOCGSERIAL, so the ASYNC_LOW_LATENCY request is refused, which must not stop the port
+//from opening.
+
+#define kernelBOTHER 0010000				//BOTHER from <asm/termbits.h>, which can't be included with <pty.h>
+
+static int masterFd = -1;
+static std::atomic<int> stopController(0);
+static std::atomic<int> driveChanges(0);
+static std::atomic<int> positionQueries(0);
+static std::atomic<int> moves(0);
+static std::atomic<int> wakes(0);
+static std::atomic<int> strayBeforeNext(0);	//put a stray CR in front of the next reply
+
+static void reply(const unsigned char *bytes, int length)
+{
+	if (strayBeforeNext.exchange(0)) {
+		unsigned char stray = protocolCR;
+		if (write(masterFd, &stray, 1) != 1)
+			return;
+	}
+	if (write(masterFd, bytes, length) != length)
+		printf("Error. Short write on the pty master\n");
+}
+
+// The stand-in controller: two drives, drive 1 starting at (1000,2000,3000)
+static void controllerMain()
+{
+	int drive = 1;
+	int position[3][3] = { {0,0,0}, {1000,2000,3000}, {0,0,0} };
+	unsigned char input[64];
+	int length = 0;
+	while (!stopController.load()) {
+		struct pollfd ready = { masterFd, POLLIN, 0 };
+		if (poll(&ready, 1, 20) <= 0)
+			continue;
+		ssize_t count = read(masterFd, input + length, sizeof(input) - length);
+		if (count <= 0)
+			continue;
+		length += (int)count;
+		while (length > 0 && length >= (int)commandSize(input[0])) {
+			int needed = (int)commandSize(input[0]);
+			if (input[0] == protoWake)
+				wakes++;
+			else if (input[0] == protoDrive) {
+				driveCommand command;
+				memcpy(command.bytes, input, driveCommand::size);
+				drive = decodeDriveChange(command);
+				if (drive < 1 || drive > 2)
+					drive = 1;
+				driveChanges++;
+				driveReply frame = encodeAck<driveReply>();
+				reply(frame.bytes, driveReply::size);
+			}
+			else if (input[0] == protoPosition) {
+				positionQueries++;
+				positionReply frame = encodePosition(drive, position[drive][0], position[drive][1], position[drive][2]);
+				reply(frame.bytes, positionReply::size);
+			}
+			else if (input[0] == protoMove) {
+				moveCommand command;
+				memcpy(command.bytes, input, moveCommand::size);
+				decodeMove(command, &position[drive][0], &position[drive][1], &position[drive][2]);
+				moves++;
+				moveReply frame = encodeAck<moveReply>();
+				reply(frame.bytes, moveReply::size);
+			}
+			length -= needed;
+			memmove(input, input + needed, length);
+		}
+	}
+}
+
+int main()
+{
+	int slaveFd = -1;
+	char slaveName[256];
+	if (openpty(&masterFd, &slaveFd, slaveName, NULL, NULL) != 0) {
+		printf("Error. openpty failed, skipping\n");
+		return 0;
+	}
+	std::thread controller(controllerMain);
+
+	CHECK_EQ(manipSetTransport("termios", slaveName), MANIP_OK);
+	manipOpenResult results[MANIP_MAX_MANIPS];
+	int tried = 0;
+	manipInitialize(NULL, 0, results, &tried);
+	CHECK_EQ(tried, 1);
+	CHECK_EQ(results[0].status, MANIP_OK);
+	CHECK_EQ(manipCount(), 1);
+	CHECK_EQ(manipFind(slaveName), 0);				//a listed path is its own serial number
+	CHECK(wakes.load() >= 1);
+
+	//The port was put in raw 8N1 at a baud rate with no Bxxx constant
+	struct termios tio;
+	CHECK_EQ(tcgetattr(slaveFd, &tio), 0);
+	CHECK_EQ(tio.c_lflag & (ICANON | ECHO | ISIG), 0);
+	CHECK_EQ(tio.c_iflag & (ICRNL | IXON), 0);
+	CHECK_EQ(tio.c_cflag & CSIZE, CS8);
+	CHECK_EQ(tio.c_cflag & CBAUD, kernelBOTHER);
+	manipLinkConfig config;
+	CHECK_EQ(manipGetLink(0, &config), MANIP_OK);
+	CHECK_EQ(config.baudRate, 128000);
+
+	int x = 0, y = 0, z = 0;
+	CHECK_EQ(manipWhere(0, 1, &x, &y, &z), MANIP_OK);
+	CHECK_EQ(x, 1000);
+	CHECK_EQ(y, 2000);
+	CHECK_EQ(z, 3000);
+	CHECK_EQ(manipMove(0, 2, 400000, 0, 123456), MANIP_OK);
+	CHECK_EQ(manipWhere(0, 2, &x, &y, &z), MANIP_OK);
+	CHECK_EQ(x, 400000);
+	CHECK_EQ(y, 0);
+	CHECK_EQ(z, 123456);
+	CHECK_EQ(driveChanges.load(), 2);				//1 for the first where, 2 for the move; none for the where after it
+	CHECK_EQ(moves.load(), 1);
+
+	//A stray byte in front of a reply is recovered from through FIONREAD and TCFLSH
+	strayBeforeNext = 1;
+	CHECK_EQ(manipWhere(0, 2, &x, &y, &z), MANIP_OK);
+	CHECK_EQ(x, 400000);
+	manipLinkHealth health;
+	CHECK_EQ(manipGetLinkHealth(0, &health), MANIP_OK);
+	CHECK(health.resyncs >= 1);
+	CHECK_EQ(health.gaveUp, 0);
+
+	//Standard rates are set the same way, through TCSETS2 with BOTHER
+	config.baudRate = 57600;
+	CHECK_EQ(manipConfigureLink(0, &config), MANIP_OK);
+	CHECK_EQ(manipGetLink(0, &config), MANIP_OK);
+	CHECK_EQ(config.baudRate, 57600);
+	CHECK_EQ(tcgetattr(slaveFd, &tio), 0);
+	CHECK_EQ(tio.c_cflag & CBAUD, kernelBOTHER);
+	CHECK_EQ(manipWhere(0, 1, &x, &y, &z), MANIP_OK);
+	CHECK_EQ(x, 1000);
+
+	//Round trips over the pty, for comparison with benchWhere's emulated ones
+	std::vector<double> ms;
+	for (int i=0; i<200; i++) {
+		double start = testNowMs();
+		manipWhere(0, 1, &x, &y, &z);
+		ms.push_back(testNowMs() - start);
+	}
+	printLatencies("where over a pty", ms);
+
+	manipUninitialize();
+	stopController = 1;
+	controller.join();
+	close(slaveFd);
+	close(masterFd);
+	return testResult("testTermios");
+}
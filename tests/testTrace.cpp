@@ -0,0 +1,42 @@
+#include <unistd.h>
+#include <vector>
+#include "manipTest.h"
+#define MANIP_TRACE_DECODER
+#include "manipTrace.h"
+
+//Transaction trace: a ring smaller than the traffic keeps the newest records, one per slot,
+//and the header's count of records written is set once, when the trace stops.
+
+int main()
+{
+	CHECK_EQ(openEmulator("devices=2;latencyUs=100;latencyTimer=0"), 2);
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/manipTest%d.trace", (int)getpid());
+	CHECK_EQ(manipStartTrace(path, 16), MANIP_OK);
+	//Both devices' I/O threads append at once
+	manipPosition positions[2*MANIP_MAX_DRIVES];
+	for (int i=0; i<50; i++)
+		CHECK_EQ(manipWhereAll(positions, 2*MANIP_MAX_DRIVES), 2*MANIP_MAX_DRIVES);
+	unsigned long long written = manipStopTrace();
+	CHECK(written > 16);
+
+	FILE *file = fopen(path, "rb");
+	manipTraceHeader header;
+	std::vector<manipTraceRecord> records(16);
+	CHECK(file != NULL);
+	if (file != NULL) {
+		CHECK_EQ(fread(&header, sizeof(header), 1, file), 1);
+		CHECK_EQ(fread(records.data(), sizeof(manipTraceRecord), 16, file), 16);
+		fclose(file);
+		CHECK_EQ(header.capacity, 16);
+		CHECK_EQ(header.written, written);
+		//Slot n % 16 holds record n, for the last 16 records
+		for (int i=0; i<16; i++) {
+			CHECK(records[i].seq > written - 16 && records[i].seq <= written);
+			CHECK_EQ((records[i].seq - 1) % 16, i);
+		}
+	}
+	unlink(path);
+	manipUninitialize();
+	return testResult("testTrace");
+}